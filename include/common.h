@@ -1,13 +1,13 @@
 #ifndef TINY_JS_COMMON_H
 #define TINY_JS_COMMON_H
 
-#include <variant>
 #include <string>
 #include <sstream>
 #include <fstream>
 #include <cmath>
 #include <cstdint>
 #include <memory>
+#include <bit>
 
 // #define DEBUG
 
@@ -15,7 +15,75 @@ struct Chunk;
 
 struct Obj;
 
-using Value = std::variant<std::monostate, bool, double, Obj*>;
+// NaN-boxing 值表示：8 字节
+// - 数字：直接存放 IEEE754 双精度位模式
+// - 其它类型：编码在静默 NaN 的空闲位中，对象指针额外带符号位
+class Value
+{
+    static constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+    static constexpr uint64_t QNAN = 0x7ffc000000000000;
+
+    static constexpr uint64_t TAG_NIL = 1;
+    static constexpr uint64_t TAG_FALSE = 2;
+    static constexpr uint64_t TAG_TRUE = 3;
+
+    uint64_t bits;
+
+public:
+    constexpr Value() : bits(QNAN | TAG_NIL)
+    {
+    }
+
+    constexpr Value(const bool b) : bits(b ? QNAN | TAG_TRUE : QNAN | TAG_FALSE)
+    {
+    }
+
+    constexpr Value(const double d) : bits(std::bit_cast<uint64_t>(d))
+    {
+    }
+
+    Value(Obj* o) : bits(SIGN_BIT | QNAN | reinterpret_cast<uintptr_t>(o))
+    {
+    }
+
+    static constexpr Value nil() { return Value(); }
+
+    // 从原始位模式还原（JIT 生成代码直接读写 Value 时使用）
+    static constexpr Value fromBits(const uint64_t raw)
+    {
+        Value v;
+        v.bits = raw;
+        return v;
+    }
+
+    [[nodiscard]] constexpr uint64_t raw() const { return bits; }
+
+    // 非数字的值在这些位上全为 1（JIT 生成代码据此判断类型）
+    static constexpr uint64_t tagMask() { return QNAN; }
+
+    [[nodiscard]] constexpr bool isNil() const { return bits == (QNAN | TAG_NIL); }
+
+    [[nodiscard]] constexpr bool isBool() const { return (bits | 1) == (QNAN | TAG_TRUE); }
+
+    [[nodiscard]] constexpr bool isNumber() const { return (bits & QNAN) != QNAN; }
+
+    [[nodiscard]] constexpr bool isObj() const { return (bits & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT); }
+
+    [[nodiscard]] constexpr bool asBool() const { return bits == (QNAN | TAG_TRUE); }
+
+    [[nodiscard]] constexpr double asNumber() const { return std::bit_cast<double>(bits); }
+
+    [[nodiscard]] Obj* asObj() const { return reinterpret_cast<Obj*>(static_cast<uintptr_t>(bits & ~(SIGN_BIT | QNAN))); }
+
+    // 数字按 IEEE754 比较（NaN 不等于自身），其余按位比较
+    friend constexpr bool operator==(const Value a, const Value b)
+    {
+        if (a.isNumber() && b.isNumber()) return a.asNumber() == b.asNumber();
+        return a.bits == b.bits;
+    }
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay NaN-boxed in 8 bytes");
 
 inline std::string readFile(const std::string& path)
 {
@@ -51,6 +51,9 @@ class Compiler
     // 发出全局变量指令（操作码 + 两字节常量索引）
     void emitGlobalOp(uint8_t opcode, int constIdx) const;
 
+    // 发出属性访问指令（操作码 + 两字节名称常量索引 + 两字节内联缓存索引）
+    void emitPropertyOp(OpCode op, int nameIdx) const;
+
     // 发出常量指令
     void emitConstant(int index) const;
 
@@ -63,6 +66,9 @@ class Compiler
     // 发出循环指令
     void emitLoop(int start) const;
 
+    // 解析全局变量，返回变量在 VM 全局表中的槽位（不存在时分配新槽位）
+    [[nodiscard]] int resolveGlobal(const std::string& name) const;
+
     // 解析局部变量，返回变量在栈中的位置，找不到返回-1
     static int resolveLocal(const CompilerState* s, const std::string& n);
 
@@ -0,0 +1,204 @@
+#ifndef TINY_JS_HEAP_H
+#define TINY_JS_HEAP_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 对象堆：按尺寸类（size class）管理对象内存
+// 每个 64 KiB 的块只存放同一尺寸类的对象：先在块内按指针碰撞连续切分，释放的单元挂入块内空闲链表优先复用；
+// 对象不移动，块内对象全部释放后整块回收复用
+//
+// 块头中有两张位图，每个 16 字节对齐的位置对应一位：分配位图记录哪些单元存放着对象，标记位图是垃圾回收的标记位。
+// 清理按块进行，不同的块可以由不同的线程同时清理
+class Heap
+{
+public:
+    // 块大小（同时也是块的对齐值，用于由对象地址反查所在块）
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+    // 对象对齐，也是尺寸类的粒度
+    static constexpr size_t ALIGNMENT = 16;
+    // 可分配的最大对象大小
+    static constexpr size_t MAX_OBJECT_SIZE = 1024;
+    // 尺寸类数量
+    static constexpr size_t SIZE_CLASSES = MAX_OBJECT_SIZE / ALIGNMENT;
+    // 位图的字数（每个对齐位置一位）
+    static constexpr size_t BITMAP_WORDS = BLOCK_SIZE / ALIGNMENT / 64;
+
+    // 空闲单元，复用单元自身的内存链接
+    struct FreeCell
+    {
+        FreeCell* next;
+    };
+
+    // 块头，位于每个块的起始处
+    struct Block
+    {
+        // 所在尺寸类可用块链表的前后指针
+        Block* prev;
+        Block* next;
+        // 尚未切分的区域
+        uint8_t* cursor;
+        uint8_t* end;
+        // 已释放、可复用的单元
+        FreeCell* freeList;
+        uint32_t cellSize;
+        // 块中尚未释放的对象数
+        uint32_t liveObjects;
+        // 在已用块列表和本轮清理列表中的位置
+        uint32_t usedIndex;
+        uint32_t sweepIndex;
+        // 是否在可用块链表中
+        bool available;
+        // 是否在本轮清理中尚未被清理
+        bool sweepPending;
+        // 分配位图和标记位图（标记位由标记线程和主线程通过原子操作访问）
+        uint64_t allocBits[BITMAP_WORDS];
+        uint64_t markBits[BITMAP_WORDS];
+    };
+
+    Heap() = default;
+    ~Heap();
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    // 对象实际占用的单元大小
+    static constexpr size_t cellSize(const size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+    // 由对象地址取得它所在单元的大小
+    static size_t allocationSize(const void* p);
+
+    // 分配 size 字节，优先复用同尺寸类的空闲单元
+    void* allocate(size_t size);
+
+    // 归还对象空间（对象需已析构）
+    void free(void* p);
+
+    // 自上次 resetNursery 以来分配的字节数（即新生代大小）
+    [[nodiscard]] size_t nurseryBytes() const { return nurseryAllocated; }
+    void resetNursery() { nurseryAllocated = 0; }
+
+    // 当前持有的块数
+    [[nodiscard]] size_t blockCount() const { return blocks; }
+
+    // 对象是否已标记
+    static bool isMarked(const void* p)
+    {
+        const size_t i = cellIndex(p);
+        return std::atomic_ref(blockOf(p)->markBits[i / 64]).load(std::memory_order_relaxed) & bitOf(i);
+    }
+
+    // 标记对象，本次调用将其从未标记变为已标记时返回 true（可在多个线程上并发调用）
+    static bool mark(const void* p)
+    {
+        const size_t i = cellIndex(p);
+        std::atomic_ref word(blockOf(p)->markBits[i / 64]);
+        if (word.load(std::memory_order_relaxed) & bitOf(i)) return false;
+        return !(word.fetch_or(bitOf(i), std::memory_order_relaxed) & bitOf(i));
+    }
+
+    // 清除对象的标记位
+    static void clearMark(const void* p)
+    {
+        const size_t i = cellIndex(p);
+        std::atomic_ref(blockOf(p)->markBits[i / 64]).fetch_and(~bitOf(i), std::memory_order_relaxed);
+    }
+
+    // 对象所在的块是否在本轮清理中尚未被清理
+    static bool sweepPending(const void* p) { return blockOf(p)->sweepPending; }
+
+    // 访问所有已分配的单元（visit 不能分配或释放单元）
+    template <typename F>
+    void forEachCell(F&& visit) const
+    {
+        for (Block* block : usedBlocks)
+        {
+            for (size_t w = 0; w < BITMAP_WORDS; w++)
+            {
+                for (uint64_t bits = block->allocBits[w]; bits; bits &= bits - 1)
+                {
+                    visit(cellAt(block, w * 64 + std::countr_zero(bits)));
+                }
+            }
+        }
+    }
+
+    // 开始一轮清理：记录当前所有的块，之后由 takeSweepBlock 逐个领取
+    void beginSweep();
+
+    // 领取下一个待清理的块，清理完时返回 nullptr（可在多个线程上并发调用）
+    Block* takeSweepBlock();
+
+    // 清理一个块：对每个已分配的单元调用 sweepCell，返回 true 表示对象已析构、单元可以回收。
+    // 只修改该块，不同的块可以在不同线程上同时清理；之后需在主线程调用 finishSweptBlocks
+    template <typename F>
+    static void sweepBlock(Block* block, F&& sweepCell)
+    {
+        for (size_t w = 0; w < BITMAP_WORDS; w++)
+        {
+            for (uint64_t bits = block->allocBits[w]; bits; bits &= bits - 1)
+            {
+                const size_t i = w * 64 + std::countr_zero(bits);
+                if (sweepCell(cellAt(block, i))) releaseCell(block, i);
+            }
+        }
+        block->sweepPending = false;
+    }
+
+    // 整理已清理的块：归还空块，有空闲单元的块挂入可用链表
+    void finishSweptBlocks();
+
+    // 本轮清理是否已领取完所有的块
+    [[nodiscard]] bool sweepDone() const { return sweepCursor.load(std::memory_order_relaxed) >= sweepBlocks.size(); }
+
+private:
+
+    struct SizeClass
+    {
+        // 正在分配的块
+        Block* current = nullptr;
+        // 有空闲单元的其他块
+        Block* available = nullptr;
+    };
+
+    // 保留的空块上限，超出的块直接还给系统
+    static constexpr size_t MAX_FREE_BLOCKS = 16;
+
+    std::array<SizeClass, SIZE_CLASSES> classes{};
+    std::vector<Block*> freeBlocks;
+    // 持有对象的块（包括各尺寸类的当前块）
+    std::vector<Block*> usedBlocks;
+    // 本轮清理的块（清理前被归还的块置为空），以及下一个待领取和待整理的位置
+    std::vector<Block*> sweepBlocks;
+    std::atomic<size_t> sweepCursor{0};
+    size_t sweepFinished = 0;
+    size_t nurseryAllocated = 0;
+    size_t blocks = 0;
+
+    static size_t headerSize();
+
+    static Block* blockOf(const void* p)
+    {
+        return reinterpret_cast<Block*>(reinterpret_cast<uintptr_t>(p) & ~(BLOCK_SIZE - 1));
+    }
+
+    static size_t cellIndex(const void* p) { return (reinterpret_cast<uintptr_t>(p) & (BLOCK_SIZE - 1)) / ALIGNMENT; }
+    static uint64_t bitOf(const size_t i) { return uint64_t{1} << (i % 64); }
+    static void* cellAt(Block* block, const size_t i) { return reinterpret_cast<uint8_t*>(block) + i * ALIGNMENT; }
+
+    // 把单元放回块的空闲链表（不调整块所在的链表）
+    static void releaseCell(Block* block, size_t i);
+
+    static bool hasRoom(const Block* block);
+    Block* newBlock(uint32_t cellSize);
+    void releaseBlock(Block* block);
+    // 单元释放后调整块所在的链表：空块归还，有空闲单元的块挂入可用链表
+    void updateBlock(Block* block);
+    void linkAvailable(SizeClass& sc, Block* block);
+    void unlinkAvailable(SizeClass& sc, Block* block);
+};
+
+#endif //TINY_JS_HEAP_H
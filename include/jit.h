@@ -1,21 +1,107 @@
 #pragma once
 
+#include "jit_perf.h"
 #include "object.h"
 #include <asmjit/asmjit.h>
+#include <set>
 
 using namespace asmjit;
 
+// JIT 代码运行时的上下文，由 VM 在进入 JIT 代码前填写。
+// JIT 代码可以修改全局变量，执行中途中止时总是按去优化记录从中止处继续解释执行
+struct JitContext
+{
+    // 单帧去优化记录的上限（头加槽位），操作数栈更深的代码不编译
+    static constexpr size_t MAX_RECORD = 256;
+
+    // 全局变量表，调用前据此校验被调函数没有变化
+    GlobalSlot* globals = nullptr;
+    // JIT 函数之间传参用的值栈：当前栈顶和上限。每次调用为调用方的去优化记录预留空间，
+    // 因此去优化记录最多占用值栈大小加 MAX_RECORD；用尽时在调用点去优化（同时限制了调用深度）
+    Value* stackTop = nullptr;
+    Value* stackEnd = nullptr;
+    // 去优化记录，由内层帧到外层帧依次追加。每帧先是一个头（ip << 32 | 槽位数），
+    // 后面是各槽位的值，槽位 0（闭包）不写入
+    Value* deoptTop = nullptr;
+    // 非 0 表示执行已中止，各层 JIT 代码写完自己的记录后直接返回
+    uint8_t bailout = 0;
+    // 守卫失败的函数，VM 据此统计去优化次数
+    ObjFunction* deoptFunction = nullptr;
+};
+
+// 一次编译任务。解释器会就地改写字节码（指令特化），全局变量也随时在变，
+// 因此提交时复制一份，编译只读取这些副本，可以在后台线程进行
+struct JitJob
+{
+    ObjFunction* function = nullptr;
+    // OSR 的循环头位置，0 表示从函数入口编译
+    int entry = 0;
+    // 字节码和常量的副本
+    Chunk chunk;
+    // 全局变量表的副本，编译期据此推测类型和确定被调函数
+    std::vector<GlobalSlot> globals;
+    // OSR 入口处解释器帧的槽位（含槽位 0），据此推测各槽位的类型
+    std::vector<Value> slots;
+    // 编译结果：机器码（失败时为空）和其中直接引用的对象，安装前调用方需保证它们存活
+    void* code = nullptr;
+    std::vector<Obj*> refs;
+};
+
 class JitCompiler
 {
     JitRuntime rt;
+    JitPerf perf;
 
 public:
-    using JitFn = double (*)(double* args);
+    // args 指向第一个参数（都是数字），可以直接指向 VM 栈
+    using JitFn = double (*)(const Value* args, JitContext* ctx);
+
+    // arity 为参数个数
+    JitFn compile(const Chunk* chunk, int arity = 0);
 
-    JitFn compile(const Chunk* chunk);
+    // 编译任务，结果写回 job。OSR 代码离开循环等无法继续时按去优化记录回到解释器
+    void compile(JitJob& job);
+
+    // 释放不再使用的机器码，可以与编译同时进行
+    void release(JitFn fn);
+
+    // 把之后编译的每段机器码报告给 perf（perf map / jitdump），打开文件失败时返回 false
+    bool enablePerfMap() { return perf.enablePerfMap(); }
+    bool enableJitDump() { return perf.enableJitDump(); }
 
 private:
-    JitFn compileX86(const Chunk* chunk, CodeHolder& code);
+    // 一次编译的输入和输出
+    struct CompileUnit
+    {
+        const Chunk* chunk;
+        int arity;
+        // 被编译的函数，仅用于记录失效的假设，可以为空
+        ObjFunction* function;
+        std::vector<Obj*>* refs;
+        // 预先扫描出的全部跳转目标
+        std::set<int> targets;
+        // OSR 的入口位置和入口处解释器帧的槽位，普通编译时 entry 为 0
+        int entry = 0;
+        const Value* entrySlots = nullptr;
+        int entryCount = 0;
+        // 编译到此为止：OSR 时是循环回边之后，否则是代码末尾
+        int end = 0;
+        // 全局变量表，为空时不支持全局变量和函数调用
+        const std::vector<GlobalSlot>* globals = nullptr;
+    };
+
+    JitFn compileUnit(CompileUnit& unit);
+
+    JitFn compileX86(CompileUnit& unit, CodeHolder& code);
+
+    JitFn compileAArch64(CompileUnit& unit, CodeHolder& code);
+
+    // perf 中显示的符号名：函数名，OSR 代码附带循环头位置
+    static std::string symbolName(const CompileUnit& unit);
+
+    // 已定义的全局变量，编译期据此推测类型；不存在时返回空
+    static const GlobalSlot* lookupGlobal(const CompileUnit& unit, uint16_t slot);
 
-    JitFn compileAArch64(const Chunk* chunk, CodeHolder& code);
+    // 被调函数：全局变量 slot 当前保存的闭包，参数个数需与 argc 一致
+    static ObjClosure* resolveCallee(const CompileUnit& unit, uint16_t slot, int argc);
 };
@@ -0,0 +1,40 @@
+#ifndef TINY_JS_JIT_PERF_H
+#define TINY_JS_JIT_PERF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+// 向 Linux perf 报告 JIT 代码的位置，否则 perf report 中机器码只显示为匿名地址。
+// 支持两种格式：
+//   perf map：/tmp/perf-<pid>.map，每行 "起始地址 长度 符号名"，perf report 直接读取；
+//   jitdump：/tmp/jit-<pid>.dump，同时保存机器码，需 perf record -k mono 采样后用 perf inject --jit 合并。
+// 机器码不会被移动，释放后的地址范围可能被新代码复用，perf 以较新的记录为准
+class JitPerf
+{
+public:
+    JitPerf() = default;
+    ~JitPerf();
+    JitPerf(const JitPerf&) = delete;
+    JitPerf& operator=(const JitPerf&) = delete;
+
+    // 打开输出文件，失败（或不是 Linux）时返回 false
+    bool enablePerfMap();
+    bool enableJitDump();
+
+    // 记录一段新安装的机器码，可以在编译线程调用
+    void record(const void* code, size_t size, const std::string& name);
+
+private:
+    std::mutex mutex;
+    FILE* perfMap = nullptr;
+    FILE* jitDump = nullptr;
+    // perf record 通过对 jitdump 文件的可执行映射找到它，映射需保持到文件关闭
+    void* dumpMarker = nullptr;
+    size_t markerSize = 0;
+    uint64_t codeIndex = 0;
+};
+
+#endif // TINY_JS_JIT_PERF_H
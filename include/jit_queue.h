@@ -0,0 +1,57 @@
+#ifndef TINY_JS_JIT_QUEUE_H
+#define TINY_JS_JIT_QUEUE_H
+
+#include "jit.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// JIT 后台编译队列：专门的编译线程按提交顺序编译，解释器同时继续执行字节码，
+// 之后在安全点取回完成的任务安装机器码
+class JitQueue
+{
+public:
+    explicit JitQueue(JitCompiler& compiler) : compiler(compiler) {}
+    ~JitQueue() { stop(); }
+    JitQueue(const JitQueue&) = delete;
+    JitQueue& operator=(const JitQueue&) = delete;
+
+    // 提交任务，编译线程在首次提交时启动
+    void push(std::unique_ptr<JitJob> job);
+
+    // 是否有等待取回的任务，不加锁，解释器可以频繁检查
+    [[nodiscard]] bool hasFinished() const { return finishedCount.load(std::memory_order_acquire) != 0; }
+
+    // 取回所有编译完成的任务
+    std::vector<std::unique_ptr<JitJob>> takeFinished();
+
+    // 等待已提交的任务全部编译完成
+    void wait();
+
+    // 访问所有尚未取回的任务（排队、编译中和已完成的），GC 据此标记它们引用的对象
+    void forEach(const std::function<void(const JitJob&)>& visit);
+
+    // 停止编译线程，正在编译的任务完成后返回，排队中的任务不再编译
+    void stop();
+
+private:
+    void workerLoop();
+
+    JitCompiler& compiler;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable workCV;
+    std::condition_variable doneCV;
+    std::deque<std::unique_ptr<JitJob>> pending;
+    std::unique_ptr<JitJob> current;
+    std::vector<std::unique_ptr<JitJob>> finished;
+    std::atomic<size_t> finishedCount{0};
+    bool stopping = false;
+};
+
+#endif //TINY_JS_JIT_QUEUE_H
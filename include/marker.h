@@ -0,0 +1,213 @@
+#ifndef TINY_JS_MARKER_H
+#define TINY_JS_MARKER_H
+
+#include "object.h"
+#include "heap.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 访问对象直接引用的所有对象
+template <typename F>
+void forEachReference(Obj* o, F&& visit)
+{
+    const auto visitValue = [&](const Value& v)
+    {
+        if (v.isObj()) visit(v.asObj());
+    };
+    const auto visitShapeTree = [&](const Shape& shape, auto& self) -> void
+    {
+        for (const auto& [k, child] : shape.transitions)
+        {
+            visit(k);
+            self(*child, self);
+        }
+    };
+
+    switch (o->type)
+    {
+    case ObjType::CLASS:
+        {
+            auto* c = static_cast<ObjClass*>(o);
+            visitShapeTree(c->rootShape, visitShapeTree);
+            for (auto& [k, v] : c->methods)
+            {
+                visit(k);
+                visit(v);
+            }
+            for (auto& [k, v] : c->nativeMethods)
+            {
+                visit(k);
+                visit(v);
+            }
+            break;
+        }
+    case ObjType::INSTANCE:
+        {
+            auto* i = static_cast<ObjInstance*>(o);
+            visit(i->klass);
+            for (auto& v : i->fields) visitValue(v);
+            // 字典模式的属性名不在类的转换树上，需单独访问
+            if (i->dictionary)
+            {
+                for (auto* k : i->dictionary->dictionaryKeys) visit(k);
+            }
+            break;
+        }
+    case ObjType::BOUND_METHOD:
+        {
+            auto* b = static_cast<ObjBoundMethod*>(o);
+            visitValue(b->receiver);
+            visit(b->method);
+            break;
+        }
+    case ObjType::ROPE:
+        {
+            auto* r = static_cast<ObjRope*>(o);
+            if (r->flat) visit(r->flat);
+            else
+            {
+                visit(r->left);
+                visit(r->right);
+            }
+            break;
+        }
+    case ObjType::LIST:
+        {
+            // 只含数字的数组没有引用，无需扫描
+            auto* l = static_cast<ObjList*>(o);
+            if (l->isPackedDouble()) break;
+            for (auto& v : l->elements) visitValue(v);
+            break;
+        }
+    case ObjType::CLOSURE:
+        {
+            auto* c = static_cast<ObjClosure*>(o);
+            visit(c->function);
+            for (auto* u : c->upvalues) visit(u);
+            break;
+        }
+    case ObjType::FUNCTION:
+        {
+            auto* f = static_cast<ObjFunction*>(o);
+            for (auto& c : f->chunk.constants) visitValue(c);
+            for (const auto& cache : f->chunk.propertyCaches)
+            {
+                for (int i = 0; i < cache.count; i++)
+                {
+                    visit(cache.entries[i].holder);
+                    visit(cache.entries[i].method);
+                }
+            }
+            for (auto* r : f->jitReferences) visit(r);
+            for (const auto& literal : f->chunk.objectLiterals)
+            {
+                for (auto* k : literal.keys) visit(k);
+                if (literal.klass) visit(literal.klass);
+            }
+            break;
+        }
+    case ObjType::UPVALUE:
+        visitValue(static_cast<ObjUpvalue*>(o)->closedValue);
+        break;
+    default:
+        break;
+    }
+}
+
+// 并发标记器：在后台线程上以 SATB（snapshot-at-the-beginning）方式标记老年代对象
+//
+// 标记开始时（主线程暂停中）先完成一次新生代回收，然后把根对象交给标记线程。此后：
+// - 标记线程只扫描老年代对象，新生代对象在标记期间分配，视为存活；
+// - 主线程修改老年代对象前调用 snapshot()：对象尚未被扫描时由主线程先扫描并记录它此刻的引用，
+//   标记线程不会再读取它，因此两个线程从不同时读写同一个对象的内容；
+// - 标记期间晋升的对象直接视为已扫描（黑色）。
+// 结束时主线程调用 finish() 等待标记线程退出，并处理剩余的记录，之后进入清理阶段。
+class ConcurrentMarker
+{
+public:
+    ConcurrentMarker() = default;
+    ~ConcurrentMarker() { finish(); }
+    ConcurrentMarker(const ConcurrentMarker&) = delete;
+    ConcurrentMarker& operator=(const ConcurrentMarker&) = delete;
+
+    // 以已置灰的根对象启动标记线程
+    void start(std::vector<Obj*> roots);
+
+    // 提交主线程记录的对象（SATB 日志），batch 被清空
+    void push(std::vector<Obj*>& batch);
+
+    // 标记线程是否已处理完所有工作
+    [[nodiscard]] bool idle();
+
+    // 停止标记线程，在调用线程上完成剩余的标记
+    void finish();
+
+    // 是否正在运行
+    [[nodiscard]] bool running() const { return thread.joinable(); }
+
+    // 将白色的老年代对象置灰，成功时返回 true（调用方负责之后扫描它）
+    static bool shade(Obj* o);
+
+    // 主线程修改老年代对象前调用：对象尚未扫描时扫描它，被引用的对象追加到 log
+    static void snapshot(Obj* o, std::vector<Obj*>& log);
+
+private:
+    // 扫描灰色对象，新置灰的对象追加到 gray
+    static void scan(Obj* o, std::vector<Obj*>& gray);
+    // 处理 gray 直到为空
+    static void drain(std::vector<Obj*>& gray);
+    void run();
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    // 待处理的对象（未必已置灰）
+    std::vector<Obj*> queue;
+    bool stopRequested = false;
+    // 标记线程手上是否还有工作
+    bool busy = false;
+};
+
+// 并行标记器：停顿期间由多个工作线程一起完成标记
+//
+// 每个工作线程在私有的灰色栈上工作，私有栈较大而共享栈为空时把一半移入共享栈；
+// 私有栈为空时从其他线程的共享栈窃取一半。所有线程都找不到工作时标记结束。
+// 对象的标记位由 Heap::mark 原子地设置，每个对象只会被一个线程扫描
+class ParallelMarker
+{
+public:
+    // 从已标记的灰色对象出发标记所有可达对象，gray 被清空；
+    // 扫描时顺便刷新对象的附属内存统计，返回统计值的总变化量
+    static int64_t mark(WorkerPool& pool, std::vector<Obj*>& gray);
+
+private:
+    // 私有栈超过该大小时向共享栈分出工作
+    static constexpr size_t SHARE_THRESHOLD = 64;
+
+    struct alignas(64) WorkStack
+    {
+        std::mutex mutex;
+        std::vector<Obj*> items;
+        // 共享栈的大小，供其他线程不加锁地检查
+        std::atomic<size_t> size{0};
+    };
+
+    explicit ParallelMarker(const unsigned workers) : stacks(workers) {}
+
+    void work(unsigned index, std::vector<Obj*>& local, int64_t& payloadDelta);
+    // 从其他线程（以及自己）的共享栈取走一半工作，成功时返回 true
+    bool steal(unsigned index, std::vector<Obj*>& local);
+    // 把私有栈的一半移入共享栈
+    void share(unsigned index, std::vector<Obj*>& local);
+    [[nodiscard]] bool anyShared() const;
+
+    std::vector<WorkStack> stacks;
+    // 找不到工作的线程数
+    std::atomic<unsigned> idle{0};
+};
+
+#endif //TINY_JS_MARKER_H
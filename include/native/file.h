@@ -6,7 +6,7 @@
 template <typename T>
 T* getNativeData(const Value obj)
 {
-    auto* instance = dynamic_cast<ObjNativeInstance*>(std::get<Obj*>(obj));
+    auto* instance = objAs<ObjNativeInstance>(obj);
     return static_cast<T*>(instance->data);
 }
 
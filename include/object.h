@@ -5,8 +5,13 @@
 #include "functional"
 #include <iostream>
 #include <map>
+#include <unordered_map>
+#include <string_view>
+#include <array>
+#include <atomic>
+#include <cassert>
 
-enum class ObjType
+enum class ObjType : uint8_t
 {
     // 字符串
     STRING,
@@ -25,15 +30,112 @@ enum class ObjType
     // 实例
     INSTANCE,
     // 绑定方法
-    BOUND_METHOD
+    BOUND_METHOD,
+    // 字符串拼接产生的绳节点
+    ROPE
+};
+
+struct Shape;
+
+// 属性访问内联缓存项
+struct PropertyCacheEntry
+{
+    enum class Kind : uint8_t
+    {
+        // 读写已有字段
+        FIELD,
+        // 添加新字段（形状转换）
+        ADD_FIELD,
+        // 实例的脚本方法
+        METHOD,
+        // 实例的原生方法
+        NATIVE_METHOD,
+        // 类的静态原生方法
+        STATIC_NATIVE,
+    };
+
+    // 缓存键：实例的形状，静态访问时为类本身
+    const void* key = nullptr;
+    Kind kind = Kind::FIELD;
+    // 字段槽位
+    uint32_t slot = 0;
+    // 添加字段后的形状
+    Shape* nextShape = nullptr;
+    // 命中的方法
+    Obj* method = nullptr;
+    // 形状所属的类：由缓存保持存活，避免形状释放后地址被复用造成误命中
+    Obj* holder = nullptr;
+};
+
+// 每条属性访问指令一个缓存，最多记录 MAX_ENTRIES 种接收者（多态），超出后不再缓存（超多态）
+struct PropertyCache
+{
+    static constexpr int MAX_ENTRIES = 4;
+
+    std::array<PropertyCacheEntry, MAX_ENTRIES> entries{};
+    uint8_t count = 0;
+    bool megamorphic = false;
+
+    [[nodiscard]] const PropertyCacheEntry* find(const void* key) const
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (entries[i].key == key) return &entries[i];
+        }
+        return nullptr;
+    }
+
+    void add(const PropertyCacheEntry& entry)
+    {
+        if (megamorphic) return;
+        if (count == MAX_ENTRIES)
+        {
+            megamorphic = true;
+            return;
+        }
+        entries[count++] = entry;
+    }
+};
+
+struct ObjString;
+struct ObjClass;
+
+// 对象字面量的调用点模板：同一处字面量创建的对象共享一个类，首次执行后记下最终形状，
+// 之后按槽位直接写入属性值，不再逐个添加属性
+struct ObjectLiteral
+{
+    // 源码顺序的属性名
+    std::vector<ObjString*> keys;
+    // 共享的类，首次执行时创建
+    ObjClass* klass = nullptr;
+    // 全部属性添加后的形状（字典模式时为空，每次按属性名添加）
+    Shape* shape = nullptr;
+    // 每个属性值写入的槽位（重复的属性名写入同一槽位）
+    std::vector<uint32_t> slots;
 };
 
 struct Chunk
 {
     std::vector<uint8_t> code;
     std::vector<Value> constants;
+    // 属性访问指令的内联缓存
+    std::vector<PropertyCache> propertyCaches;
+    // OP_BUILD_OBJECT 的字面量模板
+    std::vector<ObjectLiteral> objectLiterals;
     void write(const uint8_t byte) { code.push_back(byte); }
 
+    int addPropertyCache()
+    {
+        propertyCaches.emplace_back();
+        return static_cast<int>(propertyCaches.size()) - 1;
+    }
+
+    int addObjectLiteral()
+    {
+        objectLiterals.emplace_back();
+        return static_cast<int>(objectLiterals.size()) - 1;
+    }
+
     int addConstant(const Value value)
     {
         // 尝试复用已有常量
@@ -85,6 +187,10 @@ enum class OpCode : uint8_t
     OP_GREATER,
     // 小于比较
     OP_LESS,
+    // 大于等于比较（操作数为 NaN 时为假，不能用小于取反代替）
+    OP_GREATER_EQUAL,
+    // 小于等于比较
+    OP_LESS_EQUAL,
     // 加法
     OP_ADD,
     // 减法
@@ -141,9 +247,24 @@ enum class OpCode : uint8_t
     OP_OR,
     // new 表达式
     OP_NEW,
+    // 方法调用（属性查找 + 调用，不创建绑定方法）
+    OP_INVOKE,
+    // 以下为运行时按操作数类型改写出的特化指令（quickening），类型不符时改回通用指令
+    // 数字加法
+    OP_ADD_NUM,
+    // 字符串拼接
+    OP_ADD_STR,
+    // 数字小于
+    OP_LESS_NUM,
+    // 数字大于
+    OP_GREATER_NUM,
+    // 数字大于等于
+    OP_GREATER_EQUAL_NUM,
+    // 数字小于等于
+    OP_LESS_EQUAL_NUM,
 };
 
-static constexpr std::array<std::string_view, 45> opCodeNames = {
+static constexpr std::array<std::string_view, 54> opCodeNames = {
     "OP_CONSTANT",
     "OP_NIL",
     "OP_TRUE",
@@ -161,6 +282,8 @@ static constexpr std::array<std::string_view, 45> opCodeNames = {
     "OP_STRICT_NOT_EQUAL",
     "OP_GREATER",
     "OP_LESS",
+    "OP_GREATER_EQUAL",
+    "OP_LESS_EQUAL",
     "OP_ADD",
     "OP_SUB",
     "OP_MUL",
@@ -188,42 +311,117 @@ static constexpr std::array<std::string_view, 45> opCodeNames = {
     "OP_TERNARY",
     "OP_AND",
     "OP_OR",
-    "OP_NEW"
+    "OP_NEW",
+    "OP_INVOKE",
+    "OP_ADD_NUM",
+    "OP_ADD_STR",
+    "OP_LESS_NUM",
+    "OP_GREATER_NUM",
+    "OP_GREATER_EQUAL_NUM",
+    "OP_LESS_EQUAL_NUM"
 };
 
+// 并发标记中对象的扫描状态：白色未访问，灰色待扫描，SCANNING 正被某个线程扫描，黑色已扫描
+enum class ScanState : uint8_t
+{
+    WHITE,
+    GRAY,
+    SCANNING,
+    BLACK,
+};
+
+// 对象头（16 字节）：不含虚表指针，类型、分代和扫描状态与附属内存统计共用一个字，之后是新生代链表指针。
+// 析构按 type 分派（见 destroyObject），向下转型用 objAs / objCast，不依赖 RTTI
 struct Obj
 {
     // 对象类型
     ObjType type;
-    // 标记垃圾回收
-    bool isMarked = false;
-    // 链表指针，指向下一个对象
+    // 是否属于新生代（自上次回收以来分配，尚未晋升）
+    bool isYoung = true;
+    // 是否已在记忆集中（老年代对象写入了新生代引用）
+    bool isRemembered = false;
+    // 并发标记的扫描状态（标记线程和主线程通过原子操作访问）
+    ScanState scanState = ScanState::WHITE;
+    // 堆块之外的附属内存（字符串内容、数组元素、哈希表等）的字节数，最近一次统计的结果
+    uint32_t payload = 0;
+    // 新生代对象链表的指针，指向下一个对象（标记位在堆块的位图中，老年代对象按块清理，不在链表中）
     Obj* next = nullptr;
 
     explicit Obj(const ObjType t) : type(t)
     {
     }
-
-    virtual ~Obj() = default;
 };
 
+static_assert(sizeof(Obj) == 16, "Obj header must stay 16 bytes");
+
+// FNV-1a 字符串哈希
+inline uint32_t hashString(const std::string_view s)
+{
+    uint32_t hash = 2166136261u;
+    for (const char c : s)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// 字符串对象（全部经 VM::newString 驻留，内容不可变，相同内容只存在一份）
 struct ObjString : Obj
 {
+    static constexpr ObjType TYPE = ObjType::STRING;
+
     // 字符串内容
     std::string chars;
+    // 预计算的哈希值
+    uint32_t hash;
 
-    explicit ObjString(std::string s) : Obj(ObjType::STRING), chars(std::move(s))
+    explicit ObjString(std::string s) : Obj(ObjType::STRING), chars(std::move(s)), hash(hashString(chars))
+    {
+    }
+
+    ObjString(std::string s, const uint32_t h) : Obj(ObjType::STRING), chars(std::move(s)), hash(h)
+    {
+    }
+};
+
+// 绳节点：长字符串拼接的惰性结果，左右子节点是 ObjString 或 ObjRope。
+// 不驻留，比较、作为键或读取内容时由 VM::flatten 展平为驻留字符串；输出时直接遍历，无需展平
+struct ObjRope : Obj
+{
+    static constexpr ObjType TYPE = ObjType::ROPE;
+
+    // 拼接结果短于该长度时直接生成驻留字符串，不创建绳节点
+    static constexpr size_t MIN_LENGTH = 64;
+
+    Obj* left;
+    Obj* right;
+    // 展平后的字符串；展平后不再持有子节点
+    ObjString* flat = nullptr;
+    // 内容的字节数
+    size_t length;
+
+    ObjRope(Obj* l, Obj* r, const size_t len) : Obj(ObjType::ROPE), left(l), right(r), length(len)
     {
     }
 };
 
 struct ObjFunction : Obj
 {
+    static constexpr ObjType TYPE = ObjType::FUNCTION;
+
     int arity = 0;
     int upvalueCount = 0;
     Chunk chunk;
     std::string name;
     void* jitFunction = nullptr; // 存储编译后的 JIT 函数指针
+    uint32_t callCount = 0; // 解释执行时的调用次数
+    uint32_t loopCount = 0; // 解释执行时的循环回边次数
+    std::atomic<bool> jitFailed{false}; // 编译失败后不再尝试，后台编译线程也会读取
+    bool jitQueued = false; // 已提交后台编译，安装结果之前不再提交
+    uint32_t deoptCount = 0; // 机器码去优化回解释器的次数
+    std::vector<Obj*> jitReferences; // JIT 代码中直接引用的对象，随函数一起保持存活
+    std::vector<std::pair<int, void*>> osrEntries; // 循环头位置到 OSR 机器码，编译失败时为空
 
     ObjFunction() : Obj(ObjType::FUNCTION)
     {
@@ -232,6 +430,8 @@ struct ObjFunction : Obj
 
 struct ObjUpvalue : Obj
 {
+    static constexpr ObjType TYPE = ObjType::UPVALUE;
+
     Value* location;
     Value closedValue;
     ObjUpvalue* nextUp = nullptr;
@@ -243,6 +443,8 @@ struct ObjUpvalue : Obj
 
 struct ObjClosure : Obj
 {
+    static constexpr ObjType TYPE = ObjType::CLOSURE;
+
     ObjFunction* function;
     std::vector<ObjUpvalue*> upvalues;
 
@@ -251,11 +453,23 @@ struct ObjClosure : Obj
     }
 };
 
+// 全局变量槽位
+struct GlobalSlot
+{
+    Value value;
+    ObjString* name = nullptr;
+    // 是否已定义（未定义的槽位读取为 nil，赋值报错）
+    bool defined = false;
+    bool isConst = false;
+};
+
 
 using NativeFn = std::function<Value(int argCount, Value* args)>;
 
 struct ObjNative : Obj
 {
+    static constexpr ObjType TYPE = ObjType::NATIVE;
+
     NativeFn function;
     std::string name;
 
@@ -264,26 +478,127 @@ struct ObjNative : Obj
     }
 };
 
+// 数组的元素类型：只含数字的数组不持有对象引用，写入和回收时可以跳过屏障与扫描
+enum class ElementKind : uint8_t
+{
+    // 全部元素都是数字
+    DOUBLE,
+    // 任意值
+    GENERIC,
+};
+
 struct ObjList : Obj
 {
-    // 使用 vector 存储元素
+    static constexpr ObjType TYPE = ObjType::LIST;
+
+    // 使用 vector 存储元素（NaN-boxing 下数字元素即为 double 本身）
     std::vector<Value> elements;
+    // 元素类型，首次写入非数字时由 DOUBLE 转为 GENERIC，之后不再转回（清空时除外）
+    ElementKind kind = ElementKind::DOUBLE;
 
     ObjList() : Obj(ObjType::LIST)
     {
     }
+
+    [[nodiscard]] bool isPackedDouble() const { return kind == ElementKind::DOUBLE; }
+
+    // 写入元素后调用，维护元素类型
+    void noteElement(const Value v)
+    {
+        if (!v.isNumber()) kind = ElementKind::GENERIC;
+    }
+
+    // 追加元素
+    void push(const Value v)
+    {
+        elements.push_back(v);
+        noteElement(v);
+    }
+};
+
+// 隐藏类（形状）：描述实例的属性布局，属性名 -> 槽位下标
+// 同一个类下按相同顺序添加属性的实例共享同一个形状，形状之间通过转换树相连
+struct Shape
+{
+    // 超过该属性数时实例转为字典模式
+    static constexpr uint32_t MAX_SLOTS = 64;
+    // 超过该属性数时为查找建立哈希索引，否则沿父链线性查找
+    static constexpr uint32_t INDEX_THRESHOLD = 8;
+
+    // 父形状
+    Shape* parent = nullptr;
+    // 相对父形状新增的属性名
+    ObjString* key = nullptr;
+    // 属性数量，即实例的槽位数
+    uint32_t slotCount = 0;
+    // 字典模式：实例私有、可原地添加属性，不参与转换树
+    bool isDictionary = false;
+    // 转换树：添加某个属性后到达的子形状
+    std::vector<std::pair<ObjString*, std::unique_ptr<Shape>>> transitions;
+    // 属性名 -> 槽位下标（大形状懒建立，字典模式下始终有效）
+    std::unordered_map<ObjString*, uint32_t> index;
+    // 字典模式下按添加顺序排列的属性名
+    std::vector<ObjString*> dictionaryKeys;
+
+    // 查找属性槽位，不存在返回 -1
+    int lookup(ObjString* name)
+    {
+        if (isDictionary || slotCount > INDEX_THRESHOLD)
+        {
+            if (index.empty())
+            {
+                for (const Shape* s = this; s->key; s = s->parent) index[s->key] = s->slotCount - 1;
+            }
+            const auto it = index.find(name);
+            return it == index.end() ? -1 : static_cast<int>(it->second);
+        }
+        for (const Shape* s = this; s->key; s = s->parent)
+        {
+            if (s->key == name) return static_cast<int>(s->slotCount - 1);
+        }
+        return -1;
+    }
+
+    // 沿转换树添加属性，返回（必要时创建）子形状
+    Shape* transition(ObjString* name)
+    {
+        for (auto& [k, child] : transitions)
+        {
+            if (k == name) return child.get();
+        }
+        auto child = std::make_unique<Shape>();
+        child->parent = this;
+        child->key = name;
+        child->slotCount = slotCount + 1;
+        Shape* result = child.get();
+        transitions.emplace_back(name, std::move(child));
+        return result;
+    }
+
+    // 按添加顺序返回全部属性名
+    [[nodiscard]] std::vector<ObjString*> keys() const
+    {
+        if (isDictionary) return dictionaryKeys;
+        std::vector<ObjString*> result(slotCount);
+        for (const Shape* s = this; s->key; s = s->parent) result[s->slotCount - 1] = s->key;
+        return result;
+    }
 };
 
 struct ObjClass : Obj
 {
+    static constexpr ObjType TYPE = ObjType::CLASS;
+
     // 类名
     std::string name;
-    // 方法表
-    std::map<std::string, ObjClosure*> methods;
+    // 方法表（键为驻留字符串）
+    std::unordered_map<ObjString*, ObjClosure*> methods;
     // 原生方法
-    std::map<std::string, ObjNative*> nativeMethods;
+    std::unordered_map<ObjString*, ObjNative*> nativeMethods;
     // 是否为原生类
     bool isNative = false;
+    // 实例的初始（空）形状，即本类转换树的根
+    Shape rootShape;
 
     explicit ObjClass(std::string n) : Obj(ObjType::CLASS), name(std::move(n))
     {
@@ -292,17 +607,72 @@ struct ObjClass : Obj
 
 struct ObjInstance : Obj
 {
+    static constexpr ObjType TYPE = ObjType::INSTANCE;
+
     ObjClass* klass;
-    // 字段表
-    std::map<std::string, Value> fields;
+    // 当前形状
+    Shape* shape;
+    // 字段值，按形状中的槽位顺序连续存放
+    std::vector<Value> fields;
+    // 字典模式下实例私有的形状
+    std::unique_ptr<Shape> dictionary;
+    // 是否为 ObjNativeInstance（与普通实例共用 INSTANCE 类型，析构时据此分派）
+    bool isNative = false;
 
-    explicit ObjInstance(ObjClass* c) : Obj(ObjType::INSTANCE), klass(c)
+    explicit ObjInstance(ObjClass* c) : Obj(ObjType::INSTANCE), klass(c), shape(&c->rootShape)
     {
     }
+
+    // 读取字段，不存在时返回 false
+    bool getField(ObjString* name, Value& out)
+    {
+        const int slot = shape->lookup(name);
+        if (slot < 0) return false;
+        out = fields[slot];
+        return true;
+    }
+
+    // 写入字段，不存在时添加新属性
+    void setField(ObjString* name, const Value value)
+    {
+        if (const int slot = shape->lookup(name); slot >= 0)
+        {
+            fields[slot] = value;
+            return;
+        }
+        if (!shape->isDictionary && shape->slotCount >= Shape::MAX_SLOTS)
+        {
+            toDictionary();
+        }
+        if (shape->isDictionary)
+        {
+            shape->index[name] = shape->slotCount++;
+            shape->dictionaryKeys.push_back(name);
+        }
+        else
+        {
+            shape = shape->transition(name);
+        }
+        fields.push_back(value);
+    }
+
+private:
+    // 属性过多时脱离转换树，改用实例私有的哈希布局
+    void toDictionary()
+    {
+        dictionary = std::make_unique<Shape>();
+        dictionary->isDictionary = true;
+        dictionary->dictionaryKeys = shape->keys();
+        dictionary->slotCount = shape->slotCount;
+        for (uint32_t i = 0; i < dictionary->slotCount; i++) dictionary->index[dictionary->dictionaryKeys[i]] = i;
+        shape = dictionary.get();
+    }
 };
 
 struct ObjBoundMethod : Obj
 {
+    static constexpr ObjType TYPE = ObjType::BOUND_METHOD;
+
     Value receiver; // 绑定的 this 对象
     Obj* method;
 
@@ -326,9 +696,10 @@ struct ObjNativeInstance : ObjInstance
 
     explicit ObjNativeInstance(ObjClass* k) : ObjInstance(k)
     {
+        isNative = true;
     }
 
-    ~ObjNativeInstance() override
+    ~ObjNativeInstance()
     {
         if (data && deleter)
         {
@@ -338,37 +709,242 @@ struct ObjNativeInstance : ObjInstance
     }
 };
 
+// 对象是否为 T 类型，按对象头中的 type 判断
+template <typename T>
+bool isObj(const Obj* o)
+{
+    return o->type == T::TYPE;
+}
+
+template <>
+inline bool isObj<ObjNativeInstance>(const Obj* o)
+{
+    return o->type == ObjType::INSTANCE && static_cast<const ObjInstance*>(o)->isNative;
+}
+
+// 检查过的静态向下转型：调用方已确认对象类型，调试构建下断言
+template <typename T>
+T* objAs(Obj* o)
+{
+    assert(isObj<T>(o));
+    return static_cast<T*>(o);
+}
+
+template <typename T>
+const T* objAs(const Obj* o)
+{
+    assert(isObj<T>(o));
+    return static_cast<const T*>(o);
+}
+
+template <typename T>
+T* objAs(const Value v)
+{
+    return objAs<T>(v.asObj());
+}
+
+// 类型不符（或不是对象）时返回 nullptr 的向下转型
+template <typename T>
+T* objCast(Obj* o)
+{
+    return o && isObj<T>(o) ? static_cast<T*>(o) : nullptr;
+}
+
+template <typename T>
+T* objCast(const Value v)
+{
+    return v.isObj() ? objCast<T>(v.asObj()) : nullptr;
+}
+
+// 按 type 调用对象的析构函数（不释放内存）
+inline void destroyObject(Obj* o)
+{
+    switch (o->type)
+    {
+    case ObjType::STRING:
+        static_cast<ObjString*>(o)->~ObjString();
+        break;
+    case ObjType::FUNCTION:
+        static_cast<ObjFunction*>(o)->~ObjFunction();
+        break;
+    case ObjType::CLOSURE:
+        static_cast<ObjClosure*>(o)->~ObjClosure();
+        break;
+    case ObjType::UPVALUE:
+        static_cast<ObjUpvalue*>(o)->~ObjUpvalue();
+        break;
+    case ObjType::NATIVE:
+        static_cast<ObjNative*>(o)->~ObjNative();
+        break;
+    case ObjType::LIST:
+        static_cast<ObjList*>(o)->~ObjList();
+        break;
+    case ObjType::CLASS:
+        static_cast<ObjClass*>(o)->~ObjClass();
+        break;
+    case ObjType::INSTANCE:
+        if (static_cast<ObjInstance*>(o)->isNative) static_cast<ObjNativeInstance*>(o)->~ObjNativeInstance();
+        else static_cast<ObjInstance*>(o)->~ObjInstance();
+        break;
+    case ObjType::BOUND_METHOD:
+        static_cast<ObjBoundMethod*>(o)->~ObjBoundMethod();
+        break;
+    case ObjType::ROPE:
+        static_cast<ObjRope*>(o)->~ObjRope();
+        break;
+    }
+}
+
+// 字符串或绳节点的字节数
+inline size_t stringLength(const Obj* o)
+{
+    return o->type == ObjType::ROPE ? static_cast<const ObjRope*>(o)->length : static_cast<const ObjString*>(o)->chars.size();
+}
+
+// 按顺序访问字符串或绳节点内容的各个片段（用显式栈遍历，长拼接链不会耗尽调用栈）
+template <typename F>
+void forEachStringPiece(const Obj* o, F&& visit)
+{
+    std::vector<const Obj*> pending{o};
+    while (!pending.empty())
+    {
+        const Obj* s = pending.back();
+        pending.pop_back();
+        if (s->type == ObjType::STRING)
+        {
+            visit(static_cast<const ObjString*>(s)->chars);
+            continue;
+        }
+        const auto* rope = static_cast<const ObjRope*>(s);
+        if (rope->flat)
+        {
+            visit(rope->flat->chars);
+            continue;
+        }
+        pending.push_back(rope->right);
+        pending.push_back(rope->left);
+    }
+}
+
+// 把字符串或绳节点的内容追加到 out
+inline void appendString(std::string& out, const Obj* o)
+{
+    forEachStringPiece(o, [&out](const std::string& piece) { out += piece; });
+}
+
+// 估算哈希表占用的内存：桶数组加上每个节点（键值对、next 指针、缓存的哈希）
+template <typename Map>
+size_t hashMapBytes(const Map& map)
+{
+    return map.bucket_count() * sizeof(void*) +
+        map.size() * (sizeof(typename Map::value_type) + sizeof(void*) + sizeof(size_t));
+}
+
+// 字符串内容超出短字符串优化的内联缓冲区时才占用堆内存
+inline size_t stringBytes(const std::string& s)
+{
+    static const size_t inlineCapacity = std::string().capacity();
+    return s.capacity() > inlineCapacity ? s.capacity() + 1 : 0;
+}
+
+// 形状本身及其转换子树占用的内存
+inline size_t shapeTreeBytes(const Shape& shape)
+{
+    size_t bytes = shape.transitions.capacity() * sizeof(shape.transitions[0]) + hashMapBytes(shape.index) +
+        shape.dictionaryKeys.capacity() * sizeof(ObjString*);
+    for (const auto& [k, child] : shape.transitions) bytes += sizeof(Shape) + shapeTreeBytes(*child);
+    return bytes;
+}
+
+// 对象在堆块之外占用的内存
+inline size_t payloadBytes(const Obj* o)
+{
+    switch (o->type)
+    {
+    case ObjType::STRING:
+        return stringBytes(static_cast<const ObjString*>(o)->chars);
+    case ObjType::FUNCTION:
+        {
+            const auto* f = static_cast<const ObjFunction*>(o);
+            return f->chunk.code.capacity() + f->chunk.constants.capacity() * sizeof(Value) +
+                f->chunk.propertyCaches.capacity() * sizeof(PropertyCache) +
+                f->chunk.objectLiterals.capacity() * sizeof(ObjectLiteral) + stringBytes(f->name);
+        }
+    case ObjType::CLOSURE:
+        return static_cast<const ObjClosure*>(o)->upvalues.capacity() * sizeof(ObjUpvalue*);
+    case ObjType::NATIVE:
+        return stringBytes(static_cast<const ObjNative*>(o)->name);
+    case ObjType::LIST:
+        return static_cast<const ObjList*>(o)->elements.capacity() * sizeof(Value);
+    case ObjType::CLASS:
+        {
+            const auto* c = static_cast<const ObjClass*>(o);
+            return stringBytes(c->name) + hashMapBytes(c->methods) + hashMapBytes(c->nativeMethods) +
+                shapeTreeBytes(c->rootShape);
+        }
+    case ObjType::INSTANCE:
+        {
+            // 只统计实例私有的部分；字典模式下只计入索引和键表的规模，避免逐层遍历
+            const auto* i = static_cast<const ObjInstance*>(o);
+            size_t bytes = i->fields.capacity() * sizeof(Value);
+            if (i->dictionary)
+            {
+                bytes += sizeof(Shape) + hashMapBytes(i->dictionary->index) +
+                    i->dictionary->dictionaryKeys.capacity() * sizeof(ObjString*);
+            }
+            return bytes;
+        }
+    default:
+        return 0;
+    }
+}
+
 // 检查 Value 是否为指定类型的对象
 inline bool isObjType(const Value val, const ObjType type)
 {
-    return std::holds_alternative<Obj*>(val) && std::get<Obj*>(val)->type == type;
+    return val.isObj() && val.asObj()->type == type;
+}
+
+// 是否为字符串或绳节点
+inline bool isStringLike(const Value val)
+{
+    return isObjType(val, ObjType::STRING) || isObjType(val, ObjType::ROPE);
+}
+
+// 将数字转换为字符串表示
+inline std::string numberToString(const double d)
+{
+    double intPart;
+    if (modf(d, &intPart) == 0.0) return std::to_string(static_cast<long long>(d));
+    std::string s = std::to_string(d);
+    s.erase(s.find_last_not_of('0') + 1, std::string::npos);
+    if (s.back() == '.') s.pop_back();
+    return s;
 }
 
 // 将 Value 转换为字符串表示
 inline std::string valToString(const Value val)
 {
-    if (std::holds_alternative<std::monostate>(val)) return "null";
-    if (std::holds_alternative<bool>(val)) return std::get<bool>(val) ? "true" : "false";
-    if (std::holds_alternative<double>(val))
-    {
-        double d = std::get<double>(val);
-        double intPart;
-        if (modf(d, &intPart) == 0.0) return std::to_string(static_cast<long long>(d));
-        std::string s = std::to_string(d);
-        s.erase(s.find_last_not_of('0') + 1, std::string::npos);
-        if (s.back() == '.') s.pop_back();
-        return s;
-    }
-    if (std::holds_alternative<Obj*>(val))
-    {
-        const auto o = std::get<Obj*>(val);
-        if (o->type == ObjType::STRING) return dynamic_cast<ObjString*>(o)->chars;
-        if (o->type == ObjType::FUNCTION) return "<fn " + dynamic_cast<ObjFunction*>(o)->name + ">";
-        if (o->type == ObjType::CLOSURE) return "<fn " + dynamic_cast<ObjClosure*>(o)->function->name + ">";
-        if (o->type == ObjType::NATIVE) return "<native fn " + dynamic_cast<ObjNative*>(o)->name + ">";
+    if (val.isNil()) return "null";
+    if (val.isBool()) return val.asBool() ? "true" : "false";
+    if (val.isNumber()) return numberToString(val.asNumber());
+    if (val.isObj())
+    {
+        const auto o = val.asObj();
+        if (o->type == ObjType::STRING) return objAs<ObjString>(o)->chars;
+        if (o->type == ObjType::ROPE)
+        {
+            std::string result;
+            result.reserve(objAs<ObjRope>(o)->length);
+            appendString(result, o);
+            return result;
+        }
+        if (o->type == ObjType::FUNCTION) return "<fn " + objAs<ObjFunction>(o)->name + ">";
+        if (o->type == ObjType::CLOSURE) return "<fn " + objAs<ObjClosure>(o)->function->name + ">";
+        if (o->type == ObjType::NATIVE) return "<native fn " + objAs<ObjNative>(o)->name + ">";
         if (o->type == ObjType::LIST)
         {
-            const auto list = dynamic_cast<ObjList*>(o);
+            const auto list = objAs<ObjList>(o);
             std::string result = "[";
             for (size_t i = 0; i < list->elements.size(); i++)
             {
@@ -378,20 +954,19 @@ inline std::string valToString(const Value val)
             result += "]";
             return result;
         }
-        if (o->type == ObjType::CLASS) return "<class " + dynamic_cast<ObjClass*>(o)->name + ">";
+        if (o->type == ObjType::CLASS) return "<class " + objAs<ObjClass>(o)->name + ">";
         if (o->type == ObjType::INSTANCE)
         {
-            const auto* instance = dynamic_cast<ObjInstance*>(o);
+            const auto* instance = objAs<ObjInstance>(o);
             // 如果是对象字面量，显示其属性
             if (instance->klass->name == "<object>")
             {
                 std::string result = "{";
-                bool first = true;
-                for (auto it = instance->fields.begin(); it != instance->fields.end(); ++it)
+                const auto keys = instance->shape->keys();
+                for (size_t i = 0; i < keys.size(); i++)
                 {
-                    if (!first) result += ", ";
-                    result += it->first + ": " + valToString(it->second);
-                    first = false;
+                    if (i > 0) result += ", ";
+                    result += keys[i]->chars + ": " + valToString(instance->fields[i]);
                 }
                 result += "}";
                 return result;
@@ -400,15 +975,15 @@ inline std::string valToString(const Value val)
         }
         if (o->type == ObjType::BOUND_METHOD)
         {
-            const auto* bound = dynamic_cast<ObjBoundMethod*>(o);
+            const auto* bound = objAs<ObjBoundMethod>(o);
             if (bound->method->type == ObjType::NATIVE)
             {
-                return "<native fn " + dynamic_cast<ObjNative*>(bound->method)->name + ">";
+                return "<native fn " + objAs<ObjNative>(bound->method)->name + ">";
             }
 
             if (bound->method->type == ObjType::CLOSURE)
             {
-                return "<fn " + dynamic_cast<ObjClosure*>(bound->method)->function->name + ">";
+                return "<fn " + objAs<ObjClosure>(bound->method)->function->name + ">";
             }
             return "<bound method>";
         }
@@ -2,14 +2,20 @@
 #define TINY_JS_VM_H
 
 #include "object.h"
+#include "heap.h"
+#include "marker.h"
+#include "worker_pool.h"
 #include "jit.h"
+#include "jit_queue.h"
 #include <map>
 #include <unordered_set>
+#include <unordered_map>
 #include <future>
 #include <mutex>
 #include <condition_variable>
 #include <queue>
 #include <chrono>
+#include <algorithm>
 
 // 调用栈帧结构体
 struct CallFrame
@@ -22,6 +28,30 @@ struct CallFrame
     int slots;
 };
 
+// 驻留字符串表的查找键（内容 + 预计算哈希），用于免分配查找
+struct StringKey
+{
+    std::string_view chars;
+    uint32_t hash;
+};
+
+struct StringTableHash
+{
+    using is_transparent = void;
+
+    size_t operator()(const ObjString* s) const { return s->hash; }
+    size_t operator()(const StringKey& k) const { return k.hash; }
+};
+
+struct StringTableEqual
+{
+    using is_transparent = void;
+
+    bool operator()(const ObjString* a, const ObjString* b) const { return a == b; }
+    bool operator()(const StringKey& k, const ObjString* s) const { return k.hash == s->hash && k.chars == s->chars; }
+    bool operator()(const ObjString* s, const StringKey& k) const { return k.hash == s->hash && k.chars == s->chars; }
+};
+
 // 事件任务结构体
 struct EventTask
 {
@@ -45,15 +75,41 @@ public:
     // 调用栈帧
     std::vector<CallFrame> frames;
 
-    // 全局变量表
-    std::map<std::string, Value> globals;
+    // 全局变量表：编译期将名称解析为槽位，运行时按下标访问
+    std::vector<GlobalSlot> globals;
+
+    // 全局变量名到槽位的映射，供编译器和原生注册使用
+    std::unordered_map<ObjString*, uint16_t> globalSlots;
+
+    // 字符串驻留表（弱引用：不作为 GC 根，清理阶段移除死亡字符串）
+    std::unordered_set<ObjString*, StringTableHash, StringTableEqual> strings;
+
+    // 常用的驻留字符串
+    ObjString* lengthString = nullptr;
+    ObjString* constructorString = nullptr;
+    ObjString* exportsString = nullptr;
 
-    // 全局常量集合
-    std::unordered_set<std::string> globalConsts;
+    // 对象堆
+    Heap heap;
 
-    // 已分配的对象链表
+    // 新生代对象链表（新对象插在表头）；晋升到老年代的对象离开链表，由堆按块清理
     Obj* objects = nullptr;
 
+    // 新生代分配（含附属内存的增长）超过该字节数时触发一次新生代回收
+    static constexpr size_t NURSERY_SIZE = 512 * 1024;
+
+    // 自上次新生代回收以来附属内存增长的字节数
+    size_t payloadGrowth = 0;
+
+    // 堆上限（字节，含附属内存），为 0 时不限制
+    size_t maxHeap = 0;
+
+    // 记忆集：引用了新生代对象的老年代对象，新生代回收时作为额外的根
+    std::vector<Obj*> rememberedSet;
+
+    // 是否正在进行新生代回收（只标记新生代对象）
+    bool collectingYoung = false;
+
     // 垃圾回收标记栈
     std::vector<Obj*> grayStack;
 
@@ -63,12 +119,53 @@ public:
     // 临时根对象列表
     std::vector<Obj*> tempRoots;
 
-    // 内存管理 - 已分配的字节数
+    // 内存管理 - 对象占用的字节数（堆单元加附属内存）
     size_t bytesAllocated = 0;
 
-    // 下一次垃圾回收的阈值
+    // 老年代增长到该字节数时，在新生代回收之后开始一轮完整回收
     size_t nextGC = 1024 * 1024;
 
+    // 完整回收的阶段：增量模式下标记和清理分散在多次分配中进行
+    enum class GCPhase : uint8_t
+    {
+        IDLE,
+        MARK,
+        // 后台线程并发标记中
+        CONCURRENT_MARK,
+        SWEEP,
+    };
+
+    GCPhase gcPhase = GCPhase::IDLE;
+
+    // 完整回收单步的最大停顿时间，为 0 时不做增量回收，一次完成整个回收
+    std::chrono::microseconds gcMaxPause{1000};
+
+    // 是否在后台线程上并发标记老年代（开启时不使用增量标记）
+    bool concurrentMarking = false;
+
+    // 并发标记器
+    ConcurrentMarker marker;
+
+    // 并发标记期间主线程记录的对象（SATB 日志），攒够一批后交给标记线程
+    std::vector<Obj*> satbLog;
+    static constexpr size_t SATB_BATCH = 512;
+
+    // 增量回收期间每分配该字节数推进一步
+    static constexpr size_t GC_STEP_BYTES = 64 * 1024;
+    size_t nextGCStep = GC_STEP_BYTES;
+
+    // 完整回收的标记和清理在这些工作线程上并行进行
+    WorkerPool gcWorkers;
+
+    // 垃圾回收统计
+    struct GCStats
+    {
+        uint64_t minorCollections = 0;
+        uint64_t fullCollections = 0;
+        uint64_t incrementalSteps = 0;
+        std::chrono::microseconds maxPause{0};
+    } gcStats;
+
     // 模块系统
     std::map<std::string, Value> modules;
 
@@ -76,16 +173,38 @@ public:
     std::function<ObjFunction*(std::string, std::string)> compilerHook;
 
     // 数组原生方法
-    std::map<std::string, ObjNative*> listMethods;
+    std::unordered_map<ObjString*, ObjNative*> listMethods;
     // 字符串原生方法
-    std::map<std::string, ObjNative*> stringMethods;
+    std::unordered_map<ObjString*, ObjNative*> stringMethods;
 
-    // JIT 编译器
+    // JIT 编译器和后台编译队列
     JitCompiler jit;
+    JitQueue jitQueue{jit};
+    // 是否在后台线程编译，否则在解释器线程上同步编译
+    bool jitBackground{true};
+
+    // JIT 代码的运行上下文、函数之间传参用的值栈和去优化记录
+    JitContext jitContext;
+    std::vector<Value> jitStack;
+    std::vector<Value> jitDeopt;
+    // 值栈大小，每层调用按调用方的操作数栈深度占用，同时限制了机器码的递归深度
+    static constexpr size_t JIT_STACK_SIZE = 16 * 1024;
+    // 去优化达到此次数后丢弃机器码，之后按新的类型重新编译
+    static constexpr uint32_t JIT_DEOPT_LIMIT = 8;
 
     // JIT 是否启用
     bool jitEnabled{true};
 
+    // 调用次数或循环回边次数达到该值后才交给 JIT 编译
+    uint32_t jitThreshold{1000};
+
+    // 内联缓存命中统计
+    struct InlineCacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    } icStats;
+
     // 异步任务列表（用于 setTimeout 等）
     std::vector<std::future<void>> asyncTasks;
     std::mutex asyncTasksMutex;
@@ -94,6 +213,10 @@ public:
     std::unordered_set<std::string> intervalIds;
     std::mutex intervalIdsMutex;
 
+    // 等待执行的定时器回调（只在主线程访问，作为 GC 根）
+    std::unordered_multiset<ObjClosure*> timeoutCallbacks;
+    std::unordered_map<std::string, ObjClosure*> intervalCallbacks;
+
     // 事件队列
     std::queue<EventTask> eventQueue;
     std::mutex eventQueueMutex;
@@ -104,22 +227,113 @@ public:
     {
         // 预留大小 防止频繁扩容
        stack.reserve(2048);
+
+        lengthString = newString("length");
+        constructorString = newString("constructor");
+        exportsString = newString("exports");
     }
 
-    ~VM() { freeObjects(); }
+    ~VM()
+    {
+        // 编译线程可能还在读取对象，先停下来
+        jitQueue.stop();
+        marker.finish();
+        freeObjects();
+    }
 
-    // 分配新对象并添加到对象链表
+    // 在新生代分配新对象并添加到对象链表
     template <typename T, typename... Args>
     T* allocate(Args&&... args)
     {
-        if (bytesAllocated > nextGC) collectGarbage();
-        T* obj = new T(std::forward<Args>(args)...);
+        static_assert(sizeof(T) <= Heap::MAX_OBJECT_SIZE);
+        if (youngBytes() >= NURSERY_SIZE) collectGarbage();
+        else if (gcPhase != GCPhase::IDLE && youngBytes() >= nextGCStep) incrementalStep();
+        if (maxHeap && bytesAllocated + sizeof(T) > maxHeap) checkHeapLimit();
+        T* obj = new(heap.allocate(sizeof(T))) T(std::forward<Args>(args)...);
         obj->next = objects;
         objects = obj;
-        bytesAllocated += sizeof(T);
+        bytesAllocated += Heap::cellSize(sizeof(T));
+        accountPayload(obj);
         return obj;
     }
 
+    // 自上次新生代回收以来分配的字节数
+    [[nodiscard]] size_t youngBytes() const { return heap.nurseryBytes() + payloadGrowth; }
+
+    // 重新统计对象的附属内存（字符串、数组等增长后调用）
+    void accountPayload(Obj* o)
+    {
+        const auto bytes = static_cast<uint32_t>(std::min<size_t>(payloadBytes(o), UINT32_MAX));
+        if (bytes > o->payload) payloadGrowth += bytes - o->payload;
+        bytesAllocated += bytes;
+        bytesAllocated -= o->payload;
+        o->payload = bytes;
+    }
+
+    // 写屏障：老年代对象 owner 写入新生代引用时记入记忆集；
+    // 增量标记期间已标记的对象写入未标记的老年代对象时将其置灰（Dijkstra 插入屏障）
+    void writeBarrier(Obj* owner, Obj* child)
+    {
+        if (!child || owner->isYoung) return;
+        if (child->isYoung)
+        {
+            if (!owner->isRemembered)
+            {
+                owner->isRemembered = true;
+                rememberedSet.push_back(owner);
+            }
+        }
+        else if (gcPhase == GCPhase::MARK && Heap::isMarked(owner) && Heap::mark(child))
+        {
+            grayStack.push_back(child);
+        }
+    }
+
+    void writeBarrier(Obj* owner, const Value value)
+    {
+        if (value.isObj()) writeBarrier(owner, value.asObj());
+    }
+
+    // 修改对象的引用之前调用：并发标记期间保证标记线程看到的是对象在标记开始时的内容
+    void prepareWrite(Obj* o)
+    {
+        if (gcPhase != GCPhase::CONCURRENT_MARK || o->isYoung) return;
+        ConcurrentMarker::snapshot(o, satbLog);
+        if (satbLog.size() >= SATB_BATCH) marker.push(satbLog);
+    }
+
+    // 无条件记入记忆集（对象被大量修改且来不及逐个加屏障时使用），增量标记期间已标记的对象重新置灰
+    void rememberObject(Obj* o)
+    {
+        if (o->isYoung) return;
+        if (!o->isRemembered)
+        {
+            o->isRemembered = true;
+            rememberedSet.push_back(o);
+        }
+        if (gcPhase == GCPhase::MARK && Heap::isMarked(o)) grayStack.push_back(o);
+    }
+
+    // 弹出临时根：构造期间被晋升的对象可能已写入新生代引用，统一记入记忆集
+    void popTempRoot()
+    {
+        rememberObject(tempRoots.back());
+        accountPayload(tempRoots.back());
+        tempRoots.pop_back();
+    }
+
+    // 超过堆上限时先做一次完整回收，仍然超出则抛出内存不足错误（调用时所有存活对象都必须可达）
+    void checkHeapLimit();
+
+    // 设置堆上限（MB），为 0 时不限制
+    void setMaxHeap(double mb);
+
+    // 写入实例字段（属性名可能进入类的转换树或实例的字典，一并维护写屏障）
+    void setField(ObjInstance* instance, ObjString* name, Value value);
+
+    // 向当前执行函数的内联缓存添加一项
+    void addCacheEntry(PropertyCache& cache, const PropertyCacheEntry& entry);
+
     // 初始化模块系统
     void initModule();
 
@@ -129,15 +343,69 @@ public:
     // 定义原生类及其方法
     void defineNativeClass(const std::string& className, std::map<std::string, NativeFn> methods);
 
-    // 创建新字符串对象
-    ObjString* newString(const std::string& s);
+    // 创建（或复用已驻留的）字符串对象
+    ObjString* newString(std::string s);
+
+    // 展平绳节点，返回内容相同的驻留字符串（结果缓存在节点中）
+    ObjString* flatten(ObjRope* rope);
+
+    // 字符串原样返回，绳节点返回展平后的字符串，其他值返回 nullptr
+    ObjString* asString(Value v);
+
+    // 把栈上指定位置的绳节点原地替换为展平后的字符串
+    void flattenAt(const size_t slot)
+    {
+        if (isObjType(stack[slot], ObjType::ROPE)) stack[slot] = flatten(static_cast<ObjRope*>(stack[slot].asObj()));
+    }
+
+    // 拼接栈顶两个值（非字符串先转为字符串），结果替换它们；结果较长时生成绳节点
+    void concatenate();
 
     // 释放所有对象
     void freeObjects();
 
-    // 垃圾回收
+    // 垃圾回收：先回收新生代，老年代超过阈值时再开始一轮完整回收
     void collectGarbage();
 
+    // 新生代回收：只标记新生代对象，记忆集中的老年代对象作为额外的根，存活对象晋升到老年代
+    void collectYoung();
+
+    // 完整回收：标记并清理所有对象（进行中的增量回收会先被完成）
+    void collectFull();
+
+    // 开始一轮增量完整回收：标记根对象
+    void startIncrementalMark();
+
+    // 在停顿时间预算内推进增量回收
+    void incrementalStep();
+
+    // 结束增量标记：回收新生代并重新扫描根，之后进入清理阶段
+    void finishMark();
+
+    // 开始一轮并发完整回收：回收新生代，扫描根对象并启动标记线程
+    void startConcurrentMark();
+
+    // 结束并发标记：在主线程完成剩余的标记，之后进入清理阶段
+    void finishConcurrentMark();
+
+    // 标记结束后从驻留表移除死亡字符串，进入清理阶段
+    void beginSweep();
+
+    // 在截止时间前处理灰色对象，灰色对象处理完时返回 true
+    bool markStep(std::chrono::steady_clock::time_point deadline);
+
+    // 在截止时间前惰性清理老年代，清理完成时返回 true
+    bool sweepStep(std::chrono::steady_clock::time_point deadline);
+
+    // 设置完整回收单步的最大停顿时间（毫秒），为 0 时关闭增量回收
+    void setGCMaxPause(double ms);
+
+    // 设置完整回收的工作线程数
+    void setGCThreads(unsigned n) { gcWorkers.resize(n); }
+
+    // 打印垃圾回收统计
+    void printGCStats() const;
+
     // 标记根对象
     void markRoots();
 
@@ -147,12 +415,27 @@ public:
     // 标记对象
     void markObject(Obj* o);
 
-    // 跟踪引用对象
+    // 跟踪引用对象（完整回收时在工作线程上并行进行）
     void traceReferences();
 
-    // 清理未标记对象
+    // 标记对象直接引用的所有对象
+    void blackenObject(Obj* o);
+
+    // 在工作线程上并行清理老年代中剩余的待清理块
     void sweep();
 
+    // 清理一个块中未标记的老年代对象，返回释放的字节数（只修改该块，可在工作线程上调用）
+    size_t sweepBlock(Heap::Block* block);
+
+    // 清理新生代中未标记的对象，存活对象晋升到老年代
+    void sweepYoung();
+
+    // 记录一次回收停顿
+    void recordPause(std::chrono::steady_clock::time_point start);
+
+    // 析构并释放单个对象
+    void freeObject(Obj* o);
+
     // 注册内置原生函数
     void registerNative();
 
@@ -171,6 +454,19 @@ public:
     // 调用并执行闭包
     void callAndRun(ObjClosure* closure);
 
+    // 调用栈上位于 argc 个参数之前的被调用者，失败时返回 false
+    bool callValue(int argc);
+
+    // 调用原生函数，用返回值替换被调用者及其参数
+    void callNative(ObjNative* native, int argc, int calleeSlot);
+
+    // 在实例上解析字段或方法，结果写入 entry 并记录到内联缓存，找不到时返回 false
+    bool resolveInstanceProperty(ObjInstance* instance, ObjString* name, PropertyCache& cache,
+                                 PropertyCacheEntry& entry);
+
+    // 执行 OP_INVOKE：在接收者上查找方法并直接调用，不创建绑定方法
+    bool invoke(ObjString* name, PropertyCache& cache, int argc);
+
     // 主运行循环
     void run();
 
@@ -186,6 +482,64 @@ public:
     // 启用或禁用 JIT 编译
     void enableJIT(const bool enable = true) { jitEnabled = enable; }
 
+    // 设置 JIT 分层编译的阈值，0 表示首次调用即编译
+    void setJITThreshold(const uint32_t n) { jitThreshold = n; }
+
+    // 在后台编译时是否使用编译线程
+    void setJITBackground(const bool enable = true) { jitBackground = enable; }
+
+    // 把 JIT 代码的位置写入 /tmp/perf-<pid>.map 或 /tmp/jit-<pid>.dump，供 perf 解析符号
+    bool enableJITPerfMap() { return jit.enablePerfMap(); }
+    bool enableJITDump() { return jit.enableJitDump(); }
+
+    // 等待后台编译全部完成并安装机器码
+    void waitForJIT();
+
+    // 函数或循环足够热时提交编译，entry 为 OSR 的循环头位置（0 表示函数入口）
+    void tierUp(ObjFunction* function, int entry = 0);
+
+    // 安装编译结果，失败则标记为不再编译
+    void installJIT(JitJob& job);
+
+    // 取回并安装后台编译完成的任务
+    void installFinishedJIT();
+
+    // 丢弃假设已失效的机器码，函数回到解释执行并重新计数
+    void discardJIT(ObjFunction* function);
+
+    // 释放函数的全部机器码（不修改函数），回收函数时也经由这里，可在清理线程上调用
+    void releaseJITCode(const ObjFunction* function);
+
+    // 记录机器码直接引用的对象，由函数保持存活
+    void keepJITReferences(ObjFunction* function, std::vector<Obj*>& refs);
+
+    // 准备运行上下文后执行机器码，args 指向槽位 1
+    double runJIT(void* code, const Value* args);
+
+    // 按去优化记录重建机器码中止时各层的调用帧，从中途继续解释执行
+    void resumeFromDeopt(ObjClosure* closure, int calleeSlot);
+
+    // 统计守卫失败的次数，反复失败的函数丢弃机器码
+    void countDeopt();
+
+    // 热循环的回边处转入 OSR 机器码，执行过时返回 true，当前帧已换成去优化后重建的帧
+    bool enterOSR();
+
+    // 返回全局变量的槽位，不存在时分配新槽位
+    uint16_t globalSlot(ObjString* name);
+
+    // 按名称定义全局变量
+    void defineGlobal(ObjString* name, Value value);
+
+    // 按名称读取全局变量，未定义时返回 false
+    bool getGlobal(ObjString* name, Value& out) const;
+
+    // 按名称删除全局变量（槽位保留，重新变为未定义）
+    void removeGlobal(ObjString* name);
+
+    // 打印内联缓存命中率及各状态的缓存数量
+    void printInlineCacheStats() const;
+
 private:
     // 定义原生函数
     void defineNative(const std::string& name, const NativeFn& fn);
@@ -0,0 +1,49 @@
+#ifndef TINY_JS_WORKER_POOL_H
+#define TINY_JS_WORKER_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 垃圾回收工作线程池：run() 在所有工作线程上执行同一个任务，等待全部完成后返回
+// 调用线程本身作为 0 号工作线程参与执行，只有一个线程时不启动额外的线程
+class WorkerPool
+{
+public:
+    WorkerPool() = default;
+    ~WorkerPool() { stop(); }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // 设置工作线程数（含调用线程），线程在下次 run() 时按需启动
+    void resize(unsigned n);
+
+    // 工作线程数（含调用线程）
+    [[nodiscard]] unsigned size() const { return threadCount; }
+
+    // 在每个工作线程上执行 task(工作线程编号)，全部完成后返回
+    void run(const std::function<void(unsigned)>& task);
+
+private:
+    void stop();
+    // seen 为线程启动时已发布过的任务代数
+    void workerLoop(unsigned index, uint64_t seen);
+
+    unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable startCV;
+    std::condition_variable doneCV;
+    const std::function<void(unsigned)>* task = nullptr;
+    // 每次 run() 递增，工作线程据此判断是否有新任务
+    uint64_t generation = 0;
+    // 尚未完成当前任务的后台线程数
+    unsigned pending = 0;
+    bool stopping = false;
+};
+
+#endif //TINY_JS_WORKER_POOL_H
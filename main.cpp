@@ -1,20 +1,70 @@
-#include <string>
-#include "vm.h"
-
-constexpr auto MAIN_FILE = "main.js";
-
-int main(const int argc, char* argv[])
-{
-    VM vm;
-    vm.initModule();
-    vm.registerNative();
-    vm.enableJIT(true);
-
-    std::string entryFile = MAIN_FILE;
-    if (argc > 1)
-    {
-        entryFile = argv[1];
-    }
-
-    vm.runWithFile(entryFile);
-}
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "vm.h"
+
+constexpr auto MAIN_FILE = "main.js";
+
+int main(const int argc, char* argv[])
+{
+    VM vm;
+    vm.initModule();
+    vm.registerNative();
+    vm.enableJIT(true);
+
+    std::string entryFile = MAIN_FILE;
+    bool icStats = false;
+    bool gcStats = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (const std::string_view arg = argv[i]; arg == "--ic-stats")
+        {
+            icStats = true;
+        }
+        else if (arg == "--gc-stats")
+        {
+            gcStats = true;
+        }
+        else if (arg == "--gc-max-pause" && i + 1 < argc)
+        {
+            vm.setGCMaxPause(std::stod(argv[++i]));
+        }
+        else if (arg == "--gc-concurrent")
+        {
+            vm.concurrentMarking = true;
+        }
+        else if (arg == "--gc-threads" && i + 1 < argc)
+        {
+            vm.setGCThreads(static_cast<unsigned>(std::stoul(argv[++i])));
+        }
+        else if (arg == "--jit-threshold" && i + 1 < argc)
+        {
+            vm.setJITThreshold(static_cast<uint32_t>(std::stoul(argv[++i])));
+        }
+        else if (arg == "--jit-sync")
+        {
+            vm.setJITBackground(false);
+        }
+        else if (arg == "--jit-perf-map")
+        {
+            if (!vm.enableJITPerfMap()) std::cerr << "Cannot write perf map" << std::endl;
+        }
+        else if (arg == "--jit-dump")
+        {
+            if (!vm.enableJITDump()) std::cerr << "Cannot write jitdump" << std::endl;
+        }
+        else if (arg == "--max-heap" && i + 1 < argc)
+        {
+            vm.setMaxHeap(std::stod(argv[++i]));
+        }
+        else
+        {
+            entryFile = argv[i];
+        }
+    }
+
+    vm.runWithFile(entryFile);
+
+    if (icStats) vm.printInlineCacheStats();
+    if (gcStats) vm.printGCStats();
+}
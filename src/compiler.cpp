@@ -54,6 +54,19 @@ void Compiler::emitGlobalOp(uint8_t opcode, const int constIdx) const
     emitByte(static_cast<uint8_t>(constIdx & 0xFF));
 }
 
+void Compiler::emitPropertyOp(const OpCode op, const int nameIdx) const
+{
+    emitGlobalOp(static_cast<uint8_t>(op), nameIdx);
+    const int cacheIdx = currentChunk()->addPropertyCache();
+    emitByte(static_cast<uint8_t>((cacheIdx >> 8) & 0xFF));
+    emitByte(static_cast<uint8_t>(cacheIdx & 0xFF));
+}
+
+int Compiler::resolveGlobal(const std::string& name) const
+{
+    return vm.globalSlot(vm.newString(name));
+}
+
 int Compiler::resolveLocal(const CompilerState* s, const std::string& n)
 {
     for (int i = s->locals.size() - 1; i >= 0; i--) if (s->locals[i].name == n) return i;
@@ -95,7 +108,7 @@ void Compiler::compileFunction(const std::shared_ptr<FunctionStmt>& s, const boo
         }
         else
         {
-            gIdx = currentChunk()->addConstant(vm.newString(s->name.lexeme));
+            gIdx = resolveGlobal(s->name.lexeme);
         }
     }
 
@@ -153,7 +166,7 @@ void Compiler::compileFunction(const std::shared_ptr<FunctionStmt>& s, const boo
     ObjFunction* f = current->function;
     const auto ups = current->upvalues;
 
-    vm.tempRoots.pop_back();
+    vm.popTempRoot();
 
     current = current->enclosing;
     delete next;
@@ -186,7 +199,7 @@ ObjFunction* Compiler::compile(const std::vector<std::shared_ptr<Stmt>>& stmts)
     emitByte(static_cast<uint8_t>(OpCode::OP_RETURN));
     ObjFunction* f = current->function;
 
-    vm.tempRoots.pop_back();
+    vm.popTempRoot();
     delete current;
     return f;
 }
@@ -211,7 +224,7 @@ void Compiler::compileStmt(const std::shared_ptr<Stmt>& stmt)
         else
         {
             // 全局变量
-            const int i = currentChunk()->addConstant(vm.newString(var_stmt->name.lexeme));
+            const int i = resolveGlobal(var_stmt->name.lexeme);
 
             if (var_stmt->isConst)
             {
@@ -234,6 +247,7 @@ void Compiler::compileStmt(const std::shared_ptr<Stmt>& stmt)
                 {
                     compileExpr(var_stmt->initializer);
                     emitGlobalOp(static_cast<uint8_t>(OpCode::OP_SET_GLOBAL), i);
+                    emitByte(static_cast<uint8_t>(OpCode::OP_POP));
                 }
             }
         }
@@ -252,11 +266,14 @@ void Compiler::compileStmt(const std::shared_ptr<Stmt>& stmt)
     }
     else if (const auto if_stmt = std::dynamic_pointer_cast<IfStmt>(stmt))
     {
+        // 条件跳转不弹出条件值，两个分支各自弹出，保持栈深度一致
         compileExpr(if_stmt->condition);
         const int tj = emitJump(OpCode::OP_JUMP_IF_FALSE);
+        emitByte(static_cast<uint8_t>(OpCode::OP_POP));
         compileStmt(if_stmt->thenBranch);
         const int ej = emitJump(OpCode::OP_JUMP);
         patchJump(tj);
+        emitByte(static_cast<uint8_t>(OpCode::OP_POP));
         if (if_stmt->elseBranch) compileStmt(if_stmt->elseBranch);
         patchJump(ej);
     }
@@ -265,9 +282,11 @@ void Compiler::compileStmt(const std::shared_ptr<Stmt>& stmt)
         const size_t ls = currentChunk()->code.size();
         compileExpr(while_stmt->condition);
         const int ej = emitJump(OpCode::OP_JUMP_IF_FALSE);
+        emitByte(static_cast<uint8_t>(OpCode::OP_POP));
         compileStmt(while_stmt->body);
         emitLoop(static_cast<int>(ls));
         patchJump(ej);
+        emitByte(static_cast<uint8_t>(OpCode::OP_POP));
     }
     else if (const auto function_stmt = std::dynamic_pointer_cast<FunctionStmt>(stmt))
     {
@@ -282,9 +301,10 @@ void Compiler::compileStmt(const std::shared_ptr<Stmt>& stmt)
     else if (const auto class_stmt = std::dynamic_pointer_cast<ClassStmt>(stmt))
     {
         const int nameIdx = currentChunk()->addConstant(vm.newString(class_stmt->name.lexeme));
+        const int classSlot = resolveGlobal(class_stmt->name.lexeme);
         emitGlobalOp(static_cast<uint8_t>(OpCode::OP_CLASS), nameIdx);
-        emitGlobalOp(static_cast<uint8_t>(OpCode::OP_DEFINE_GLOBAL), nameIdx); // 定义类名
-        emitGlobalOp(static_cast<uint8_t>(OpCode::OP_GET_GLOBAL), nameIdx);
+        emitGlobalOp(static_cast<uint8_t>(OpCode::OP_DEFINE_GLOBAL), classSlot); // 定义类名
+        emitGlobalOp(static_cast<uint8_t>(OpCode::OP_GET_GLOBAL), classSlot);
         for (auto& method : class_stmt->methods)
         {
             const int constIdx = currentChunk()->addConstant(vm.newString(method->name.lexeme));
@@ -298,7 +318,7 @@ void Compiler::compileStmt(const std::shared_ptr<Stmt>& stmt)
     }
     else if (const auto import_stmt = std::dynamic_pointer_cast<ImportStmt>(stmt))
     {
-        const int requireIdx = currentChunk()->addConstant(vm.newString("require"));
+        const int requireIdx = resolveGlobal("require");
 
         // 先压入被调用者
         emitGlobalOp(static_cast<uint8_t>(OpCode::OP_GET_GLOBAL), requireIdx);
@@ -326,10 +346,10 @@ void Compiler::compileStmt(const std::shared_ptr<Stmt>& stmt)
 
             const auto& spec = import_stmt->specifiers[i];
             const int propNameIdx = currentChunk()->addConstant(vm.newString(spec.lexeme));
-            emitGlobalOp(static_cast<uint8_t>(OpCode::OP_GET_PROPERTY), propNameIdx);
+            emitPropertyOp(OpCode::OP_GET_PROPERTY, propNameIdx);
 
             // 定义为全局变量
-            const int globalNameIdx = currentChunk()->addConstant(vm.newString(spec.lexeme));
+            const int globalNameIdx = resolveGlobal(spec.lexeme);
             emitGlobalOp(static_cast<uint8_t>(OpCode::OP_DEFINE_GLOBAL), globalNameIdx);
         }
     }
@@ -351,7 +371,7 @@ void Compiler::compileStmt(const std::shared_ptr<Stmt>& stmt)
                 }
             }
 
-            const int exportsIdx = currentChunk()->addConstant(vm.newString("exports"));
+            const int exportsIdx = resolveGlobal("exports");
             emitGlobalOp(static_cast<uint8_t>(OpCode::OP_GET_GLOBAL), exportsIdx);
 
             // 获取变量值
@@ -361,10 +381,10 @@ void Compiler::compileStmt(const std::shared_ptr<Stmt>& stmt)
             }
             else
             {
-                emitGlobalOp(static_cast<uint8_t>(OpCode::OP_GET_GLOBAL), varNameIdx);
+                emitGlobalOp(static_cast<uint8_t>(OpCode::OP_GET_GLOBAL), resolveGlobal(spec.lexeme));
             }
 
-            emitGlobalOp(static_cast<uint8_t>(OpCode::OP_SET_PROPERTY), varNameIdx);
+            emitPropertyOp(OpCode::OP_SET_PROPERTY, varNameIdx);
             emitByte(static_cast<uint8_t>(OpCode::OP_POP));
         }
     }
@@ -414,19 +434,9 @@ void Compiler::compileExpr(const std::shared_ptr<Expr>& expr)
         else if (t == TokenType::EQUAL_EQUAL_EQUAL) emitByte(static_cast<uint8_t>(OpCode::OP_STRICT_EQUAL));
         else if (t == TokenType::BANG_EQUAL_EQUAL) emitByte(static_cast<uint8_t>(OpCode::OP_STRICT_NOT_EQUAL));
         else if (t == TokenType::LESS) emitByte(static_cast<uint8_t>(OpCode::OP_LESS));
-        else if (t == TokenType::LESS_EQUAL)
-        {
-            compileExpr(binary->right);
-            compileExpr(binary->left);
-            emitByte(static_cast<uint8_t>(OpCode::OP_GREATER));
-        }
+        else if (t == TokenType::LESS_EQUAL) emitByte(static_cast<uint8_t>(OpCode::OP_LESS_EQUAL));
         else if (t == TokenType::GREATER) emitByte(static_cast<uint8_t>(OpCode::OP_GREATER));
-        else if (t == TokenType::GREATER_EQUAL)
-        {
-            compileExpr(binary->right);
-            compileExpr(binary->left);
-            emitByte(static_cast<uint8_t>(OpCode::OP_LESS));
-        }
+        else if (t == TokenType::GREATER_EQUAL) emitByte(static_cast<uint8_t>(OpCode::OP_GREATER_EQUAL));
         else if (t == TokenType::AND_AND)
         {
             compileExpr(binary->left);
@@ -465,8 +475,7 @@ void Compiler::compileExpr(const std::shared_ptr<Expr>& expr)
         else if ((arg = resolveUpvalue(current, variable->name.lexeme)) != -1)
             emitBytes(static_cast<uint8_t>(OpCode::OP_GET_UPVALUE), static_cast<uint8_t>(arg));
         else
-            emitGlobalOp(static_cast<uint8_t>(OpCode::OP_GET_GLOBAL),
-                         currentChunk()->addConstant(vm.newString(variable->name.lexeme)));
+            emitGlobalOp(static_cast<uint8_t>(OpCode::OP_GET_GLOBAL), resolveGlobal(variable->name.lexeme));
     }
     else if (const auto assign = std::dynamic_pointer_cast<Assign>(expr))
     {
@@ -489,12 +498,20 @@ void Compiler::compileExpr(const std::shared_ptr<Expr>& expr)
         }
         else
         {
-            emitGlobalOp(static_cast<uint8_t>(OpCode::OP_SET_GLOBAL),
-                         currentChunk()->addConstant(vm.newString(assign->name.lexeme)));
+            emitGlobalOp(static_cast<uint8_t>(OpCode::OP_SET_GLOBAL), resolveGlobal(assign->name.lexeme));
         }
     }
     else if (const auto call = std::dynamic_pointer_cast<Call>(expr))
     {
+        // obj.method(args) 直接编译为 OP_INVOKE，避免创建绑定方法
+        if (const auto callee = std::dynamic_pointer_cast<GetExpr>(call->callee))
+        {
+            compileExpr(callee->object);
+            for (const auto& a : call->args) compileExpr(a);
+            emitPropertyOp(OpCode::OP_INVOKE, currentChunk()->addConstant(vm.newString(callee->name.lexeme)));
+            emitByte(static_cast<uint8_t>(call->args.size()));
+            return;
+        }
         compileExpr(call->callee);
         for (const auto& a : call->args) compileExpr(a);
         emitBytes(static_cast<uint8_t>(OpCode::OP_CALL), static_cast<uint8_t>(call->args.size()));
@@ -523,13 +540,17 @@ void Compiler::compileExpr(const std::shared_ptr<Expr>& expr)
     }
     else if (const auto object_expr = std::dynamic_pointer_cast<ObjectExpr>(expr))
     {
+        // 属性名记录在字面量模板中（由函数保持存活），栈上只放属性值
+        const int literalIdx = currentChunk()->addObjectLiteral();
         for (const auto& prop : object_expr->properties)
         {
-            const int keyIdx = currentChunk()->addConstant(vm.newString(prop.key.lexeme));
-            emitConstant(keyIdx);
+            ObjString* key = vm.newString(prop.key.lexeme);
+            currentChunk()->objectLiterals[literalIdx].keys.push_back(key);
             compileExpr(prop.value);
         }
         emitBytes(static_cast<uint8_t>(OpCode::OP_BUILD_OBJECT), static_cast<uint8_t>(object_expr->properties.size()));
+        emitByte(static_cast<uint8_t>((literalIdx >> 8) & 0xFF));
+        emitByte(static_cast<uint8_t>(literalIdx & 0xFF));
     }
     else if (const auto get_subscript_expr = std::dynamic_pointer_cast<GetSubscriptExpr>(expr))
     {
@@ -552,14 +573,14 @@ void Compiler::compileExpr(const std::shared_ptr<Expr>& expr)
     {
         compileExpr(get_expr->object);
         const int nameIdx = currentChunk()->addConstant(vm.newString(get_expr->name.lexeme));
-        emitGlobalOp(static_cast<uint8_t>(OpCode::OP_GET_PROPERTY), nameIdx);
+        emitPropertyOp(OpCode::OP_GET_PROPERTY, nameIdx);
     }
     else if (const auto set_expr = std::dynamic_pointer_cast<SetExpr>(expr))
     {
         compileExpr(set_expr->object);
         compileExpr(set_expr->value);
         const int nameIdx = currentChunk()->addConstant(vm.newString(set_expr->name.lexeme));
-        emitGlobalOp(static_cast<uint8_t>(OpCode::OP_SET_PROPERTY), nameIdx);
+        emitPropertyOp(OpCode::OP_SET_PROPERTY, nameIdx);
     }
     else if (const auto update = std::dynamic_pointer_cast<UpdateExpr>(expr))
     {
@@ -582,7 +603,7 @@ void Compiler::compileExpr(const std::shared_ptr<Expr>& expr)
         {
             getOp = OpCode::OP_GET_GLOBAL;
             setOp = OpCode::OP_SET_GLOBAL;
-            index = currentChunk()->addConstant(vm.newString(update->name.lexeme));
+            index = resolveGlobal(update->name.lexeme);
         }
 
         if (update->isPostfix)
@@ -691,7 +712,7 @@ void Compiler::compileFunctionExpression(const std::shared_ptr<FunctionExpr>& ex
     ObjFunction* f = current->function;
     const auto ups = current->upvalues;
 
-    vm.tempRoots.pop_back();
+    vm.popTempRoot();
 
     current = current->enclosing;
     delete next;
@@ -748,7 +769,7 @@ void Compiler::compileArrowFunctionExpression(const std::shared_ptr<ArrowFunctio
     ObjFunction* f = current->function;
     const auto ups = current->upvalues;
 
-    vm.tempRoots.pop_back();
+    vm.popTempRoot();
 
     current = current->enclosing;
     delete next;
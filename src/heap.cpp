@@ -0,0 +1,207 @@
+#include "heap.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+Heap::~Heap()
+{
+    // 调用方应已析构所有对象，此处只归还块内存
+    for (Block* b : usedBlocks) std::free(b);
+    for (Block* b : freeBlocks) std::free(b);
+}
+
+size_t Heap::headerSize()
+{
+    return cellSize(sizeof(Block));
+}
+
+size_t Heap::allocationSize(const void* p)
+{
+    return blockOf(p)->cellSize;
+}
+
+bool Heap::hasRoom(const Block* block)
+{
+    return block->freeList || block->cursor + block->cellSize <= block->end;
+}
+
+Heap::Block* Heap::newBlock(const uint32_t cellSize)
+{
+    void* mem;
+    if (!freeBlocks.empty())
+    {
+        mem = freeBlocks.back();
+        freeBlocks.pop_back();
+    }
+    else
+    {
+        mem = std::aligned_alloc(BLOCK_SIZE, BLOCK_SIZE);
+        if (!mem) throw std::bad_alloc();
+        blocks++;
+    }
+    auto* block = static_cast<Block*>(mem);
+    block->prev = nullptr;
+    block->next = nullptr;
+    block->cursor = static_cast<uint8_t*>(mem) + headerSize();
+    block->end = static_cast<uint8_t*>(mem) + BLOCK_SIZE;
+    block->freeList = nullptr;
+    block->cellSize = cellSize;
+    block->liveObjects = 0;
+    block->available = false;
+    block->sweepPending = false;
+    std::memset(block->allocBits, 0, sizeof(block->allocBits));
+    std::memset(block->markBits, 0, sizeof(block->markBits));
+    block->usedIndex = static_cast<uint32_t>(usedBlocks.size());
+    usedBlocks.push_back(block);
+    return block;
+}
+
+void Heap::releaseBlock(Block* block)
+{
+    usedBlocks[block->usedIndex] = usedBlocks.back();
+    usedBlocks[block->usedIndex]->usedIndex = block->usedIndex;
+    usedBlocks.pop_back();
+    // 本轮清理尚未到达的空块不再需要清理
+    if (block->sweepPending) sweepBlocks[block->sweepIndex] = nullptr;
+
+    if (freeBlocks.size() < MAX_FREE_BLOCKS)
+    {
+        freeBlocks.push_back(block);
+    }
+    else
+    {
+        std::free(block);
+        blocks--;
+    }
+}
+
+void Heap::linkAvailable(SizeClass& sc, Block* block)
+{
+    block->prev = nullptr;
+    block->next = sc.available;
+    if (sc.available) sc.available->prev = block;
+    sc.available = block;
+    block->available = true;
+}
+
+void Heap::unlinkAvailable(SizeClass& sc, Block* block)
+{
+    if (block->prev) block->prev->next = block->next;
+    else sc.available = block->next;
+    if (block->next) block->next->prev = block->prev;
+    block->prev = block->next = nullptr;
+    block->available = false;
+}
+
+void* Heap::allocate(const size_t size)
+{
+    const size_t cell = cellSize(size);
+    SizeClass& sc = classes[cell / ALIGNMENT - 1];
+    Block* block = sc.current;
+    if (!block || !hasRoom(block))
+    {
+        // 写满的当前块不进入任何链表，其中有对象释放时再加入可用块链表
+        if (sc.available)
+        {
+            block = sc.available;
+            unlinkAvailable(sc, block);
+        }
+        else
+        {
+            block = newBlock(static_cast<uint32_t>(cell));
+        }
+        sc.current = block;
+    }
+
+    void* p;
+    if (block->freeList)
+    {
+        p = block->freeList;
+        block->freeList = block->freeList->next;
+    }
+    else
+    {
+        p = block->cursor;
+        block->cursor += cell;
+    }
+    const size_t i = cellIndex(p);
+    block->allocBits[i / 64] |= bitOf(i);
+    block->liveObjects++;
+    nurseryAllocated += cell;
+    return p;
+}
+
+void Heap::releaseCell(Block* block, const size_t i)
+{
+    block->allocBits[i / 64] &= ~bitOf(i);
+    std::atomic_ref(block->markBits[i / 64]).fetch_and(~bitOf(i), std::memory_order_relaxed);
+    auto* cell = static_cast<FreeCell*>(cellAt(block, i));
+    cell->next = block->freeList;
+    block->freeList = cell;
+    block->liveObjects--;
+}
+
+void Heap::free(void* p)
+{
+    Block* block = blockOf(p);
+    releaseCell(block, cellIndex(p));
+    updateBlock(block);
+}
+
+void Heap::updateBlock(Block* block)
+{
+    SizeClass& sc = classes[block->cellSize / ALIGNMENT - 1];
+    if (block == sc.current)
+    {
+        if (block->liveObjects == 0)
+        {
+            // 当前块已空，丢弃空闲链表从头重新切分
+            block->freeList = nullptr;
+            block->cursor = reinterpret_cast<uint8_t*>(block) + headerSize();
+        }
+        return;
+    }
+    if (block->liveObjects == 0)
+    {
+        if (block->available) unlinkAvailable(sc, block);
+        releaseBlock(block);
+        return;
+    }
+    if (block->freeList && !block->available) linkAvailable(sc, block);
+}
+
+void Heap::beginSweep()
+{
+    sweepBlocks = usedBlocks;
+    for (size_t i = 0; i < sweepBlocks.size(); i++)
+    {
+        sweepBlocks[i]->sweepPending = true;
+        sweepBlocks[i]->sweepIndex = static_cast<uint32_t>(i);
+    }
+    sweepCursor.store(0, std::memory_order_relaxed);
+    sweepFinished = 0;
+}
+
+Heap::Block* Heap::takeSweepBlock()
+{
+    while (true)
+    {
+        const size_t i = sweepCursor.fetch_add(1, std::memory_order_relaxed);
+        if (i >= sweepBlocks.size()) return nullptr;
+        if (sweepBlocks[i]) return sweepBlocks[i];
+    }
+}
+
+void Heap::finishSweptBlocks()
+{
+    const size_t end = std::min(sweepCursor.load(std::memory_order_relaxed), sweepBlocks.size());
+    for (; sweepFinished < end; sweepFinished++)
+    {
+        Block* block = sweepBlocks[sweepFinished];
+        if (!block) continue;
+        // 整理时可能归还块，先从清理列表移除
+        sweepBlocks[sweepFinished] = nullptr;
+        updateBlock(block);
+    }
+}
@@ -1,26 +1,180 @@
 #include "jit.h"
 #include "debug.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "asmjit/x86/x86compiler.h"
 #include "asmjit/arm/a64compiler.h"
 
-constexpr auto ZERO_VALUE = 0.0;
+// 取模交给 fmod，与解释器的结果一致（除数为 0、商超出整数范围时不能用截断相除代替）
+static double jitMod(const double a, const double b)
+{
+    return std::fmod(a, b);
+}
+
+// 指令后面跟随的操作数字节数
+static int operandBytes(const uint8_t instruction)
+{
+    switch (instruction)
+    {
+    case static_cast<uint8_t>(OpCode::OP_CONSTANT):
+    case static_cast<uint8_t>(OpCode::OP_GET_GLOBAL):
+    case static_cast<uint8_t>(OpCode::OP_SET_GLOBAL):
+    case static_cast<uint8_t>(OpCode::OP_JUMP):
+    case static_cast<uint8_t>(OpCode::OP_JUMP_IF_FALSE):
+    case static_cast<uint8_t>(OpCode::OP_JUMP_IF_TRUE):
+    case static_cast<uint8_t>(OpCode::OP_LOOP):
+        return 2;
+    case static_cast<uint8_t>(OpCode::OP_GET_LOCAL):
+    case static_cast<uint8_t>(OpCode::OP_SET_LOCAL):
+    case static_cast<uint8_t>(OpCode::OP_CALL):
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// JIT 能否编译该指令
+static bool isSupported(const uint8_t instruction)
+{
+    switch (instruction)
+    {
+    case static_cast<uint8_t>(OpCode::OP_CONSTANT):
+    case static_cast<uint8_t>(OpCode::OP_TRUE):
+    case static_cast<uint8_t>(OpCode::OP_FALSE):
+    case static_cast<uint8_t>(OpCode::OP_POP):
+    case static_cast<uint8_t>(OpCode::OP_GET_LOCAL):
+    case static_cast<uint8_t>(OpCode::OP_SET_LOCAL):
+    case static_cast<uint8_t>(OpCode::OP_GET_GLOBAL):
+    case static_cast<uint8_t>(OpCode::OP_SET_GLOBAL):
+    case static_cast<uint8_t>(OpCode::OP_CALL):
+    case static_cast<uint8_t>(OpCode::OP_EQUAL):
+    case static_cast<uint8_t>(OpCode::OP_GREATER):
+    case static_cast<uint8_t>(OpCode::OP_GREATER_NUM):
+    case static_cast<uint8_t>(OpCode::OP_LESS):
+    case static_cast<uint8_t>(OpCode::OP_LESS_NUM):
+    case static_cast<uint8_t>(OpCode::OP_GREATER_EQUAL):
+    case static_cast<uint8_t>(OpCode::OP_GREATER_EQUAL_NUM):
+    case static_cast<uint8_t>(OpCode::OP_LESS_EQUAL):
+    case static_cast<uint8_t>(OpCode::OP_LESS_EQUAL_NUM):
+    case static_cast<uint8_t>(OpCode::OP_ADD):
+    case static_cast<uint8_t>(OpCode::OP_ADD_NUM):
+    case static_cast<uint8_t>(OpCode::OP_SUB):
+    case static_cast<uint8_t>(OpCode::OP_MUL):
+    case static_cast<uint8_t>(OpCode::OP_DIV):
+    case static_cast<uint8_t>(OpCode::OP_MOD):
+    case static_cast<uint8_t>(OpCode::OP_NOT):
+    case static_cast<uint8_t>(OpCode::OP_NEGATE):
+    case static_cast<uint8_t>(OpCode::OP_JUMP):
+    case static_cast<uint8_t>(OpCode::OP_JUMP_IF_FALSE):
+    case static_cast<uint8_t>(OpCode::OP_JUMP_IF_TRUE):
+    case static_cast<uint8_t>(OpCode::OP_LOOP):
+    case static_cast<uint8_t>(OpCode::OP_RETURN):
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 收集 [ip, limit) 内所有跳转目标；不支持的指令长度未知，扫描到此为止
+static void scanJumpTargets(const Chunk* chunk, int ip, const int limit, std::set<int>& targets)
+{
+    while (ip < limit)
+    {
+        const uint8_t instruction = chunk->code[ip++];
+        if (!isSupported(instruction))
+        {
+            return;
+        }
+        switch (instruction)
+        {
+        case static_cast<uint8_t>(OpCode::OP_LOOP):
+            targets.insert(ip + 2 - (chunk->code[ip] << 8 | chunk->code[ip + 1]));
+            break;
+        case static_cast<uint8_t>(OpCode::OP_JUMP):
+        case static_cast<uint8_t>(OpCode::OP_JUMP_IF_FALSE):
+        case static_cast<uint8_t>(OpCode::OP_JUMP_IF_TRUE):
+            targets.insert(ip + 2 + (chunk->code[ip] << 8 | chunk->code[ip + 1]));
+            break;
+        default:
+            break;
+        }
+        ip += operandBytes(instruction);
+    }
+}
+
+// 循环头 entry 对应的 OP_LOOP 之后的位置，循环体内有不支持的指令时返回 -1
+static int findLoopEnd(const Chunk* chunk, int ip)
+{
+    const int entry = ip;
+    while (ip < static_cast<int>(chunk->code.size()))
+    {
+        const uint8_t instruction = chunk->code[ip++];
+        if (!isSupported(instruction))
+        {
+            return -1;
+        }
+        if (instruction == static_cast<uint8_t>(OpCode::OP_LOOP) &&
+            ip + 2 - (chunk->code[ip] << 8 | chunk->code[ip + 1]) == entry)
+        {
+            return ip + 2;
+        }
+        ip += operandBytes(instruction);
+    }
+    return -1;
+}
+
+JitCompiler::JitFn JitCompiler::compile(const Chunk* chunk, const int arity)
+{
+    CompileUnit unit{chunk, arity, nullptr, nullptr, {}};
+    return compileUnit(unit);
+}
 
-JitCompiler::JitFn JitCompiler::compile(const Chunk* chunk)
+void JitCompiler::compile(JitJob& job)
+{
+    CompileUnit unit{&job.chunk, job.function->arity, job.function, &job.refs, {}, job.entry, job.slots.data(),
+                     static_cast<int>(job.slots.size())};
+    unit.globals = &job.globals;
+    if (job.entry != 0)
+    {
+        unit.end = findLoopEnd(unit.chunk, job.entry);
+        if (unit.end < 0)
+        {
+            return;
+        }
+    }
+    job.code = reinterpret_cast<void*>(compileUnit(unit));
+}
+
+void JitCompiler::release(const JitFn fn)
+{
+    rt.release(fn);
+}
+
+JitCompiler::JitFn JitCompiler::compileUnit(CompileUnit& unit)
 {
     try
     {
+        if (unit.entry == 0)
+        {
+            unit.end = static_cast<int>(unit.chunk->code.size());
+        }
+        scanJumpTargets(unit.chunk, unit.entry, unit.end, unit.targets);
+
         CodeHolder code;
         code.init(rt.environment());
 
         // 根据架构选择编译器
         if (rt.environment().is_family_x86())
         {
-            return compileX86(chunk, code);
+            return compileX86(unit, code);
         }
         if (rt.environment().is_family_aarch64())
         {
-            return compileAArch64(chunk, code);
+            return compileAArch64(unit, code);
         }
         std::cout << "Unsupported architecture for JIT compilation" << std::endl;
         return nullptr;
@@ -37,12 +191,48 @@ JitCompiler::JitFn JitCompiler::compile(const Chunk* chunk)
     }
 }
 
-JitCompiler::JitFn JitCompiler::compileX86(const Chunk* chunk, CodeHolder& code)
+std::string JitCompiler::symbolName(const CompileUnit& unit)
+{
+    std::string name = "js::" + (unit.function != nullptr ? unit.function->name : std::string("<chunk>"));
+    if (unit.entry != 0)
+    {
+        name += " [osr@" + std::to_string(unit.entry) + "]";
+    }
+    return name;
+}
+
+const GlobalSlot* JitCompiler::lookupGlobal(const CompileUnit& unit, const uint16_t slot)
 {
+    if (unit.globals == nullptr || slot >= unit.globals->size() || !(*unit.globals)[slot].defined)
+    {
+        return nullptr;
+    }
+    return &(*unit.globals)[slot];
+}
+
+ObjClosure* JitCompiler::resolveCallee(const CompileUnit& unit, const uint16_t slot, const int argc)
+{
+    const GlobalSlot* global = lookupGlobal(unit, slot);
+    if (unit.refs == nullptr || global == nullptr || !isObjType(global->value, ObjType::CLOSURE))
+    {
+        return nullptr;
+    }
+    auto* closure = static_cast<ObjClosure*>(global->value.asObj());
+    // 编译失败过的函数不会再有机器码，调用它总会中止；自身递归时机器码稍后才写入
+    if (closure->function->arity != argc || (closure->function->jitFailed && closure->function != unit.function))
+    {
+        return nullptr;
+    }
+    return closure;
+}
+
+JitCompiler::JitFn JitCompiler::compileX86(CompileUnit& unit, CodeHolder& code)
+{
+    const Chunk* chunk = unit.chunk;
     x86::Compiler cc(&code);
 
     FuncNode* func_node;
-    Error err = cc.add_func_node(Out(func_node), FuncSignature::build<double, uint64_t>());
+    Error err = cc.add_func_node(Out(func_node), FuncSignature::build<double, const Value*, JitContext*>());
     if (err != Error::kOk)
     {
         std::cout << "Failed to create FuncNode: " << DebugUtils::error_as_string(err) << std::endl;
@@ -50,15 +240,315 @@ JitCompiler::JitFn JitCompiler::compileX86(const Chunk* chunk, CodeHolder& code)
     }
 
     const x86::Gp args = cc.new_gp64();
+    const x86::Gp ctx = cc.new_gp64();
     func_node->set_arg(0, args);
+    func_node->set_arg(1, ctx);
 
-    // 处理字节码
-    int ip = 0;
+    // 处理字节码，OSR 从循环头开始
+    int ip = unit.entry;
     bool jitFailed = false;
 
-    while (ip < chunk->code.size() && !jitFailed)
+    // 操作数栈的一项：数字放在向量寄存器，布尔值以 0/1 放在通用寄存器；
+    // 被调函数保存读取全局变量时的值（参数求值可能给全局变量重新赋值），并记录来自哪个全局变量，
+    // 由对应的 OP_CALL 确定编译时的被调函数
+    struct Slot
+    {
+        bool isBool = false;
+        x86::Vec num;
+        x86::Gp flag;
+        bool isCallee = false;
+        uint16_t global = 0;
+        x86::Gp callee;
+    };
+
+    auto isNumber = [](const Slot& slot) { return !slot.isBool && !slot.isCallee; };
+
+    auto newSlot = [&](const bool isBool)
+    {
+        Slot slot;
+        slot.isBool = isBool;
+        if (isBool) slot.flag = cc.new_gp32();
+        else slot.num = cc.new_xmm();
+        return slot;
+    };
+    auto copySlot = [&](const Slot& dst, const Slot& src)
+    {
+        if (src.isBool) cc.mov(dst.flag, src.flag);
+        else cc.movapd(dst.num, src.num);
+    };
+    // 从内存加载按类型推测的值，实际类型不同时跳到 fail
+    auto loadValue = [&](const x86::Mem& from, const bool isBool, const Label& fail)
+    {
+        const Slot slot = newSlot(isBool);
+        const x86::Gp bits = cc.new_gp64();
+        const x86::Gp tag = cc.new_gp64();
+        const x86::Gp expected = cc.new_gp64();
+        cc.mov(bits, from);
+        if (!isBool)
+        {
+            cc.mov(expected, Value::tagMask());
+            cc.mov(tag, expected);
+            cc.and_(tag, bits);
+            cc.cmp(tag, expected);
+            cc.je(fail);
+            cc.movq(slot.num, bits);
+        }
+        else
+        {
+            cc.mov(expected, Value(true).raw());
+            cc.mov(tag, bits);
+            cc.or_(tag, 1);
+            cc.cmp(tag, expected);
+            cc.jne(fail);
+            cc.xor_(slot.flag, slot.flag);
+            cc.cmp(bits, expected);
+            cc.sete(slot.flag.r8());
+        }
+        return slot;
+    };
+
+    // 字节码操作数栈在编译期映射为虚拟寄存器，由 asmjit 的寄存器分配器决定物理寄存器
+    // 每个虚拟寄存器只写一次，局部变量槽位可以直接引用栈上的寄存器
+    std::vector<Slot> stack;
+
+    // 槽位 0 是闭包本身，按 0 处理
+    Slot self = newSlot(false);
+    cc.xorpd(self.num, self.num);
+    stack.push_back(self);
+    // OSR 入口处的类型与编译时不同则跳到 mismatch，不写去优化记录，解释器继续执行循环
+    Label mismatch;
+    if (unit.entry == 0)
+    {
+        // 槽位 1..arity 是参数
+        for (int i = 0; i < unit.arity; i++)
+        {
+            Slot arg = newSlot(false);
+            cc.movsd(arg.num, x86::ptr(args, i * 8));
+            stack.push_back(arg);
+        }
+    }
+    else
+    {
+        // 槽位 1 及之后从解释器帧加载，只支持数字和布尔值
+        mismatch = cc.new_label();
+        for (int i = 1; i < unit.entryCount; i++)
+        {
+            const Value value = unit.entrySlots[i];
+            if (!value.isNumber() && !value.isBool())
+            {
+                return nullptr;
+            }
+            stack.push_back(loadValue(x86::ptr(args, (i - 1) * 8), value.isBool(), mismatch));
+        }
+    }
+
+    // 每个跳转目标一个标签，以及到达该处时栈的规范寄存器
+    std::unordered_map<int, Label> labels;
+    std::unordered_map<int, std::vector<Slot>> states;
+    for (const int target : unit.targets)
+    {
+        labels.emplace(target, cc.new_label());
+    }
+    // 去优化点：守卫失败或被调函数去优化时，按 ip 处的栈布局把槽位写入去优化记录
+    struct DeoptSite
+    {
+        Label label;
+        int ip;
+        std::vector<Slot> stack;
+        // 是否守卫失败（否则是被调函数中止后回到调用点）
+        bool guard;
+    };
+    std::vector<DeoptSite> sites;
+    auto deoptAt = [&](const int at, const size_t depth, const bool guard)
+    {
+        if (depth + 1 > JitContext::MAX_RECORD)
+        {
+            jitFailed = true;
+        }
+        sites.push_back({cc.new_label(), at, {stack.begin(), stack.begin() + depth}, guard});
+        return sites.back().label;
+    };
+    // 中止后各层跳到 unwind 返回
+    const Label unwind = cc.new_label();
+    // 当前位置是否可达（跳转、循环和返回之后直到下一个跳转目标都不可达）
+    bool reachable = true;
+    // 解码的终点：整个函数，或者 OSR 的循环体；遇到不支持的指令时提前结束
+    int end = unit.end;
+    // 已经绑定的跳转目标
+    std::set<int> bound;
+
+    // OSR 代码无法继续的位置：带着当前的栈回到解释器，从 target 继续执行
+    auto leaveTo = [&](const int target)
+    {
+        if (unit.entry == 0)
+        {
+            jitFailed = true;
+            return;
+        }
+        cc.jmp(deoptAt(target, stack.size(), false));
+        reachable = false;
+    };
+
+    // 把当前栈写入跳转目标的规范寄存器，首次到达时为每个槽位分配新寄存器
+    auto mergeInto = [&](const int target)
     {
+        auto [it, inserted] = states.try_emplace(target);
+        std::vector<Slot>& state = it->second;
+        // 被调函数不能跨越跳转
+        if (std::ranges::any_of(stack, [](const Slot& slot) { return slot.isCallee; }))
+        {
+            return false;
+        }
+        if (inserted)
+        {
+            for (const Slot& slot : stack)
+            {
+                state.push_back(newSlot(slot.isBool));
+                copySlot(state.back(), slot);
+            }
+            return true;
+        }
+        if (state.size() != stack.size())
+        {
+            return false;
+        }
+        // 先复制到临时寄存器再写回，避免槽位之间互相覆盖
+        std::vector<Slot> temps;
+        for (size_t i = 0; i < stack.size(); i++)
+        {
+            if (stack[i].isBool != state[i].isBool)
+            {
+                return false;
+            }
+            temps.push_back(newSlot(stack[i].isBool));
+            copySlot(temps.back(), stack[i]);
+        }
+        for (size_t i = 0; i < temps.size(); i++)
+        {
+            copySlot(state[i], temps[i]);
+        }
+        return true;
+    };
+
+    // 值的真假与 to 一致时跳转，数字 0 为假，NaN 为真
+    auto branch = [&](const Slot& value, const bool whenTruthy, const Label& to)
+    {
+        if (value.isBool)
+        {
+            cc.test(value.flag, value.flag);
+            if (whenTruthy) cc.jnz(to);
+            else cc.jz(to);
+            return;
+        }
+        const x86::Vec zero = cc.new_xmm();
+        cc.xorpd(zero, zero);
+        cc.ucomisd(value.num, zero);
+        if (whenTruthy)
+        {
+            cc.jp(to);
+            cc.jne(to);
+        }
+        else
+        {
+            const Label truthy = cc.new_label();
+            cc.jp(truthy);
+            cc.je(to);
+            cc.bind(truthy);
+        }
+    };
+
+    // 比较两个数字，equal 为 false 时求 a > b
+    // 比较的种类：相等、a > b、a >= b，小于类比较交换操作数
+    enum class Compare { EQUAL, ABOVE, ABOVE_EQUAL };
+    auto compare = [&](const x86::Vec& a, const x86::Vec& b, const Compare kind)
+    {
+        Slot result = newSlot(true);
+        cc.xor_(result.flag, result.flag);
+        if (kind == Compare::EQUAL)
+        {
+            // 相等且不是无序比较（NaN）
+            const x86::Gp ordered = cc.new_gp32();
+            cc.xor_(ordered, ordered);
+            cc.ucomisd(a, b);
+            cc.sete(result.flag.r8());
+            cc.setnp(ordered.r8());
+            cc.and_(result.flag, ordered);
+        }
+        else
+        {
+            // 无序比较（NaN）时 CF 和 ZF 都置位，seta 和 setae 都得到假
+            cc.ucomisd(a, b);
+            if (kind == Compare::ABOVE) cc.seta(result.flag.r8());
+            else cc.setae(result.flag.r8());
+        }
+        return result;
+    };
+
+    // 弹出两个数字操作数，复制左操作数后执行运算，结果压回栈
+    auto binary = [&](auto&& emit)
+    {
+        if (stack.size() < 2 || !isNumber(stack[stack.size() - 1]) || !isNumber(stack[stack.size() - 2]))
+        {
+            jitFailed = true;
+            return;
+        }
+        const x86::Vec b = stack.back().num;
+        stack.pop_back();
+        const x86::Vec a = stack.back().num;
+        stack.pop_back();
+        const Slot result = newSlot(false);
+        cc.movapd(result.num, a);
+        emit(result.num, b);
+        stack.push_back(result);
+    };
+
+    // 弹出两个数字操作数比较，结果为布尔值
+    auto relation = [&](const bool less, const bool orEqual)
+    {
+        if (stack.size() < 2 || !isNumber(stack[stack.size() - 1]) || !isNumber(stack[stack.size() - 2]))
+        {
+            jitFailed = true;
+            return;
+        }
+        const x86::Vec b = stack.back().num;
+        stack.pop_back();
+        const x86::Vec a = stack.back().num;
+        stack.pop_back();
+        const Compare kind = orEqual ? Compare::ABOVE_EQUAL : Compare::ABOVE;
+        stack.push_back(less ? compare(b, a, kind) : compare(a, b, kind));
+    };
+
+    while (ip < end && !jitFailed)
+    {
+        if (const auto label = labels.find(ip); label != labels.end())
+        {
+            if (reachable && !mergeInto(ip))
+            {
+                jitFailed = true;
+                break;
+            }
+            if (const auto state = states.find(ip); state != states.end())
+            {
+                cc.bind(label->second);
+                bound.insert(ip);
+                stack = state->second;
+                reachable = true;
+            }
+        }
+
         const uint8_t instruction = chunk->code[ip++];
+        if (!isSupported(instruction))
+        {
+            // 不可达的代码（如末尾隐式的 return nil）可以忽略，但之后无法继续解码
+            jitFailed = reachable;
+            end = ip - 1;
+            break;
+        }
+        if (!reachable)
+        {
+            ip += operandBytes(instruction);
+            continue;
+        }
         debug_log("处理指令: {}", static_cast<int>(instruction));
 
         switch (instruction)
@@ -68,156 +558,370 @@ JitCompiler::JitFn JitCompiler::compileX86(const Chunk* chunk, CodeHolder& code)
                 const uint8_t highByte = chunk->code[ip++];
                 const uint8_t lowByte = chunk->code[ip++];
                 const uint16_t idx = highByte << 8 | lowByte;
-                const double* value = std::get_if<double>(&chunk->constants[idx]);
-                if (!value)
+                const Value value = chunk->constants[idx];
+                if (!value.isNumber())
                 {
                     jitFailed = true;
                     debug_log("JIT 暂不支持非 double 类型的常量");
                     break;
                 }
-                const double constValue = *value;
-                x86::Vec xmm0 = cc.new_xmm();
-                x86::Gp temp = cc.new_gp64();
-                cc.mov(temp, *reinterpret_cast<const uint64_t*>(&constValue));
-                cc.movq(xmm0, temp);
-                cc.sub(x86::rsp, 8);
-                cc.movsd(x86::Mem(x86::rsp, 0), xmm0);
+                // 常量放进函数自带的常量池，直接从内存加载
+                const Slot slot = newSlot(false);
+                cc.movsd(slot.num, cc.new_double_const(ConstPoolScope::kLocal, value.asNumber()));
+                stack.push_back(slot);
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_TRUE):
+        case static_cast<uint8_t>(OpCode::OP_FALSE):
+            {
+                const Slot slot = newSlot(true);
+                cc.mov(slot.flag, instruction == static_cast<uint8_t>(OpCode::OP_TRUE) ? 1 : 0);
+                stack.push_back(slot);
                 break;
             }
         case static_cast<uint8_t>(OpCode::OP_GET_LOCAL):
             {
                 const uint8_t idx = chunk->code[ip++];
-                x86::Vec xmm0 = cc.new_xmm();
-                // 索引 0 是返回值位置，参数从索引 1 开始
-                if (idx > 0)
+                if (idx >= stack.size())
+                {
+                    jitFailed = true;
+                    break;
+                }
+                stack.push_back(stack[idx]);
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_SET_LOCAL):
+            {
+                // 与解释器一致，赋值后值仍留在栈顶
+                const uint8_t idx = chunk->code[ip++];
+                if (idx >= stack.size() || stack.back().isCallee)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                stack[idx] = stack.back();
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_GET_GLOBAL):
+            {
+                const int at = ip - 1;
+                const uint16_t idx = chunk->code[ip] << 8 | chunk->code[ip + 1];
+                ip += 2;
+                const GlobalSlot* global = lookupGlobal(unit, idx);
+                if (global == nullptr)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                // 闭包只能作为被调函数，到 OP_CALL 时再检查是哪个
+                if (isObjType(global->value, ObjType::CLOSURE))
+                {
+                    Slot callee;
+                    callee.isCallee = true;
+                    callee.global = idx;
+                    callee.callee = cc.new_gp64();
+                    const x86::Gp table = cc.new_gp64();
+                    cc.mov(table, x86::ptr(ctx, offsetof(JitContext, globals)));
+                    cc.mov(callee.callee, x86::ptr(table, idx * sizeof(GlobalSlot) + offsetof(GlobalSlot, value)));
+                    stack.push_back(callee);
+                    break;
+                }
+                if (!global->value.isNumber() && !global->value.isBool())
                 {
-                    cc.movsd(xmm0, x86::ptr(args, (idx - 1) * 8));
+                    jitFailed = true;
+                    break;
+                }
+
+                // 按编译时观察到的类型推测，运行时类型不同则去优化
+                const Label guard = deoptAt(at, stack.size(), true);
+                const x86::Gp table = cc.new_gp64();
+                cc.mov(table, x86::ptr(ctx, offsetof(JitContext, globals)));
+                stack.push_back(loadValue(x86::ptr(table, idx * sizeof(GlobalSlot) + offsetof(GlobalSlot, value)),
+                                          global->value.isBool(), guard));
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_SET_GLOBAL):
+            {
+                const uint16_t idx = chunk->code[ip] << 8 | chunk->code[ip + 1];
+                ip += 2;
+                // 未定义和常量的错误由解释器报告
+                const GlobalSlot* global = lookupGlobal(unit, idx);
+                if (global == nullptr || global->isConst || stack.back().isCallee)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                // 与解释器一致，赋值后值仍留在栈顶
+                const Slot& value = stack.back();
+                const x86::Gp table = cc.new_gp64();
+                const x86::Gp bits = cc.new_gp64();
+                cc.mov(table, x86::ptr(ctx, offsetof(JitContext, globals)));
+                if (value.isBool)
+                {
+                    cc.mov(bits, Value(false).raw());
+                    cc.add(bits, value.flag.r64());
                 }
                 else
                 {
-                    x86::Gp temp = cc.new_gp64();
-                    cc.mov(temp, *reinterpret_cast<const uint64_t*>(&ZERO_VALUE));
-                    cc.movq(xmm0, temp);
+                    cc.movq(bits, value.num);
                 }
-                cc.sub(x86::rsp, 8);
-                cc.movsd(x86::Mem(x86::rsp, 0), xmm0);
+                cc.mov(x86::ptr(table, idx * sizeof(GlobalSlot) + offsetof(GlobalSlot, value)), bits);
                 break;
             }
-        case static_cast<uint8_t>(OpCode::OP_SET_LOCAL):
+        case static_cast<uint8_t>(OpCode::OP_CALL):
             {
-                const uint8_t idx = chunk->code[ip++];
-                x86::Vec xmm0 = cc.new_xmm();
-                cc.movsd(xmm0, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                // 索引 0 是返回值位置，参数从索引 1 开始
-                if (idx > 0)
+                const int at = ip - 1;
+                const uint8_t argc = chunk->code[ip++];
+                if (stack.size() < argc + 2u || !stack[stack.size() - 1 - argc].isCallee ||
+                    !std::all_of(stack.end() - argc, stack.end(), isNumber))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                const Slot& calleeSlot = stack[stack.size() - 1 - argc];
+                ObjClosure* callee = resolveCallee(unit, calleeSlot.global, argc);
+                if (callee == nullptr)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                // 守卫失败时由解释器执行这次调用
+                const Label guard = deoptAt(at, stack.size(), true);
+
+                // 读取到的仍是编译时的闭包
+                const x86::Gp expected = cc.new_gp64();
+                cc.mov(expected, Value(callee).raw());
+                cc.cmp(calleeSlot.callee, expected);
+                cc.jne(guard);
+
+                // 被调函数已有机器码；递归调用自身时读到的是本次编译完成后写入的地址
+                const x86::Gp target = cc.new_gp64();
+                cc.mov(target, reinterpret_cast<uint64_t>(&callee->function->jitFunction));
+                cc.mov(target, x86::ptr(target));
+                cc.test(target, target);
+                cc.jz(guard);
+
+                // 参数写入值栈，同时为本帧的去优化记录预留空间；用尽时由解释器执行这次调用
+                const x86::Gp base = cc.new_gp64();
+                const x86::Gp top = cc.new_gp64();
+                cc.mov(base, x86::ptr(ctx, offsetof(JitContext, stackTop)));
+                cc.lea(top, x86::ptr(base, static_cast<int>(stack.size() + 1) * 8));
+                cc.cmp(top, x86::ptr(ctx, offsetof(JitContext, stackEnd)));
+                cc.ja(deoptAt(at, stack.size(), false));
+                for (int i = 0; i < argc; i++)
                 {
-                    cc.movsd(x86::ptr(args, (idx - 1) * 8), xmm0);
+                    cc.movsd(x86::ptr(base, i * 8), stack[stack.size() - argc + i].num);
                 }
+                cc.mov(x86::ptr(ctx, offsetof(JitContext, stackTop)), top);
+
+                InvokeNode* invoke_node;
+                cc.invoke(Out(invoke_node), target, FuncSignature::build<double, const Value*, JitContext*>());
+                invoke_node->set_arg(0, base);
+                invoke_node->set_arg(1, ctx);
+                const Slot result = newSlot(false);
+                invoke_node->set_ret(0, result.num);
+
+                // 被调函数中止：去优化时本帧从调用之后恢复，栈上保留被调函数，由它的帧接着执行
+                cc.mov(x86::ptr(ctx, offsetof(JitContext, stackTop)), base);
+                cc.cmp(x86::byte_ptr(ctx, offsetof(JitContext, bailout)), 0);
+                cc.jne(deoptAt(ip, stack.size() - argc, false));
+
+                stack.resize(stack.size() - argc - 1);
+                stack.push_back(result);
+                unit.refs->push_back(callee);
                 break;
             }
-        case static_cast<uint8_t>(OpCode::OP_ADD):
+        case static_cast<uint8_t>(OpCode::OP_POP):
+            if (stack.size() < 2)
             {
-                debug_log("处理 OP_ADD");
-                x86::Vec xmm0 = cc.new_xmm();
-                x86::Vec xmm1 = cc.new_xmm();
-                // 从栈中弹出两个操作数
-                cc.movsd(xmm0, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                cc.movsd(xmm1, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                // 相加
-                cc.addsd(xmm0, xmm1);
-                // 压回栈
-                cc.sub(x86::rsp, 8);
-                cc.movsd(x86::Mem(x86::rsp, 0), xmm0);
+                jitFailed = true;
                 break;
             }
+            stack.pop_back();
+            break;
+        case static_cast<uint8_t>(OpCode::OP_ADD):
+        case static_cast<uint8_t>(OpCode::OP_ADD_NUM):
+            binary([&](const x86::Vec& a, const x86::Vec& b) { cc.addsd(a, b); });
+            break;
         case static_cast<uint8_t>(OpCode::OP_MUL):
+            binary([&](const x86::Vec& a, const x86::Vec& b) { cc.mulsd(a, b); });
+            break;
+        case static_cast<uint8_t>(OpCode::OP_SUB):
+            binary([&](const x86::Vec& a, const x86::Vec& b) { cc.subsd(a, b); });
+            break;
+        case static_cast<uint8_t>(OpCode::OP_DIV):
+            binary([&](const x86::Vec& a, const x86::Vec& b) { cc.divsd(a, b); });
+            break;
+        case static_cast<uint8_t>(OpCode::OP_MOD):
+            binary([&](const x86::Vec& a, const x86::Vec& b)
+            {
+                const x86::Gp target = cc.new_gp64();
+                cc.mov(target, reinterpret_cast<uint64_t>(&jitMod));
+                InvokeNode* invoke_node;
+                cc.invoke(Out(invoke_node), target, FuncSignature::build<double, double, double>());
+                invoke_node->set_arg(0, a);
+                invoke_node->set_arg(1, b);
+                invoke_node->set_ret(0, a);
+            });
+            break;
+        case static_cast<uint8_t>(OpCode::OP_LESS):
+        case static_cast<uint8_t>(OpCode::OP_LESS_NUM):
+            relation(true, false);
+            break;
+        case static_cast<uint8_t>(OpCode::OP_GREATER):
+        case static_cast<uint8_t>(OpCode::OP_GREATER_NUM):
+            relation(false, false);
+            break;
+        case static_cast<uint8_t>(OpCode::OP_LESS_EQUAL):
+        case static_cast<uint8_t>(OpCode::OP_LESS_EQUAL_NUM):
+            relation(true, true);
+            break;
+        case static_cast<uint8_t>(OpCode::OP_GREATER_EQUAL):
+        case static_cast<uint8_t>(OpCode::OP_GREATER_EQUAL_NUM):
+            relation(false, true);
+            break;
+        case static_cast<uint8_t>(OpCode::OP_EQUAL):
+            {
+                const Slot b = stack.back();
+                stack.pop_back();
+                const Slot a = stack.back();
+                stack.pop_back();
+                if (a.isBool != b.isBool || a.isCallee || b.isCallee)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                if (a.isBool)
+                {
+                    const Slot result = newSlot(true);
+                    cc.xor_(result.flag, result.flag);
+                    cc.cmp(a.flag, b.flag);
+                    cc.sete(result.flag.r8());
+                    stack.push_back(result);
+                }
+                else
+                {
+                    stack.push_back(compare(a.num, b.num, Compare::EQUAL));
+                }
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_NOT):
             {
-                debug_log("处理 OP_MUL");
-                x86::Vec xmm0 = cc.new_xmm();
-                x86::Vec xmm1 = cc.new_xmm();
-                // 从栈中弹出两个操作数
-                cc.movsd(xmm0, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                cc.movsd(xmm1, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                // 相乘
-                cc.mulsd(xmm0, xmm1);
-                // 压回栈
-                cc.sub(x86::rsp, 8);
-                cc.movsd(x86::Mem(x86::rsp, 0), xmm0);
+                const Slot value = stack.back();
+                stack.pop_back();
+                if (value.isCallee)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                if (value.isBool)
+                {
+                    const Slot result = newSlot(true);
+                    cc.mov(result.flag, value.flag);
+                    cc.xor_(result.flag, 1);
+                    stack.push_back(result);
+                }
+                else
+                {
+                    // 数字为 0 时取反为真
+                    const x86::Vec zero = cc.new_xmm();
+                    cc.xorpd(zero, zero);
+                    stack.push_back(compare(value.num, zero, Compare::EQUAL));
+                }
                 break;
             }
-        case static_cast<uint8_t>(OpCode::OP_SUB):
+        case static_cast<uint8_t>(OpCode::OP_NEGATE):
             {
-                debug_log("处理 OP_SUB");
-                x86::Vec xmm0 = cc.new_xmm();
-                x86::Vec xmm1 = cc.new_xmm();
-                // 从栈中弹出两个操作数
-                cc.movsd(xmm0, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                cc.movsd(xmm1, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                // 相减 (a - b)
-                cc.subsd(xmm1, xmm0);
-                // 压回栈
-                cc.sub(x86::rsp, 8);
-                cc.movsd(x86::Mem(x86::rsp, 0), xmm1);
+                const Slot value = stack.back();
+                if (!isNumber(value))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                // 翻转符号位
+                const Slot result = newSlot(false);
+                const x86::Vec sign = cc.new_xmm();
+                const x86::Gp bits = cc.new_gp64();
+                cc.mov(bits, 0x8000000000000000ull);
+                cc.movq(sign, bits);
+                cc.movapd(result.num, value.num);
+                cc.xorpd(result.num, sign);
+                stack.back() = result;
                 break;
             }
-        case static_cast<uint8_t>(OpCode::OP_DIV):
+        case static_cast<uint8_t>(OpCode::OP_JUMP):
             {
-                debug_log("处理 OP_DIV");
-                x86::Vec xmm0 = cc.new_xmm();
-                x86::Vec xmm1 = cc.new_xmm();
-                // 从栈中弹出两个操作数
-                cc.movsd(xmm0, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                cc.movsd(xmm1, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                // 相除 (a / b)
-                cc.divsd(xmm1, xmm0);
-                // 压回栈
-                cc.sub(x86::rsp, 8);
-                cc.movsd(x86::Mem(x86::rsp, 0), xmm1);
+                const int target = ip + 2 + (chunk->code[ip] << 8 | chunk->code[ip + 1]);
+                ip += 2;
+                if (!mergeInto(target))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                cc.jmp(labels[target]);
+                reachable = false;
                 break;
             }
-        case static_cast<uint8_t>(OpCode::OP_MOD):
+        case static_cast<uint8_t>(OpCode::OP_JUMP_IF_FALSE):
+        case static_cast<uint8_t>(OpCode::OP_JUMP_IF_TRUE):
             {
-                debug_log("处理 OP_MOD");
-                x86::Vec xmm0 = cc.new_xmm();
-                x86::Vec xmm1 = cc.new_xmm();
-                x86::Vec xmm2 = cc.new_xmm();
-                // 从栈中弹出两个操作数
-                cc.movsd(xmm0, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                cc.movsd(xmm1, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                // 取余 (a % b)
-                cc.xorpd(xmm2, xmm2); // 清零
-                cc.divsd(xmm1, xmm0); // 除法
-                cc.cvtsd2si(x86::rax, xmm1); // 转换为整数
-                cc.cvtsi2sd(xmm2, x86::rax); // 转换回浮点数
-                cc.mulsd(xmm2, xmm0); // 乘法
-                cc.subsd(xmm1, xmm2); // 减法
-                cc.mulsd(xmm1, xmm0); // 乘法得到余数
-                // 压回栈
-                cc.sub(x86::rsp, 8);
-                cc.movsd(x86::Mem(x86::rsp, 0), xmm1);
+                // 条件值留在栈上，由后续的 OP_POP 弹出
+                const int target = ip + 2 + (chunk->code[ip] << 8 | chunk->code[ip + 1]);
+                ip += 2;
+                const bool jumpIfTrue = instruction == static_cast<uint8_t>(OpCode::OP_JUMP_IF_TRUE);
+                if (stack.back().isCallee)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                const Label fallthrough = cc.new_label();
+                branch(stack.back(), !jumpIfTrue, fallthrough);
+                if (!mergeInto(target))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                cc.jmp(labels[target]);
+                cc.bind(fallthrough);
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_LOOP):
+            {
+                const int target = ip + 2 - (chunk->code[ip] << 8 | chunk->code[ip + 1]);
+                ip += 2;
+                // 循环头必须已经从前面顺序到达过；OSR 代码的外层循环回到解释器执行
+                if (!states.contains(target))
+                {
+                    leaveTo(target);
+                    break;
+                }
+                if (!mergeInto(target))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                cc.jmp(labels[target]);
+                reachable = false;
                 break;
             }
         case static_cast<uint8_t>(OpCode::OP_RETURN):
             {
                 debug_log("处理 OP_RETURN");
-                const x86::Vec result = cc.new_xmm();
-                // 从栈中取出返回值
-                cc.movsd(result, x86::Mem(x86::rsp, 0));
-                cc.add(x86::rsp, 8);
-                // 返回结果
-                cc.ret(result);
-                goto finalize;
+                // OSR 代码由解释器完成返回
+                if (unit.entry != 0)
+                {
+                    leaveTo(ip - 1);
+                    break;
+                }
+                // 只能返回数字
+                if (!isNumber(stack.back()))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                cc.ret(stack.back().num);
+                reachable = false;
+                break;
             }
         default:
             jitFailed = true;
@@ -225,12 +929,83 @@ JitCompiler::JitFn JitCompiler::compileX86(const Chunk* chunk, CodeHolder& code)
             break;
         }
     }
-
-finalize:
-    if (jitFailed)
+
+    // 代码末尾不能继续执行，跳转目标也都必须落在解码过的代码内；OSR 代码离开循环时回到解释器
+    if (reachable)
+    {
+        leaveTo(end);
+    }
+    for (const auto& [target, state] : states)
+    {
+        if (!bound.contains(target) && !jitFailed)
+        {
+            cc.bind(labels[target]);
+            stack = state;
+            leaveTo(target);
+        }
+    }
+
+    if (jitFailed)
+    {
+        debug_log("JIT 编译失败，遇到不支持的操作");
+        return nullptr;
+    }
+
+    // 去优化出口：追加本帧的记录后返回，返回值无意义。值栈的预留保证记录不会越界
+    for (const DeoptSite& site : sites)
+    {
+        cc.bind(site.label);
+        const int count = static_cast<int>(site.stack.size());
+        const x86::Gp record = cc.new_gp64();
+        const x86::Gp next = cc.new_gp64();
+        const x86::Gp value = cc.new_gp64();
+        cc.mov(record, x86::ptr(ctx, offsetof(JitContext, deoptTop)));
+        cc.lea(next, x86::ptr(record, (count + 1) * 8));
+        cc.mov(value, static_cast<uint64_t>(site.ip) << 32 | count);
+        cc.mov(x86::ptr(record), value);
+        for (int i = 1; i < count; i++)
+        {
+            const Slot& slot = site.stack[i];
+            const x86::Mem to = x86::ptr(record, (i + 1) * 8);
+            if (slot.isCallee)
+            {
+                cc.mov(to, slot.callee);
+            }
+            else if (slot.isBool)
+            {
+                cc.mov(value, Value(false).raw());
+                cc.add(value, slot.flag.r64());
+                cc.mov(to, value);
+            }
+            else
+            {
+                cc.movsd(to, slot.num);
+            }
+        }
+        cc.mov(x86::ptr(ctx, offsetof(JitContext, deoptTop)), next);
+
+        if (site.guard)
+        {
+            cc.mov(value, reinterpret_cast<uint64_t>(unit.function));
+            cc.mov(x86::ptr(ctx, offsetof(JitContext, deoptFunction)), value);
+        }
+        cc.mov(x86::byte_ptr(ctx, offsetof(JitContext, bailout)), 1);
+        cc.jmp(unwind);
+    }
+    if (unit.entry != 0)
     {
-        debug_log("JIT 编译失败，遇到不支持的操作");
-        return nullptr;
+        const x86::Gp value = cc.new_gp64();
+        cc.bind(mismatch);
+        cc.mov(value, reinterpret_cast<uint64_t>(unit.function));
+        cc.mov(x86::ptr(ctx, offsetof(JitContext, deoptFunction)), value);
+        cc.mov(x86::byte_ptr(ctx, offsetof(JitContext, bailout)), 1);
+    }
+    if (!sites.empty() || unit.entry != 0)
+    {
+        const x86::Vec zero = cc.new_xmm();
+        cc.bind(unwind);
+        cc.xorpd(zero, zero);
+        cc.ret(zero);
     }
 
     cc.end_func();
@@ -252,17 +1027,19 @@ finalize:
             std::endl;
         return nullptr;
     }
+    perf.record(reinterpret_cast<const void*>(fn), code.code_size(), symbolName(unit));
     debug_log("JIT 编译完成");
     return fn;
 }
 
-JitCompiler::JitFn JitCompiler::compileAArch64(const Chunk* chunk, CodeHolder& code)
+JitCompiler::JitFn JitCompiler::compileAArch64(CompileUnit& unit, CodeHolder& code)
 {
+    const Chunk* chunk = unit.chunk;
     a64::Compiler cc(&code);
 
     // 开始定义函数
     FuncNode* func_node;
-    Error err = cc.add_func_node(Out(func_node), FuncSignature::build<double, uint64_t>());
+    Error err = cc.add_func_node(Out(func_node), FuncSignature::build<double, const Value*, JitContext*>());
     if (err != Error::kOk)
     {
         std::cout << "Failed to create FuncNode: " << DebugUtils::error_as_string(err) << std::endl;
@@ -271,163 +1048,653 @@ JitCompiler::JitFn JitCompiler::compileAArch64(const Chunk* chunk, CodeHolder& c
 
     // 获取参数 - 使用虚拟寄存器
     const a64::Gp args = cc.new_gp64();
+    const a64::Gp ctx = cc.new_gp64();
     func_node->set_arg(0, args);
+    func_node->set_arg(1, ctx);
+
+    // 处理字节码，OSR 从循环头开始
+    int ip = unit.entry;
+    bool jitFailed = false;
 
-    // 分配128字节的固定栈帧
-    cc.sub(a64::regs::sp, a64::regs::sp, 128);
-    cc.stp(a64::regs::x29, a64::regs::x30, a64::ptr(a64::regs::sp, 0));
-    cc.mov(a64::regs::x29, a64::regs::sp);
+    // 常量池：函数结束后以字面量形式嵌入代码，相同的常量只存一份
+    std::unordered_map<uint64_t, Label> constants;
+    auto pooled = [&](const uint64_t bits)
+    {
+        auto [it, inserted] = constants.try_emplace(bits);
+        if (inserted)
+        {
+            it->second = cc.new_label();
+        }
+        return it->second;
+    };
+    auto constant = [&](const Value value)
+    {
+        a64::Vec v = cc.new_vec_d();
+        cc.ldr(v, a64::ptr(pooled(value.raw())));
+        return v;
+    };
+    // 64 位整数（地址等）同样从常量池加载
+    auto immediate = [&](const uint64_t bits)
+    {
+        a64::Gp gp = cc.new_gp64();
+        cc.ldr(gp, a64::ptr(pooled(bits)));
+        return gp;
+    };
 
-    // 使用一个虚拟寄存器作为栈指针偏移（避免直接修改sp导致对齐问题）
-    const a64::Gp stackOffset = cc.new_gp64();
-    // 栈帧开始在sp+16处（因为x29和x30占据了0-15字节）
-    cc.mov(stackOffset, 16);
+    // 操作数栈的一项，与 x86 路径相同
+    struct Slot
+    {
+        bool isBool = false;
+        a64::Vec num;
+        a64::Gp flag;
+        bool isCallee = false;
+        uint16_t global = 0;
+        a64::Gp callee;
+    };
 
-    // 处理字节码
-    int ip = 0;
-    bool jitFailed = false;
+    auto isNumber = [](const Slot& slot) { return !slot.isBool && !slot.isCallee; };
+
+    auto newSlot = [&](const bool isBool)
+    {
+        Slot slot;
+        slot.isBool = isBool;
+        if (isBool) slot.flag = cc.new_gp32();
+        else slot.num = cc.new_vec_d();
+        return slot;
+    };
+    auto copySlot = [&](const Slot& dst, const Slot& src)
+    {
+        if (src.isBool) cc.mov(dst.flag, src.flag);
+        else cc.fmov(dst.num, src.num);
+    };
+    // 从内存加载按类型推测的值，实际类型不同时跳到 fail
+    auto loadValue = [&](const a64::Mem& from, const bool isBool, const Label& fail)
+    {
+        const Slot slot = newSlot(isBool);
+        const a64::Gp bits = cc.new_gp64();
+        const a64::Gp tag = cc.new_gp64();
+        cc.ldr(bits, from);
+        if (!isBool)
+        {
+            const a64::Gp mask = immediate(Value::tagMask());
+            cc.and_(tag, bits, mask);
+            cc.cmp(tag, mask);
+            cc.b_eq(fail);
+            cc.fmov(slot.num, bits);
+        }
+        else
+        {
+            const a64::Gp expected = immediate(Value(true).raw());
+            cc.orr(tag, bits, 1);
+            cc.cmp(tag, expected);
+            cc.b_ne(fail);
+            cc.cmp(bits, expected);
+            cc.cset(slot.flag, a64::CondCode::kEQ);
+        }
+        return slot;
+    };
+
+    // 字节码操作数栈在编译期映射为虚拟寄存器，与 x86 路径相同
+    std::vector<Slot> stack;
+
+    // 槽位 0 是闭包本身，按 0 处理；槽位 1..arity 是参数，OSR 时从解释器帧加载
+    Slot self;
+    self.num = constant(Value(0.0));
+    stack.push_back(self);
+    Label mismatch;
+    if (unit.entry == 0)
+    {
+        for (int i = 0; i < unit.arity; i++)
+        {
+            Slot arg = newSlot(false);
+            cc.ldr(arg.num, a64::ptr(args, i * 8));
+            stack.push_back(arg);
+        }
+    }
+    else
+    {
+        mismatch = cc.new_label();
+        for (int i = 1; i < unit.entryCount; i++)
+        {
+            const Value value = unit.entrySlots[i];
+            if (!value.isNumber() && !value.isBool())
+            {
+                return nullptr;
+            }
+            stack.push_back(loadValue(a64::ptr(args, (i - 1) * 8), value.isBool(), mismatch));
+        }
+    }
+
+    // 每个跳转目标一个标签，以及到达该处时栈的规范寄存器
+    std::unordered_map<int, Label> labels;
+    std::unordered_map<int, std::vector<Slot>> states;
+    for (const int target : unit.targets)
+    {
+        labels.emplace(target, cc.new_label());
+    }
+    // 去优化点和中止路径，与 x86 路径相同
+    struct DeoptSite
+    {
+        Label label;
+        int ip;
+        std::vector<Slot> stack;
+        bool guard;
+    };
+    std::vector<DeoptSite> sites;
+    auto deoptAt = [&](const int at, const size_t depth, const bool guard)
+    {
+        if (depth + 1 > JitContext::MAX_RECORD)
+        {
+            jitFailed = true;
+        }
+        sites.push_back({cc.new_label(), at, {stack.begin(), stack.begin() + depth}, guard});
+        return sites.back().label;
+    };
+    const Label unwind = cc.new_label();
+    bool reachable = true;
+    // 解码的终点：整个函数，或者 OSR 的循环体；遇到不支持的指令时提前结束
+    int end = unit.end;
+    // 已经绑定的跳转目标
+    std::set<int> bound;
+
+    // OSR 代码无法继续的位置：带着当前的栈回到解释器
+    auto leaveTo = [&](const int target)
+    {
+        if (unit.entry == 0)
+        {
+            jitFailed = true;
+            return;
+        }
+        cc.b(deoptAt(target, stack.size(), false));
+        reachable = false;
+    };
+
+    // 把当前栈写入跳转目标的规范寄存器，首次到达时为每个槽位分配新寄存器
+    auto mergeInto = [&](const int target)
+    {
+        auto [it, inserted] = states.try_emplace(target);
+        std::vector<Slot>& state = it->second;
+        // 被调函数不能跨越跳转
+        if (std::ranges::any_of(stack, [](const Slot& slot) { return slot.isCallee; }))
+        {
+            return false;
+        }
+        if (inserted)
+        {
+            for (const Slot& slot : stack)
+            {
+                state.push_back(newSlot(slot.isBool));
+                copySlot(state.back(), slot);
+            }
+            return true;
+        }
+        if (state.size() != stack.size())
+        {
+            return false;
+        }
+        // 先复制到临时寄存器再写回，避免槽位之间互相覆盖
+        std::vector<Slot> temps;
+        for (size_t i = 0; i < stack.size(); i++)
+        {
+            if (stack[i].isBool != state[i].isBool)
+            {
+                return false;
+            }
+            temps.push_back(newSlot(stack[i].isBool));
+            copySlot(temps.back(), stack[i]);
+        }
+        for (size_t i = 0; i < temps.size(); i++)
+        {
+            copySlot(state[i], temps[i]);
+        }
+        return true;
+    };
+
+    // 值的真假与 to 一致时跳转，数字 0 为假，NaN 为真
+    auto branch = [&](const Slot& value, const bool whenTruthy, const Label& to)
+    {
+        if (value.isBool)
+        {
+            if (whenTruthy) cc.cbnz(value.flag, to);
+            else cc.cbz(value.flag, to);
+            return;
+        }
+        cc.fcmp(value.num, constant(Value(0.0)));
+        if (whenTruthy) cc.b_ne(to);
+        else cc.b_eq(to);
+    };
+
+    // 比较两个数字，无序比较（NaN）时 MI/GT/EQ 均不成立
+    auto compare = [&](const a64::Vec& a, const a64::Vec& b, const a64::CondCode cond)
+    {
+        const Slot result = newSlot(true);
+        cc.fcmp(a, b);
+        cc.cset(result.flag, cond);
+        return result;
+    };
+
+    // 弹出两个数字操作数，结果写入新的虚拟寄存器后压回栈
+    auto binary = [&](auto&& emit)
+    {
+        if (stack.size() < 2 || !isNumber(stack[stack.size() - 1]) || !isNumber(stack[stack.size() - 2]))
+        {
+            jitFailed = true;
+            return;
+        }
+        const a64::Vec b = stack.back().num;
+        stack.pop_back();
+        const a64::Vec a = stack.back().num;
+        stack.pop_back();
+        const Slot result = newSlot(false);
+        emit(result.num, a, b);
+        stack.push_back(result);
+    };
+
+    // 弹出两个数字操作数比较，结果为布尔值
+    auto relation = [&](const a64::CondCode cond)
+    {
+        if (stack.size() < 2 || !isNumber(stack[stack.size() - 1]) || !isNumber(stack[stack.size() - 2]))
+        {
+            jitFailed = true;
+            return;
+        }
+        const a64::Vec b = stack.back().num;
+        stack.pop_back();
+        const a64::Vec a = stack.back().num;
+        stack.pop_back();
+        stack.push_back(compare(a, b, cond));
+    };
 
-    while (ip < chunk->code.size() && !jitFailed)
+    while (ip < end && !jitFailed)
     {
-        switch (const uint8_t instruction = chunk->code[ip++])
+        if (const auto label = labels.find(ip); label != labels.end())
+        {
+            if (reachable && !mergeInto(ip))
+            {
+                jitFailed = true;
+                break;
+            }
+            if (const auto state = states.find(ip); state != states.end())
+            {
+                cc.bind(label->second);
+                bound.insert(ip);
+                stack = state->second;
+                reachable = true;
+            }
+        }
+
+        const uint8_t instruction = chunk->code[ip++];
+        if (!isSupported(instruction))
+        {
+            // 不可达的代码（如末尾隐式的 return nil）可以忽略，但之后无法继续解码
+            jitFailed = reachable;
+            end = ip - 1;
+            break;
+        }
+        if (!reachable)
+        {
+            ip += operandBytes(instruction);
+            continue;
+        }
+
+        switch (instruction)
         {
         case static_cast<uint8_t>(OpCode::OP_CONSTANT):
             {
                 const uint8_t highByte = chunk->code[ip++];
                 const uint8_t lowByte = chunk->code[ip++];
                 const uint16_t idx = highByte << 8 | lowByte;
-                const double* value = std::get_if<double>(&chunk->constants[idx]);
-                if (!value)
+                const Value value = chunk->constants[idx];
+                if (!value.isNumber())
                 {
                     jitFailed = true;
                     debug_log("JIT 暂不支持非 double 类型的常量");
                     break;
                 }
-                auto d0 = cc.new_vec_d();
-                cc.fmov(d0, *value);
-                cc.str(d0, a64::ptr(a64::regs::sp, stackOffset));
-                cc.add(stackOffset, stackOffset, 8);
+                Slot slot;
+                slot.num = constant(value);
+                stack.push_back(slot);
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_TRUE):
+        case static_cast<uint8_t>(OpCode::OP_FALSE):
+            {
+                const Slot slot = newSlot(true);
+                cc.mov(slot.flag, instruction == static_cast<uint8_t>(OpCode::OP_TRUE) ? 1 : 0);
+                stack.push_back(slot);
                 break;
             }
         case static_cast<uint8_t>(OpCode::OP_GET_LOCAL):
             {
                 const uint8_t idx = chunk->code[ip++];
-                auto d0 = cc.new_vec_d();
-                // 编译器中第一个参数索引是 1，而 VM 传递的 args 数组索引是 0
-                if (idx > 0)
+                if (idx >= stack.size())
                 {
-                    cc.ldr(d0, a64::ptr(args, (idx - 1) * 8));
-                }
-                else
-                {
-                    cc.fmov(d0, 0.0);
+                    jitFailed = true;
+                    break;
                 }
-                cc.str(d0, a64::ptr(a64::regs::sp, stackOffset));
-                cc.add(stackOffset, stackOffset, 8);
+                stack.push_back(stack[idx]);
                 break;
             }
         case static_cast<uint8_t>(OpCode::OP_SET_LOCAL):
             {
                 debug_log("处理 OP_SET_LOCAL");
                 const uint8_t idx = chunk->code[ip++];
-                auto d0 = cc.new_vec_d();
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d0, a64::ptr(a64::regs::sp, stackOffset));
-                // 编译器中第一个参数索引是 1，而 VM 传递的 args 数组索引是 0
-                if (idx > 0)
+                if (idx >= stack.size() || stack.back().isCallee)
                 {
-                    cc.str(d0, a64::ptr(args, (idx - 1) * 8));
+                    jitFailed = true;
+                    break;
                 }
+                stack[idx] = stack.back();
                 break;
             }
-        case static_cast<uint8_t>(OpCode::OP_ADD):
+        case static_cast<uint8_t>(OpCode::OP_GET_GLOBAL):
             {
-                auto d0 = cc.new_vec_d();
-                auto d1 = cc.new_vec_d();
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d0, a64::ptr(a64::regs::sp, stackOffset)); // 弹出 b
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d1, a64::ptr(a64::regs::sp, stackOffset)); // 弹出 a
-                cc.fadd(d1, d1, d0); // 计算 a + b
-                cc.str(d1, a64::ptr(a64::regs::sp, stackOffset));
-                cc.add(stackOffset, stackOffset, 8);
+                const int at = ip - 1;
+                const uint16_t idx = chunk->code[ip] << 8 | chunk->code[ip + 1];
+                ip += 2;
+                const GlobalSlot* global = lookupGlobal(unit, idx);
+                if (global == nullptr)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                // 闭包只能作为被调函数，到 OP_CALL 时再检查是哪个
+                if (isObjType(global->value, ObjType::CLOSURE))
+                {
+                    Slot callee;
+                    callee.isCallee = true;
+                    callee.global = idx;
+                    callee.callee = cc.new_gp64();
+                    const a64::Gp table = cc.new_gp64();
+                    cc.ldr(table, a64::ptr(ctx, offsetof(JitContext, globals)));
+                    cc.add(table, table, immediate(idx * sizeof(GlobalSlot) + offsetof(GlobalSlot, value)));
+                    cc.ldr(callee.callee, a64::ptr(table));
+                    stack.push_back(callee);
+                    break;
+                }
+                if (!global->value.isNumber() && !global->value.isBool())
+                {
+                    jitFailed = true;
+                    break;
+                }
+
+                // 按编译时观察到的类型推测，运行时类型不同则去优化
+                const Label guard = deoptAt(at, stack.size(), true);
+                const a64::Gp table = cc.new_gp64();
+                cc.ldr(table, a64::ptr(ctx, offsetof(JitContext, globals)));
+                cc.add(table, table, immediate(idx * sizeof(GlobalSlot) + offsetof(GlobalSlot, value)));
+                stack.push_back(loadValue(a64::ptr(table), global->value.isBool(), guard));
                 break;
             }
-        case static_cast<uint8_t>(OpCode::OP_MUL):
+        case static_cast<uint8_t>(OpCode::OP_SET_GLOBAL):
+            {
+                const uint16_t idx = chunk->code[ip] << 8 | chunk->code[ip + 1];
+                ip += 2;
+                // 未定义和常量的错误由解释器报告
+                const GlobalSlot* global = lookupGlobal(unit, idx);
+                if (global == nullptr || global->isConst || stack.back().isCallee)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                // 与解释器一致，赋值后值仍留在栈顶
+                const Slot& value = stack.back();
+                const a64::Gp table = cc.new_gp64();
+                cc.ldr(table, a64::ptr(ctx, offsetof(JitContext, globals)));
+                cc.add(table, table, immediate(idx * sizeof(GlobalSlot) + offsetof(GlobalSlot, value)));
+                if (value.isBool)
+                {
+                    const a64::Gp bits = immediate(Value(false).raw());
+                    cc.add(bits, bits, value.flag.x());
+                    cc.str(bits, a64::ptr(table));
+                }
+                else
+                {
+                    cc.str(value.num, a64::ptr(table));
+                }
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_CALL):
             {
-                debug_log("处理 OP_MUL");
-                auto d0 = cc.new_vec_d();
-                auto d1 = cc.new_vec_d();
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d0, a64::ptr(a64::regs::sp, stackOffset)); // 弹出 b
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d1, a64::ptr(a64::regs::sp, stackOffset)); // 弹出 a
-                cc.fmul(d1, d1, d0); // 计算 a * b
-                cc.str(d1, a64::ptr(a64::regs::sp, stackOffset));
-                cc.add(stackOffset, stackOffset, 8);
+                const int at = ip - 1;
+                const uint8_t argc = chunk->code[ip++];
+                if (stack.size() < argc + 2u || !stack[stack.size() - 1 - argc].isCallee ||
+                    !std::all_of(stack.end() - argc, stack.end(), isNumber))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                const Slot& calleeSlot = stack[stack.size() - 1 - argc];
+                ObjClosure* callee = resolveCallee(unit, calleeSlot.global, argc);
+                if (callee == nullptr)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                // 守卫失败时由解释器执行这次调用
+                const Label guard = deoptAt(at, stack.size(), true);
+
+                // 读取到的仍是编译时的闭包
+                cc.cmp(calleeSlot.callee, immediate(Value(callee).raw()));
+                cc.b_ne(guard);
+
+                // 被调函数已有机器码；递归调用自身时读到的是本次编译完成后写入的地址
+                const a64::Gp target = immediate(reinterpret_cast<uint64_t>(&callee->function->jitFunction));
+                cc.ldr(target, a64::ptr(target));
+                cc.cbz(target, guard);
+
+                // 参数写入值栈，同时为本帧的去优化记录预留空间；用尽时由解释器执行这次调用
+                const a64::Gp base = cc.new_gp64();
+                const a64::Gp top = cc.new_gp64();
+                const a64::Gp limit = cc.new_gp64();
+                cc.ldr(base, a64::ptr(ctx, offsetof(JitContext, stackTop)));
+                cc.add(top, base, static_cast<int>(stack.size() + 1) * 8);
+                cc.ldr(limit, a64::ptr(ctx, offsetof(JitContext, stackEnd)));
+                cc.cmp(top, limit);
+                cc.b_hi(deoptAt(at, stack.size(), false));
+                for (int i = 0; i < argc; i++)
+                {
+                    cc.str(stack[stack.size() - argc + i].num, a64::ptr(base, i * 8));
+                }
+                cc.str(top, a64::ptr(ctx, offsetof(JitContext, stackTop)));
+
+                InvokeNode* invoke_node;
+                cc.invoke(Out(invoke_node), target, FuncSignature::build<double, const Value*, JitContext*>());
+                invoke_node->set_arg(0, base);
+                invoke_node->set_arg(1, ctx);
+                const Slot result = newSlot(false);
+                invoke_node->set_ret(0, result.num);
+
+                // 被调函数中止：去优化时本帧从调用之后恢复
+                const a64::Gp bailout = cc.new_gp32();
+                cc.str(base, a64::ptr(ctx, offsetof(JitContext, stackTop)));
+                cc.ldrb(bailout, a64::ptr(ctx, offsetof(JitContext, bailout)));
+                cc.cbnz(bailout, deoptAt(ip, stack.size() - argc, false));
+
+                stack.resize(stack.size() - argc - 1);
+                stack.push_back(result);
+                unit.refs->push_back(callee);
                 break;
             }
-        case static_cast<uint8_t>(OpCode::OP_SUB):
+        case static_cast<uint8_t>(OpCode::OP_POP):
+            if (stack.size() < 2)
             {
-                debug_log("处理 OP_SUB");
-                auto d0 = cc.new_vec_d();
-                auto d1 = cc.new_vec_d();
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d0, a64::ptr(a64::regs::sp, stackOffset));
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d1, a64::ptr(a64::regs::sp, stackOffset));
-                cc.fsub(d1, d1, d0); // 计算 a - b
-                cc.str(d1, a64::ptr(a64::regs::sp, stackOffset));
-                cc.add(stackOffset, stackOffset, 8);
+                jitFailed = true;
                 break;
             }
+            stack.pop_back();
+            break;
+        case static_cast<uint8_t>(OpCode::OP_ADD):
+        case static_cast<uint8_t>(OpCode::OP_ADD_NUM):
+            binary([&](const a64::Vec& r, const a64::Vec& a, const a64::Vec& b) { cc.fadd(r, a, b); });
+            break;
+        case static_cast<uint8_t>(OpCode::OP_MUL):
+            binary([&](const a64::Vec& r, const a64::Vec& a, const a64::Vec& b) { cc.fmul(r, a, b); });
+            break;
+        case static_cast<uint8_t>(OpCode::OP_SUB):
+            binary([&](const a64::Vec& r, const a64::Vec& a, const a64::Vec& b) { cc.fsub(r, a, b); });
+            break;
         case static_cast<uint8_t>(OpCode::OP_DIV):
+            binary([&](const a64::Vec& r, const a64::Vec& a, const a64::Vec& b) { cc.fdiv(r, a, b); });
+            break;
+        case static_cast<uint8_t>(OpCode::OP_MOD):
+            binary([&](const a64::Vec& r, const a64::Vec& a, const a64::Vec& b)
+            {
+                const a64::Gp target = immediate(reinterpret_cast<uint64_t>(&jitMod));
+                InvokeNode* invoke_node;
+                cc.invoke(Out(invoke_node), target, FuncSignature::build<double, double, double>());
+                invoke_node->set_arg(0, a);
+                invoke_node->set_arg(1, b);
+                invoke_node->set_ret(0, r);
+            });
+            break;
+        case static_cast<uint8_t>(OpCode::OP_LESS):
+        case static_cast<uint8_t>(OpCode::OP_LESS_NUM):
+            relation(a64::CondCode::kMI);
+            break;
+        case static_cast<uint8_t>(OpCode::OP_GREATER):
+        case static_cast<uint8_t>(OpCode::OP_GREATER_NUM):
+            relation(a64::CondCode::kGT);
+            break;
+        // 无序比较（NaN）时 fcmp 置 C 和 V，LS 和 GE 都不成立
+        case static_cast<uint8_t>(OpCode::OP_LESS_EQUAL):
+        case static_cast<uint8_t>(OpCode::OP_LESS_EQUAL_NUM):
+            relation(a64::CondCode::kLS);
+            break;
+        case static_cast<uint8_t>(OpCode::OP_GREATER_EQUAL):
+        case static_cast<uint8_t>(OpCode::OP_GREATER_EQUAL_NUM):
+            relation(a64::CondCode::kGE);
+            break;
+        case static_cast<uint8_t>(OpCode::OP_EQUAL):
             {
-                debug_log("处理 OP_DIV");
-                auto d0 = cc.new_vec_d();
-                auto d1 = cc.new_vec_d();
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d0, a64::ptr(a64::regs::sp, stackOffset));
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d1, a64::ptr(a64::regs::sp, stackOffset));
-                cc.fdiv(d1, d1, d0); // 计算 a / b
-                cc.str(d1, a64::ptr(a64::regs::sp, stackOffset));
-                cc.add(stackOffset, stackOffset, 8);
+                const Slot b = stack.back();
+                stack.pop_back();
+                const Slot a = stack.back();
+                stack.pop_back();
+                if (a.isBool != b.isBool || a.isCallee || b.isCallee)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                if (a.isBool)
+                {
+                    const Slot result = newSlot(true);
+                    cc.cmp(a.flag, b.flag);
+                    cc.cset(result.flag, a64::CondCode::kEQ);
+                    stack.push_back(result);
+                }
+                else
+                {
+                    stack.push_back(compare(a.num, b.num, a64::CondCode::kEQ));
+                }
                 break;
             }
-        case static_cast<uint8_t>(OpCode::OP_MOD):
+        case static_cast<uint8_t>(OpCode::OP_NOT):
+            {
+                const Slot value = stack.back();
+                stack.pop_back();
+                if (value.isCallee)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                if (value.isBool)
+                {
+                    const Slot result = newSlot(true);
+                    cc.eor(result.flag, value.flag, 1);
+                    stack.push_back(result);
+                }
+                else
+                {
+                    // 数字为 0 时取反为真
+                    stack.push_back(compare(value.num, constant(Value(0.0)), a64::CondCode::kEQ));
+                }
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_NEGATE):
+            {
+                if (!isNumber(stack.back()))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                const Slot result = newSlot(false);
+                cc.fneg(result.num, stack.back().num);
+                stack.back() = result;
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_JUMP):
+            {
+                const int target = ip + 2 + (chunk->code[ip] << 8 | chunk->code[ip + 1]);
+                ip += 2;
+                if (!mergeInto(target))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                cc.b(labels[target]);
+                reachable = false;
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_JUMP_IF_FALSE):
+        case static_cast<uint8_t>(OpCode::OP_JUMP_IF_TRUE):
+            {
+                // 条件值留在栈上，由后续的 OP_POP 弹出
+                const int target = ip + 2 + (chunk->code[ip] << 8 | chunk->code[ip + 1]);
+                ip += 2;
+                const bool jumpIfTrue = instruction == static_cast<uint8_t>(OpCode::OP_JUMP_IF_TRUE);
+                if (stack.back().isCallee)
+                {
+                    jitFailed = true;
+                    break;
+                }
+                const Label fallthrough = cc.new_label();
+                branch(stack.back(), !jumpIfTrue, fallthrough);
+                if (!mergeInto(target))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                cc.b(labels[target]);
+                cc.bind(fallthrough);
+                break;
+            }
+        case static_cast<uint8_t>(OpCode::OP_LOOP):
             {
-                debug_log("处理 OP_MOD");
-                auto d0 = cc.new_vec_d();
-                auto d1 = cc.new_vec_d();
-                auto d2 = cc.new_vec_d();
-                auto x0 = cc.new_gp64();
-                // 从栈中弹出两个操作数
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d0, a64::ptr(a64::regs::sp, stackOffset)); // 弹出 b
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(d1, a64::ptr(a64::regs::sp, stackOffset)); // 弹出 a
-                // 取余 (a % b)
-                cc.fdiv(d2, d1, d0); // 除法
-                cc.fcvtzs(x0, d2); // 转换为整数
-                cc.sxtw(x0, x0.w()); // 符号扩展
-                cc.scvtf(d2, x0); // 转换回浮点数
-                cc.fmul(d2, d2, d0); // 乘法
-                cc.fsub(d1, d1, d2); // 减法得到余数
-                cc.str(d1, a64::ptr(a64::regs::sp, stackOffset));
-                cc.add(stackOffset, stackOffset, 8);
+                const int target = ip + 2 - (chunk->code[ip] << 8 | chunk->code[ip + 1]);
+                ip += 2;
+                // 循环头必须已经从前面顺序到达过；OSR 代码的外层循环回到解释器执行
+                if (!states.contains(target))
+                {
+                    leaveTo(target);
+                    break;
+                }
+                if (!mergeInto(target))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                cc.b(labels[target]);
+                reachable = false;
                 break;
             }
         case static_cast<uint8_t>(OpCode::OP_RETURN):
             {
-                auto result = cc.new_vec_d();
-                cc.sub(stackOffset, stackOffset, 8);
-                cc.ldr(result, a64::ptr(a64::regs::sp, stackOffset));
-                cc.ldp(a64::regs::x29, a64::regs::x30, a64::ptr(a64::regs::sp, 0));
-                cc.add(a64::regs::sp, a64::regs::sp, 128);
-                cc.fmov(a64::regs::d0, result);
-                cc.ret();
-                goto finalize;
+                // OSR 代码由解释器完成返回
+                if (unit.entry != 0)
+                {
+                    leaveTo(ip - 1);
+                    break;
+                }
+                // 只能返回数字
+                if (!isNumber(stack.back()))
+                {
+                    jitFailed = true;
+                    break;
+                }
+                cc.ret(stack.back().num);
+                reachable = false;
+                break;
             }
         default:
             jitFailed = true;
@@ -436,14 +1703,90 @@ JitCompiler::JitFn JitCompiler::compileAArch64(const Chunk* chunk, CodeHolder& c
         }
     }
 
-finalize:
+    // 代码末尾不能继续执行，跳转目标也都必须落在解码过的代码内；OSR 代码离开循环时回到解释器
+    if (reachable)
+    {
+        leaveTo(end);
+    }
+    for (const auto& [target, state] : states)
+    {
+        if (!bound.contains(target) && !jitFailed)
+        {
+            cc.bind(labels[target]);
+            stack = state;
+            leaveTo(target);
+        }
+    }
+
     if (jitFailed)
     {
         debug_log("JIT 编译失败，遇到不支持的操作");
         return nullptr;
     }
 
+    // 去优化出口：追加本帧的记录后返回，与 x86 路径相同
+    const a64::Gp flag = cc.new_gp32();
+    for (const DeoptSite& site : sites)
+    {
+        cc.bind(site.label);
+        const int count = static_cast<int>(site.stack.size());
+        const a64::Gp record = cc.new_gp64();
+        const a64::Gp next = cc.new_gp64();
+        cc.ldr(record, a64::ptr(ctx, offsetof(JitContext, deoptTop)));
+        cc.add(next, record, immediate((count + 1) * 8));
+        cc.str(immediate(static_cast<uint64_t>(site.ip) << 32 | count), a64::ptr(record));
+        for (int i = 1; i < count; i++)
+        {
+            const Slot& slot = site.stack[i];
+            const a64::Mem to = a64::ptr(record, (i + 1) * 8);
+            if (slot.isCallee)
+            {
+                cc.str(slot.callee, to);
+            }
+            else if (slot.isBool)
+            {
+                const a64::Gp value = immediate(Value(false).raw());
+                cc.add(value, value, slot.flag.x());
+                cc.str(value, to);
+            }
+            else
+            {
+                cc.str(slot.num, to);
+            }
+        }
+        cc.str(next, a64::ptr(ctx, offsetof(JitContext, deoptTop)));
+
+        if (site.guard)
+        {
+            cc.str(immediate(reinterpret_cast<uint64_t>(unit.function)), a64::ptr(ctx, offsetof(JitContext, deoptFunction)));
+        }
+        cc.mov(flag, 1);
+        cc.strb(flag, a64::ptr(ctx, offsetof(JitContext, bailout)));
+        cc.b(unwind);
+    }
+    if (unit.entry != 0)
+    {
+        cc.bind(mismatch);
+        cc.str(immediate(reinterpret_cast<uint64_t>(unit.function)), a64::ptr(ctx, offsetof(JitContext, deoptFunction)));
+        cc.mov(flag, 1);
+        cc.strb(flag, a64::ptr(ctx, offsetof(JitContext, bailout)));
+    }
+    if (!sites.empty() || unit.entry != 0)
+    {
+        cc.bind(unwind);
+        cc.ret(constant(Value(0.0)));
+    }
+
     cc.end_func();
+
+    // 常量池紧跟在函数代码之后
+    cc.align(AlignMode::kData, 8);
+    for (const auto& [bits, label] : constants)
+    {
+        cc.bind(label);
+        cc.embed_uint64(bits);
+    }
+
     cc.finalize();
 
     if (code.sections().size() == 0 || code.sections()[0] == nullptr || code.sections()[0]->buffer_size() == 0)
@@ -460,5 +1803,6 @@ finalize:
             std::endl;
         return nullptr;
     }
+    perf.record(reinterpret_cast<const void*>(fn), code.code_size(), symbolName(unit));
     return fn;
 }
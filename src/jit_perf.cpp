@@ -0,0 +1,169 @@
+#include "jit_perf.h"
+
+#ifdef __linux__
+#include <cinttypes>
+#include <ctime>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    // jitdump 格式定义见 Linux 源码 tools/perf/Documentation/jitdump-specification.txt
+    constexpr uint32_t JITDUMP_MAGIC = 0x4A695444;
+    constexpr uint32_t JITDUMP_VERSION = 1;
+    constexpr uint32_t JIT_CODE_LOAD = 0;
+    constexpr uint32_t JIT_CODE_CLOSE = 3;
+
+    struct JitDumpHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t totalSize;
+        uint32_t elfMach;
+        uint32_t pad1;
+        uint32_t pid;
+        uint64_t timestamp;
+        uint64_t flags;
+    };
+
+    struct JitRecordHeader
+    {
+        uint32_t id;
+        uint32_t totalSize;
+        uint64_t timestamp;
+    };
+
+    // 后面紧跟以 0 结尾的符号名和机器码
+    struct JitCodeLoad
+    {
+        JitRecordHeader header;
+        uint32_t pid;
+        uint32_t tid;
+        uint64_t vma;
+        uint64_t codeAddr;
+        uint64_t codeSize;
+        uint64_t codeIndex;
+    };
+
+    // 与 perf record -k mono 使用同一时钟
+    uint64_t timestamp()
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    uint32_t elfMachine()
+    {
+#if defined(__x86_64__)
+        return EM_X86_64;
+#elif defined(__aarch64__)
+        return EM_AARCH64;
+#else
+        return EM_NONE;
+#endif
+    }
+}
+
+JitPerf::~JitPerf()
+{
+    std::lock_guard lock(mutex);
+    if (perfMap != nullptr)
+    {
+        std::fclose(perfMap);
+    }
+    if (jitDump != nullptr)
+    {
+        const JitRecordHeader close{JIT_CODE_CLOSE, sizeof(JitRecordHeader), timestamp()};
+        std::fwrite(&close, sizeof(close), 1, jitDump);
+        std::fclose(jitDump);
+        munmap(dumpMarker, markerSize);
+    }
+}
+
+bool JitPerf::enablePerfMap()
+{
+    std::lock_guard lock(mutex);
+    if (perfMap == nullptr)
+    {
+        const std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+        perfMap = std::fopen(path.c_str(), "w");
+    }
+    return perfMap != nullptr;
+}
+
+bool JitPerf::enableJitDump()
+{
+    std::lock_guard lock(mutex);
+    if (jitDump != nullptr)
+    {
+        return true;
+    }
+    const std::string path = "/tmp/jit-" + std::to_string(getpid()) + ".dump";
+    FILE* file = std::fopen(path.c_str(), "w+");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    const auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    void* marker = mmap(nullptr, pageSize, PROT_READ | PROT_EXEC, MAP_PRIVATE, fileno(file), 0);
+    if (marker == MAP_FAILED)
+    {
+        std::fclose(file);
+        return false;
+    }
+    const JitDumpHeader header{JITDUMP_MAGIC, JITDUMP_VERSION, sizeof(JitDumpHeader), elfMachine(), 0,
+                               static_cast<uint32_t>(getpid()), timestamp(), 0};
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fflush(file);
+    jitDump = file;
+    dumpMarker = marker;
+    markerSize = pageSize;
+    return true;
+}
+
+void JitPerf::record(const void* code, const size_t size, const std::string& name)
+{
+    std::lock_guard lock(mutex);
+    if (perfMap != nullptr)
+    {
+        std::fprintf(perfMap, "%" PRIxPTR " %zx %s\n", reinterpret_cast<uintptr_t>(code), size, name.c_str());
+        std::fflush(perfMap);
+    }
+    if (jitDump != nullptr)
+    {
+        const auto address = reinterpret_cast<uint64_t>(code);
+        const JitCodeLoad load{
+            {JIT_CODE_LOAD, static_cast<uint32_t>(sizeof(JitCodeLoad) + name.size() + 1 + size), timestamp()},
+            static_cast<uint32_t>(getpid()), static_cast<uint32_t>(syscall(SYS_gettid)), address, address, size,
+            codeIndex++
+        };
+        std::fwrite(&load, sizeof(load), 1, jitDump);
+        std::fwrite(name.c_str(), 1, name.size() + 1, jitDump);
+        std::fwrite(code, 1, size, jitDump);
+        std::fflush(jitDump);
+    }
+}
+
+#else
+
+// perf 只在 Linux 上可用
+JitPerf::~JitPerf() = default;
+
+bool JitPerf::enablePerfMap()
+{
+    return false;
+}
+
+bool JitPerf::enableJitDump()
+{
+    return false;
+}
+
+void JitPerf::record(const void*, size_t, const std::string&)
+{
+}
+
+#endif
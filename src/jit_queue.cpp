@@ -0,0 +1,72 @@
+#include "jit_queue.h"
+
+void JitQueue::push(std::unique_ptr<JitJob> job)
+{
+    {
+        std::lock_guard lock(mutex);
+        if (!thread.joinable())
+        {
+            stopping = false;
+            thread = std::thread(&JitQueue::workerLoop, this);
+        }
+        pending.push_back(std::move(job));
+    }
+    workCV.notify_one();
+}
+
+std::vector<std::unique_ptr<JitJob>> JitQueue::takeFinished()
+{
+    std::lock_guard lock(mutex);
+    std::vector<std::unique_ptr<JitJob>> jobs;
+    jobs.swap(finished);
+    finishedCount.store(0, std::memory_order_relaxed);
+    return jobs;
+}
+
+void JitQueue::wait()
+{
+    std::unique_lock lock(mutex);
+    doneCV.wait(lock, [this] { return (pending.empty() && current == nullptr) || !thread.joinable(); });
+}
+
+void JitQueue::forEach(const std::function<void(const JitJob&)>& visit)
+{
+    std::lock_guard lock(mutex);
+    for (const auto& job : pending) visit(*job);
+    if (current) visit(*current);
+    for (const auto& job : finished) visit(*job);
+}
+
+void JitQueue::stop()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    workCV.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void JitQueue::workerLoop()
+{
+    while (true)
+    {
+        JitJob* job;
+        {
+            std::unique_lock lock(mutex);
+            workCV.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (stopping) return;
+            current = std::move(pending.front());
+            pending.pop_front();
+            job = current.get();
+        }
+        // 编译只读取任务中的副本，不需要持有锁
+        compiler.compile(*job);
+        {
+            std::lock_guard lock(mutex);
+            finished.push_back(std::move(current));
+            finishedCount.store(finished.size(), std::memory_order_release);
+        }
+        doneCV.notify_all();
+    }
+}
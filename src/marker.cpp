@@ -0,0 +1,231 @@
+#include "marker.h"
+
+bool ConcurrentMarker::shade(Obj* o)
+{
+    std::atomic_ref state(o->scanState);
+    ScanState expected = ScanState::WHITE;
+    if (!state.compare_exchange_strong(expected, ScanState::GRAY, std::memory_order_acq_rel)) return false;
+    // 只有置灰成功的线程写标记位
+    Heap::mark(o);
+    return true;
+}
+
+void ConcurrentMarker::snapshot(Obj* o, std::vector<Obj*>& log)
+{
+    std::atomic_ref state(o->scanState);
+    ScanState current = state.load(std::memory_order_acquire);
+    while (current != ScanState::BLACK)
+    {
+        if (current == ScanState::SCANNING)
+        {
+            // 标记线程正在扫描该对象，等它完成
+            std::this_thread::yield();
+            current = state.load(std::memory_order_acquire);
+            continue;
+        }
+        if (state.compare_exchange_weak(current, ScanState::SCANNING, std::memory_order_acq_rel))
+        {
+            if (current == ScanState::WHITE) Heap::mark(o);
+            forEachReference(o, [&](Obj* child)
+            {
+                if (child && !child->isYoung) log.push_back(child);
+            });
+            state.store(ScanState::BLACK, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+void ConcurrentMarker::scan(Obj* o, std::vector<Obj*>& gray)
+{
+    std::atomic_ref state(o->scanState);
+    ScanState expected = ScanState::GRAY;
+    // 主线程可能已抢先扫描
+    if (!state.compare_exchange_strong(expected, ScanState::SCANNING, std::memory_order_acq_rel)) return;
+    forEachReference(o, [&](Obj* child)
+    {
+        // 新生代对象由新生代回收负责，标记期间晋升的对象已是黑色
+        if (!child || std::atomic_ref(child->isYoung).load(std::memory_order_acquire)) return;
+        if (shade(child)) gray.push_back(child);
+    });
+    state.store(ScanState::BLACK, std::memory_order_release);
+}
+
+void ConcurrentMarker::drain(std::vector<Obj*>& gray)
+{
+    while (!gray.empty())
+    {
+        Obj* o = gray.back();
+        gray.pop_back();
+        scan(o, gray);
+    }
+}
+
+void ConcurrentMarker::start(std::vector<Obj*> roots)
+{
+    queue = std::move(roots);
+    stopRequested = false;
+    busy = false;
+    thread = std::thread(&ConcurrentMarker::run, this);
+}
+
+void ConcurrentMarker::push(std::vector<Obj*>& batch)
+{
+    if (batch.empty()) return;
+    {
+        std::lock_guard lock(mutex);
+        queue.insert(queue.end(), batch.begin(), batch.end());
+    }
+    batch.clear();
+    cv.notify_one();
+}
+
+bool ConcurrentMarker::idle()
+{
+    std::lock_guard lock(mutex);
+    return queue.empty() && !busy;
+}
+
+void ConcurrentMarker::run()
+{
+    std::vector<Obj*> batch;
+    std::vector<Obj*> gray;
+    while (true)
+    {
+        {
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [this] { return stopRequested || !queue.empty(); });
+            // 停止时剩余的工作交给 finish() 在主线程完成
+            if (stopRequested) break;
+            batch.swap(queue);
+            busy = true;
+        }
+        for (Obj* o : batch)
+        {
+            if (shade(o)) gray.push_back(o);
+        }
+        batch.clear();
+        drain(gray);
+        {
+            std::lock_guard lock(mutex);
+            busy = false;
+        }
+    }
+}
+
+void ConcurrentMarker::finish()
+{
+    if (!thread.joinable()) return;
+    {
+        std::lock_guard lock(mutex);
+        stopRequested = true;
+    }
+    cv.notify_one();
+    thread.join();
+
+    std::vector<Obj*> gray;
+    for (Obj* o : queue)
+    {
+        if (shade(o)) gray.push_back(o);
+    }
+    queue.clear();
+    drain(gray);
+}
+
+int64_t ParallelMarker::mark(WorkerPool& pool, std::vector<Obj*>& gray)
+{
+    ParallelMarker marker(pool.size());
+    // 初始的灰色对象轮流分给各个线程
+    std::vector<std::vector<Obj*>> initial(pool.size());
+    for (size_t i = 0; i < gray.size(); i++) initial[i % pool.size()].push_back(gray[i]);
+    gray.clear();
+
+    std::vector<int64_t> deltas(pool.size());
+    pool.run([&](const unsigned index)
+    {
+        int64_t delta = 0;
+        marker.work(index, initial[index], delta);
+        deltas[index] = delta;
+    });
+
+    int64_t total = 0;
+    for (const int64_t d : deltas) total += d;
+    return total;
+}
+
+void ParallelMarker::work(const unsigned index, std::vector<Obj*>& local, int64_t& payloadDelta)
+{
+    const auto workers = static_cast<unsigned>(stacks.size());
+    while (true)
+    {
+        while (!local.empty())
+        {
+            Obj* o = local.back();
+            local.pop_back();
+            const auto bytes = static_cast<uint32_t>(std::min<size_t>(payloadBytes(o), UINT32_MAX));
+            payloadDelta += static_cast<int64_t>(bytes) - o->payload;
+            o->payload = bytes;
+            forEachReference(o, [&](Obj* child)
+            {
+                if (child && Heap::mark(child)) local.push_back(child);
+            });
+            if (local.size() > SHARE_THRESHOLD && stacks[index].size.load(std::memory_order_relaxed) == 0)
+            {
+                share(index, local);
+            }
+        }
+        if (steal(index, local)) continue;
+
+        // 没有工作可做：等待其他线程分出工作，所有线程都空闲时结束
+        idle.fetch_add(1);
+        while (true)
+        {
+            if (idle.load() == workers) return;
+            if (anyShared())
+            {
+                idle.fetch_sub(1);
+                if (steal(index, local)) break;
+                idle.fetch_add(1);
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ParallelMarker::steal(const unsigned index, std::vector<Obj*>& local)
+{
+    const auto workers = static_cast<unsigned>(stacks.size());
+    for (unsigned k = 0; k < workers; k++)
+    {
+        WorkStack& victim = stacks[(index + k) % workers];
+        if (victim.size.load(std::memory_order_relaxed) == 0) continue;
+        std::lock_guard lock(victim.mutex);
+        if (victim.items.empty()) continue;
+        // 自己的共享栈整个取回，其他线程的取走一半
+        const size_t take = k == 0 ? victim.items.size() : (victim.items.size() + 1) / 2;
+        local.insert(local.end(), victim.items.end() - static_cast<std::ptrdiff_t>(take), victim.items.end());
+        victim.items.resize(victim.items.size() - take);
+        victim.size.store(victim.items.size(), std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void ParallelMarker::share(const unsigned index, std::vector<Obj*>& local)
+{
+    WorkStack& own = stacks[index];
+    const size_t half = local.size() / 2;
+    std::lock_guard lock(own.mutex);
+    own.items.insert(own.items.end(), local.begin(), local.begin() + static_cast<std::ptrdiff_t>(half));
+    local.erase(local.begin(), local.begin() + static_cast<std::ptrdiff_t>(half));
+    own.size.store(own.items.size(), std::memory_order_relaxed);
+}
+
+bool ParallelMarker::anyShared() const
+{
+    for (const WorkStack& stack : stacks)
+    {
+        if (stack.size.load(std::memory_order_relaxed) != 0) return true;
+    }
+    return false;
+}
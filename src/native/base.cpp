@@ -20,38 +20,52 @@ Value nativeNow(VM& vm, int argc, const Value* args)
     return static_cast<double>(getNowMillis());
 }
 
+// 输出一个值：绳节点逐段写出，不拼接也不展平
+static void printValue(const Value v)
+{
+    if (isObjType(v, ObjType::ROPE)) forEachStringPiece(v.asObj(), [](const std::string& piece) { std::cout << piece; });
+    else std::cout << valToString(v);
+}
+
 Value nativePrint(VM& vm, const int argc, const Value* args)
 {
-    for (int i = 0; i < argc; i++) std::cout << valToString(args[i]) << (i < argc - 1 ? " " : "");
-    return std::monostate{};
+    for (int i = 0; i < argc; i++)
+    {
+        printValue(args[i]);
+        if (i < argc - 1) std::cout << " ";
+    }
+    return Value::nil();
 }
 
 Value nativePrintln(VM& vm, const int argc, const Value* args)
 {
-    for (int i = 0; i < argc; i++) std::cout << valToString(args[i]) << (i < argc - 1 ? " " : "");
+    for (int i = 0; i < argc; i++)
+    {
+        printValue(args[i]);
+        if (i < argc - 1) std::cout << " ";
+    }
     std::cout << std::endl;
-    return std::monostate{};
+    return Value::nil();
 }
 
 Value nativeSleep(VM& vm, const int argc, const Value* args)
 {
-    if (argc < 1 || !std::holds_alternative<double>(args[0]))
+    if (argc < 1 || !args[0].isNumber())
     {
         throw std::runtime_error("Sleep duration must be a number.");
     }
-    const int durationMs = static_cast<int>(std::get<double>(args[0]));
+    const int durationMs = static_cast<int>(args[0].asNumber());
     std::this_thread::sleep_for(std::chrono::milliseconds(durationMs));
-    return std::monostate{};
+    return Value::nil();
 }
 
 Value nativeGetEnv(VM& vm, const int argc, const Value* args)
 {
-    if (argc < 1 || !std::holds_alternative<Obj*>(args[0]) ||
-        dynamic_cast<ObjString*>(std::get<Obj*>(args[0])) == nullptr)
+    const ObjString* varName = argc < 1 ? nullptr : vm.asString(args[0]);
+    if (!varName)
     {
         throw std::runtime_error("Environment variable name must be a string.");
     }
-    const auto* varName = dynamic_cast<ObjString*>(std::get<Obj*>(args[0]));
     const char* value = std::getenv(varName->chars.c_str());
     if (value == nullptr)
     {
@@ -62,42 +76,41 @@ Value nativeGetEnv(VM& vm, const int argc, const Value* args)
 
 Value nativeSetEnv(VM& vm, const int argc, const Value* args)
 {
-    if (argc < 2 ||
-        !std::holds_alternative<Obj*>(args[0]) ||
-        dynamic_cast<ObjString*>(std::get<Obj*>(args[0])) == nullptr ||
-        !std::holds_alternative<Obj*>(args[1]) ||
-        dynamic_cast<ObjString*>(std::get<Obj*>(args[1])) == nullptr)
+    const ObjString* varName = argc < 2 ? nullptr : vm.asString(args[0]);
+    const ObjString* varValue = argc < 2 ? nullptr : vm.asString(args[1]);
+    if (!varName || !varValue)
     {
         throw std::runtime_error("Environment variable name and value must be strings.");
     }
-    const auto* varName = dynamic_cast<ObjString*>(std::get<Obj*>(args[0]));
-    const auto* varValue = dynamic_cast<ObjString*>(std::get<Obj*>(args[1]));
     if (setenv(varName->chars.c_str(), varValue->chars.c_str(), 1) != 0)
     {
         throw std::runtime_error("Failed to set environment variable.");
     }
-    return std::monostate{};
+    return Value::nil();
 }
 
 Value nativeExit(VM& vm, const int argc, const Value* args)
 {
     int exitCode = 0;
-    if (argc >= 1 && std::holds_alternative<double>(args[0]))
+    if (argc >= 1 && args[0].isNumber())
     {
-        exitCode = static_cast<int>(std::get<double>(args[0]));
+        exitCode = static_cast<int>(args[0].asNumber());
     }
     std::exit(exitCode);
 }
 
 Value nativeSetTimeout(VM& vm, const int argc, const Value* args)
 {
-    if (argc < 2 || !isObjType(args[0], ObjType::CLOSURE) || !std::holds_alternative<double>(args[1]))
+    if (argc < 2 || !isObjType(args[0], ObjType::CLOSURE) || !args[1].isNumber())
     {
         throw std::runtime_error("setTimeout requires a function and a delay in milliseconds.");
     }
 
-    auto* callback = dynamic_cast<ObjClosure*>(std::get<Obj*>(args[0]));
-    const int delayMs = static_cast<int>(std::get<double>(args[1]));
+    auto* callback = objAs<ObjClosure>(args[0]);
+    const int delayMs = static_cast<int>(args[1].asNumber());
+
+    // 回调执行前保持可达
+    vm.timeoutCallbacks.insert(callback);
 
     // 定时器线程添加任务
     std::future<void> future = std::async(std::launch::async, [&vm, callback, delayMs]()
@@ -122,12 +135,12 @@ Value nativeSetTimeout(VM& vm, const int argc, const Value* args)
     std::lock_guard lock(vm.asyncTasksMutex);
     vm.asyncTasks.push_back(std::move(future));
 
-    return std::monostate{};
+    return Value::nil();
 }
 
 Value nativeSetInterval(VM& vm, const int argc, const Value* args)
 {
-    if (argc < 2 || !isObjType(args[0], ObjType::CLOSURE) || !std::holds_alternative<double>(args[1]))
+    if (argc < 2 || !isObjType(args[0], ObjType::CLOSURE) || !args[1].isNumber())
     {
         throw std::runtime_error("setInterval requires a function and an interval in milliseconds.");
     }
@@ -135,8 +148,11 @@ Value nativeSetInterval(VM& vm, const int argc, const Value* args)
     // 生成唯一的定时器 ID
     const std::string intervalId = "interval_" + std::to_string(getNowMicros());
 
-    auto* callback = dynamic_cast<ObjClosure*>(std::get<Obj*>(args[0]));
-    const int intervalMs = static_cast<int>(std::get<double>(args[1]));
+    auto* callback = objAs<ObjClosure>(args[0]);
+    const int intervalMs = static_cast<int>(args[1].asNumber());
+
+    // 回调在定时器清除前保持可达
+    vm.intervalCallbacks[intervalId] = callback;
 
     // 注册 interval ID
     {
@@ -196,17 +212,17 @@ Value nativeSetInterval(VM& vm, const int argc, const Value* args)
 
 Value nativeClearInterval(VM& vm, const int argc, const Value* args)
 {
-    if (argc < 1 || !std::holds_alternative<Obj*>(args[0]) ||
-        dynamic_cast<ObjString*>(std::get<Obj*>(args[0])) == nullptr)
+    const ObjString* intervalId = argc < 1 ? nullptr : vm.asString(args[0]);
+    if (!intervalId)
     {
         throw std::runtime_error("Interval ID must be a string.");
     }
     {
-        const auto* intervalId = dynamic_cast<ObjString*>(std::get<Obj*>(args[0]));
         std::lock_guard lock(vm.intervalIdsMutex);
         vm.intervalIds.erase(intervalId->chars);
+        vm.intervalCallbacks.erase(intervalId->chars);
     }
-    return std::monostate{};
+    return Value::nil();
 }
 
 
@@ -219,23 +235,24 @@ Value nativeTypeof(VM& vm, int argc, const Value* args)
 
     const Value& val = args[0];
 
-    if (std::holds_alternative<std::monostate>(val))
+    if (val.isNil())
     {
         return vm.newString("object");
     }
-    if (std::holds_alternative<bool>(val))
+    if (val.isBool())
     {
         return vm.newString("boolean");
     }
-    if (std::holds_alternative<double>(val))
+    if (val.isNumber())
     {
         return vm.newString("number");
     }
-    if (std::holds_alternative<Obj*>(val))
+    if (val.isObj())
     {
-        switch (const auto obj = std::get<Obj*>(val); obj->type)
+        switch (const auto obj = val.asObj(); obj->type)
         {
         case ObjType::STRING:
+        case ObjType::ROPE:
             return vm.newString("string");
         case ObjType::FUNCTION:
         case ObjType::CLOSURE:
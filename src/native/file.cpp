@@ -6,12 +6,12 @@ void registerNativeFile(VM& vm)
     auto methods = std::map<std::string, NativeFn>{};
     methods["constructor"] = [](const int argc, const Value* args) -> Value
     {
-        if (argc < 1) return std::monostate{};
+        if (argc < 1) return Value::nil();
 
         const std::string path = valToString(args[0]);
         const std::string modeStr = (argc > 1) ? valToString(args[1]) : "r";
 
-        auto* instance = dynamic_cast<ObjNativeInstance*>(std::get<Obj*>(args[-1]));
+        auto* instance = objAs<ObjNativeInstance>(args[-1]);
 
         auto* handle = new FileHandle();
         handle->path = path;
@@ -32,22 +32,22 @@ void registerNativeFile(VM& vm)
             if (h->stream.is_open()) h->stream.close();
             delete h;
         };
-        return std::monostate{};
+        return Value::nil();
     };
     methods["write"] = [](const int argc, const Value* args) -> Value
     {
-        if (auto* handle = static_cast<FileHandle*>(dynamic_cast<ObjNativeInstance*>(std::get<Obj*>(args[-1]))->data);
+        if (auto* handle = static_cast<FileHandle*>(objAs<ObjNativeInstance>(args[-1])->data);
             handle && handle->stream.is_open() && argc > 0)
         {
             handle->stream << valToString(args[0]);
         }
-        return std::monostate{};
+        return Value::nil();
     };
     methods["read"] = [&vm](int argc, const Value* args) -> Value
     {
-        const auto* handle = static_cast<FileHandle*>(dynamic_cast<ObjNativeInstance*>(std::get<Obj*>(args[-1]))->data);
+        const auto* handle = static_cast<FileHandle*>(objAs<ObjNativeInstance>(args[-1])->data);
 
-        if (!handle || !handle->stream.is_open()) return std::monostate{};
+        if (!handle || !handle->stream.is_open()) return Value::nil();
 
         std::stringstream buffer;
         buffer << handle->stream.rdbuf();
@@ -55,14 +55,14 @@ void registerNativeFile(VM& vm)
     };
     methods["close"] = [](const int argc, const Value* args) -> Value
     {
-        if (auto* handle = static_cast<FileHandle*>(dynamic_cast<ObjNativeInstance*>(std::get<Obj*>(args[-1]))->data);
+        if (auto* handle = static_cast<FileHandle*>(objAs<ObjNativeInstance>(args[-1])->data);
             handle && handle->stream.is_open())
             handle->stream.close();
-        return std::monostate{};
+        return Value::nil();
     };
     methods["isOpen"] = [](const int argc, const Value* args) -> Value
     {
-        if (const auto* handle = static_cast<FileHandle*>(dynamic_cast<ObjNativeInstance*>(std::get<Obj*>(args[-1]))->
+        if (const auto* handle = static_cast<FileHandle*>(objAs<ObjNativeInstance>(args[-1])->
                 data);
             handle)
         {
@@ -73,7 +73,7 @@ void registerNativeFile(VM& vm)
 
     methods["size"] = [](const int argc, const Value* args) -> Value
     {
-        auto* handle = static_cast<FileHandle*>(dynamic_cast<ObjNativeInstance*>(std::get<Obj*>(args[-1]))->data);
+        auto* handle = static_cast<FileHandle*>(objAs<ObjNativeInstance>(args[-1])->data);
 
         if (!handle) return -1.0;
 
@@ -95,7 +95,7 @@ void registerNativeFile(VM& vm)
 
     methods["remove"] = [](const int argc, const Value* args) -> Value
     {
-        auto* handle = static_cast<FileHandle*>(dynamic_cast<ObjNativeInstance*>(std::get<Obj*>(args[-1]))->data);
+        auto* handle = static_cast<FileHandle*>(objAs<ObjNativeInstance>(args[-1])->data);
 
         if (!handle) return false;
 
@@ -108,7 +108,7 @@ void registerNativeFile(VM& vm)
 
     methods["exists"] = [](const int argc, const Value* args) -> Value
     {
-        const auto* handle = static_cast<FileHandle*>(dynamic_cast<ObjNativeInstance*>(std::get<Obj*>(args[-1]))->data);
+        const auto* handle = static_cast<FileHandle*>(objAs<ObjNativeInstance>(args[-1])->data);
 
         if (!handle) return false;
 
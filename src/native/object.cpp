@@ -12,12 +12,12 @@ Value objectKeys(VM& vm, int argc, Value* args)
     const Value& objVal = args[0];
 
     // 检查是否是实例（对象字面量或类的实例）
-    if (!std::holds_alternative<Obj*>(objVal))
+    if (!objVal.isObj())
     {
         throw std::runtime_error("Object.keys() argument must be an object.");
     }
 
-    Obj* obj = std::get<Obj*>(objVal);
+    Obj* obj = objVal.asObj();
 
     // 检查是否是实例类型
     if (obj->type != ObjType::INSTANCE)
@@ -25,16 +25,16 @@ Value objectKeys(VM& vm, int argc, Value* args)
         throw std::runtime_error("Object.keys() argument must be an object instance.");
     }
 
-    auto* instance = dynamic_cast<ObjInstance*>(obj);
+    auto* instance = objAs<ObjInstance>(obj);
 
     // 创建包含所有键的列表
+    // 属性名已驻留，按添加顺序直接取自形状
     auto* keysList = vm.allocate<ObjList>();
-    keysList->elements.reserve(instance->fields.size());
-
-    for (auto it = instance->fields.begin(); it != instance->fields.end(); ++it)
+    for (ObjString* key : instance->shape->keys())
     {
-        keysList->elements.push_back(vm.newString(it->first));
+        keysList->push(key);
     }
+    vm.accountPayload(keysList);
 
     return keysList;
 }
@@ -50,28 +50,26 @@ Value objectValues(VM& vm, int argc, Value* args)
     const Value& objVal = args[0];
 
     // 检查是否是实例
-    if (!std::holds_alternative<Obj*>(objVal))
+    if (!objVal.isObj())
     {
         throw std::runtime_error("Object.values() argument must be an object.");
     }
 
-    Obj* obj = std::get<Obj*>(objVal);
+    Obj* obj = objVal.asObj();
 
     if (obj->type != ObjType::INSTANCE)
     {
         throw std::runtime_error("Object.values() argument must be an object instance.");
     }
 
-    auto* instance = dynamic_cast<ObjInstance*>(obj);
+    auto* instance = objAs<ObjInstance>(obj);
 
     // 创建包含所有值的列表
+    // 字段值按槽位顺序存放，与 Object.keys 顺序一致
     auto* valuesList = vm.allocate<ObjList>();
-    valuesList->elements.reserve(instance->fields.size());
-
-    for (auto it = instance->fields.begin(); it != instance->fields.end(); ++it)
-    {
-        valuesList->elements.push_back(it->second);
-    }
+    valuesList->elements = instance->fields;
+    for (const Value v : valuesList->elements) valuesList->noteElement(v);
+    vm.accountPayload(valuesList);
 
     return valuesList;
 }
@@ -87,33 +85,37 @@ Value objectEntries(VM& vm, int argc, Value* args)
     const Value& objVal = args[0];
 
     // 检查是否是实例
-    if (!std::holds_alternative<Obj*>(objVal))
+    if (!objVal.isObj())
     {
         throw std::runtime_error("Object.entries() argument must be an object.");
     }
 
-    Obj* obj = std::get<Obj*>(objVal);
+    Obj* obj = objVal.asObj();
 
     if (obj->type != ObjType::INSTANCE)
     {
         throw std::runtime_error("Object.entries() argument must be an object instance.");
     }
 
-    auto* instance = dynamic_cast<ObjInstance*>(obj);
+    auto* instance = objAs<ObjInstance>(obj);
 
     // 创建包含所有 [key, value] 对的列表
     auto* entriesList = vm.allocate<ObjList>();
-    entriesList->elements.reserve(instance->fields.size());
+    // 分配 entry 数组期间保护结果列表不被回收
+    vm.tempRoots.push_back(entriesList);
 
-    for (auto it = instance->fields.begin(); it != instance->fields.end(); ++it)
+    const auto keys = instance->shape->keys();
+    entriesList->elements.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
     {
         // 为每个 entry 创建一个 [key, value] 数组
         auto* entryArray = vm.allocate<ObjList>();
-        entryArray->elements.push_back(vm.newString(it->first));
-        entryArray->elements.push_back(it->second);
-        entriesList->elements.push_back(entryArray);
+        entryArray->push(keys[i]);
+        entryArray->push(instance->fields[i]);
+        entriesList->push(entryArray);
     }
 
+    vm.popTempRoot();
     return entriesList;
 }
 
@@ -4,14 +4,14 @@
 
 Value nativeRequire(VM& vm, const int argc, const Value* args)
 {
-    if (argc != 1 || !std::holds_alternative<Obj*>(args[0]) ||
-        std::get<Obj*>(args[0])->type != ObjType::STRING)
+    const ObjString* pathString = argc != 1 ? nullptr : vm.asString(args[0]);
+    if (!pathString)
     {
         std::cerr << "require expects a file path string.\n";
-        return std::monostate{};
+        return Value::nil();
     }
 
-    const std::string path = dynamic_cast<ObjString*>(std::get<Obj*>(args[0]))->chars;
+    const std::string path = pathString->chars;
 
     // 是否已加载模块
     if (vm.modules.contains(path))
@@ -24,30 +24,32 @@ Value nativeRequire(VM& vm, const int argc, const Value* args)
     if (source.empty())
     {
         std::cerr << "Could not open file: " << path << " (tried '" << path << "' and 'scripts/" << path << "')\n";
-        return std::monostate{};
+        return Value::nil();
     }
 
     if (!vm.compilerHook)
     {
         std::cerr << "Compiler hook not set.\n";
-        return std::monostate{};
+        return Value::nil();
     }
 
     // 保存旧的 exports 对象
-    Value oldExports = std::monostate{};
-    const bool hadExports = vm.globals.contains("exports");
-    if (hadExports)
-    {
-        oldExports = vm.globals["exports"];
-    }
+    Value oldExports = Value::nil();
+    const bool hadExports = vm.getGlobal(vm.exportsString, oldExports);
+
+    // 模块执行期间旧的 exports 不在任何全局槽位中，需要临时作为根
+    const bool rootOldExports = hadExports && oldExports.isObj();
+    if (rootOldExports) vm.tempRoots.push_back(oldExports.asObj());
 
     // 创建一个空的 exports 类和实例
     auto* exportsClass = vm.allocate<ObjClass>("exports");
+    vm.tempRoots.push_back(exportsClass);
     auto* exportsObj = vm.allocate<ObjInstance>(exportsClass);
+    vm.popTempRoot();
     vm.tempRoots.push_back(exportsObj);
 
     // 将 exports 注入到全局变量中
-    vm.globals["exports"] = exportsObj;
+    vm.defineGlobal(vm.exportsString, exportsObj);
 
     // 编译模块
     ObjFunction* moduleScript = vm.compilerHook(source, path);
@@ -56,31 +58,35 @@ Value nativeRequire(VM& vm, const int argc, const Value* args)
         // 恢复旧的 exports 对象
         if (hadExports)
         {
-            vm.globals["exports"] = oldExports;
+            vm.defineGlobal(vm.exportsString, oldExports);
         }
         else
         {
-            vm.globals.erase("exports");
+            vm.removeGlobal(vm.exportsString);
         }
-        vm.tempRoots.pop_back();
-        return std::monostate{};
+        vm.popTempRoot();
+        if (rootOldExports) vm.popTempRoot();
+        return Value::nil();
     }
 
     // 创建模块闭包并使用 callAndRun
+    vm.tempRoots.push_back(moduleScript);
     auto* moduleClosure = vm.allocate<ObjClosure>(moduleScript);
+    vm.popTempRoot();
     vm.callAndRun(moduleClosure);
 
     // 恢复旧的 exports 对象
     if (hadExports)
     {
-        vm.globals["exports"] = oldExports;
+        vm.defineGlobal(vm.exportsString, oldExports);
     }
     else
     {
-        vm.globals.erase("exports");
+        vm.removeGlobal(vm.exportsString);
     }
 
-    vm.tempRoots.pop_back();
+    vm.popTempRoot();
+    if (rootOldExports) vm.popTempRoot();
 
     // 返回 exports 对象
     vm.modules[path] = exportsObj;
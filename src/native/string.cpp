@@ -1,47 +1,65 @@
 #include "native/string.h"
+#include <algorithm>
 
 Value nativeStringLength(VM& vm, int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    const auto* str = dynamic_cast<ObjString*>(std::get<Obj*>(receiver));
+    const auto* str = objAs<ObjString>(receiver);
     return static_cast<double>(str->chars.size());
 }
 
 Value nativeListLength(VM& vm, int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    const auto* list = dynamic_cast<ObjList*>(std::get<Obj*>(receiver));
+    const auto* list = objAs<ObjList>(receiver);
     return static_cast<double>(list->elements.size());
 }
 
 Value nativeListClear(VM& vm, int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    auto* list = dynamic_cast<ObjList*>(std::get<Obj*>(receiver));
+    auto* list = objAs<ObjList>(receiver);
+    if (!list->isPackedDouble()) vm.prepareWrite(list);
     list->elements.clear();
-    return std::monostate{};
+    // 空数组重新视为只含数字
+    list->kind = ElementKind::DOUBLE;
+    return Value::nil();
 }
 
 Value nativeListPush(VM& vm, const int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    auto* list = dynamic_cast<ObjList*>(std::get<Obj*>(receiver));
-    for (int i = 0; i < argc; i++)
+    auto* list = objAs<ObjList>(receiver);
+    if (list->isPackedDouble() && std::all_of(args, args + argc, [](const Value v) { return v.isNumber(); }))
     {
-        list->elements.push_back(args[i]);
+        // 只含数字的数组追加数字：没有引用需要记录
+        list->elements.insert(list->elements.end(), args, args + argc);
     }
-    return std::monostate{};
+    else
+    {
+        vm.prepareWrite(list);
+        for (int i = 0; i < argc; i++)
+        {
+            list->push(args[i]);
+            vm.writeBarrier(list, args[i]);
+        }
+    }
+    vm.accountPayload(list);
+    // 接收者和参数都在栈上，可以安全地回收
+    if (vm.maxHeap) vm.checkHeapLimit();
+    return Value::nil();
 }
 
 Value nativeListPop(VM& vm, int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    auto* list = dynamic_cast<ObjList*>(std::get<Obj*>(receiver));
+    auto* list = objAs<ObjList>(receiver);
     if (list->elements.empty())
     {
         throw std::runtime_error("Cannot pop from an empty list.");
     }
     Value val = list->elements.back();
+    if (!list->isPackedDouble()) vm.prepareWrite(list);
     list->elements.pop_back();
     return val;
 }
@@ -49,35 +67,43 @@ Value nativeListPop(VM& vm, int argc, const Value* args)
 Value nativeListJoin(VM& vm, const int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    const auto* list = dynamic_cast<ObjList*>(std::get<Obj*>(receiver));
+    const auto* list = objAs<ObjList>(receiver);
 
     std::string sep = ",";
-    if (argc > 0 && std::holds_alternative<Obj*>(args[0]))
+    if (argc > 0 && isStringLike(args[0]))
     {
-        if (const auto o = std::get<Obj*>(args[0]); o->type == ObjType::STRING)
-        {
-            sep = dynamic_cast<ObjString*>(o)->chars;
-        }
+        sep = valToString(args[0]);
     }
 
+    // 字符串和绳节点的内容直接追加，不展平
     std::string res;
+    if (list->isPackedDouble())
+    {
+        for (size_t i = 0; i < list->elements.size(); i++)
+        {
+            res += numberToString(list->elements[i].asNumber());
+            if (i < list->elements.size() - 1) res += sep;
+        }
+        return vm.newString(std::move(res));
+    }
     for (size_t i = 0; i < list->elements.size(); i++)
     {
-        res += valToString(list->elements[i]);
+        if (const Value v = list->elements[i]; isStringLike(v)) appendString(res, v.asObj());
+        else res += valToString(v);
         if (i < list->elements.size() - 1) res += sep;
     }
-    return Value{new ObjString(res)};
+    return vm.newString(std::move(res));
 }
 
 Value nativeListAt(VM& vm, int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    const auto* list = dynamic_cast<ObjList*>(std::get<Obj*>(receiver));
-    if (argc < 1 || !std::holds_alternative<double>(args[0]))
+    const auto* list = objAs<ObjList>(receiver);
+    if (argc < 1 || !args[0].isNumber())
     {
         throw std::runtime_error("Index must be a number.");
     }
-    const int index = static_cast<int>(std::get<double>(args[0]));
+    const int index = static_cast<int>(args[0].asNumber());
     if (index < 0 || index >= list->elements.size())
     {
         throw std::runtime_error("List index out of bounds.");
@@ -88,29 +114,28 @@ Value nativeListAt(VM& vm, int argc, const Value* args)
 Value nativeStringAt(VM& vm, const int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    const auto* str = dynamic_cast<ObjString*>(std::get<Obj*>(receiver));
-    if (argc < 1 || !std::holds_alternative<double>(args[0]))
+    const auto* str = objAs<ObjString>(receiver);
+    if (argc < 1 || !args[0].isNumber())
     {
         throw std::runtime_error("Index must be a number.");
     }
-    const int index = static_cast<int>(std::get<double>(args[0]));
+    const int index = static_cast<int>(args[0].asNumber());
     if (index < 0 || index >= str->chars.size())
     {
         throw std::runtime_error("String index out of bounds.");
     }
-    return Value{new ObjString(std::string(1, str->chars[index]))};
+    return vm.newString(std::string(1, str->chars[index]));
 }
 
 Value nativeStringIndexOf(VM& vm, int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    const auto* str = dynamic_cast<ObjString*>(std::get<Obj*>(receiver));
-    if (argc < 1 || !std::holds_alternative<Obj*>(args[0]) ||
-        dynamic_cast<ObjString*>(std::get<Obj*>(args[0])) == nullptr)
+    const auto* str = objAs<ObjString>(receiver);
+    const ObjString* substr = argc < 1 ? nullptr : vm.asString(args[0]);
+    if (!substr)
     {
         throw std::runtime_error("Argument must be a string.");
     }
-    const auto* substr = dynamic_cast<ObjString*>(std::get<Obj*>(args[0]));
     const size_t pos = str->chars.find(substr->chars);
     if (pos == std::string::npos)
     {
@@ -122,24 +147,24 @@ Value nativeStringIndexOf(VM& vm, int argc, const Value* args)
 Value nativeStringSubstring(VM& vm, int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    const auto* str = dynamic_cast<ObjString*>(std::get<Obj*>(receiver));
-    if (argc < 2 || !std::holds_alternative<double>(args[0]) || !std::holds_alternative<double>(args[1]))
+    const auto* str = objAs<ObjString>(receiver);
+    if (argc < 2 || !args[0].isNumber() || !args[1].isNumber())
     {
         throw std::runtime_error("Arguments must be numbers.");
     }
-    const int start = static_cast<int>(std::get<double>(args[0]));
-    const int end = static_cast<int>(std::get<double>(args[1]));
+    const int start = static_cast<int>(args[0].asNumber());
+    const int end = static_cast<int>(args[1].asNumber());
     if (start < 0 || end > str->chars.size() || start > end)
     {
         throw std::runtime_error("Invalid substring indices.");
     }
-    return Value{new ObjString(str->chars.substr(start, end - start))};
+    return vm.newString(str->chars.substr(start, end - start));
 }
 
 Value nativeStringToUpper(VM& vm, int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    const auto* str = dynamic_cast<ObjString*>(std::get<Obj*>(receiver));
+    const auto* str = objAs<ObjString>(receiver);
     std::string upperStr = str->chars;
     std::transform(
         upperStr.begin(),
@@ -150,13 +175,13 @@ Value nativeStringToUpper(VM& vm, int argc, const Value* args)
             return std::toupper(c);
         }
     );
-    return Value{new ObjString(upperStr)};
+    return vm.newString(upperStr);
 }
 
 Value nativeStringToLower(VM& vm, int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    const auto* str = dynamic_cast<ObjString*>(std::get<Obj*>(receiver));
+    const auto* str = objAs<ObjString>(receiver);
     std::string lowerStr = str->chars;
     std::transform(
         lowerStr.begin(),
@@ -167,13 +192,13 @@ Value nativeStringToLower(VM& vm, int argc, const Value* args)
             return std::tolower(c);
         }
     );
-    return Value{new ObjString(lowerStr)};
+    return vm.newString(lowerStr);
 }
 
 Value nativeStringTrim(VM& vm, int argc, const Value* args)
 {
     const Value receiver = args[-1];
-    const auto* str = dynamic_cast<ObjString*>(std::get<Obj*>(receiver));
+    const auto* str = objAs<ObjString>(receiver);
     const std::string& s = str->chars;
 
     const size_t start = s.find_first_not_of(" \t\n\r");
@@ -8,16 +8,25 @@
 #include "native/file.h"
 #include "native/string.h"
 #include "native/sys_object.h"
+#include <algorithm>
 #include <iostream>
 
+// 线索化分派：编译器支持标签地址（GCC/Clang）时，每条指令末尾各自间接跳转到下一条指令，
+// 否则回退到可移植的 switch 分派
+#if defined(TINY_JS_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define TINY_JS_THREADED_DISPATCH 1
+#else
+#define TINY_JS_THREADED_DISPATCH 0
+#endif
+
 bool toBool(const Value value)
 {
-    if (std::holds_alternative<std::monostate>(value))
+    if (value.isNil())
         return false;
-    if (std::holds_alternative<bool>(value))
-        return std::get<bool>(value);
-    if (std::holds_alternative<double>(value))
-        return std::get<double>(value) != 0;
+    if (value.isBool())
+        return value.asBool();
+    if (value.isNumber())
+        return value.asNumber() != 0;
     return true;
 }
 
@@ -45,145 +54,597 @@ void VM::initModule()
 
 void VM::bindNativeMethod(const ObjType type, const std::string& name, const NativeFn& fn)
 {
+    ObjString* key = newString(name);
+    tempRoots.push_back(key);
     if (type == ObjType::STRING)
     {
-        stringMethods[name] = allocate<ObjNative>(fn, name);
+        stringMethods[key] = allocate<ObjNative>(fn, name);
     }
     else if (type == ObjType::LIST)
     {
-        listMethods[name] = allocate<ObjNative>(fn, name);
+        listMethods[key] = allocate<ObjNative>(fn, name);
     }
+    popTempRoot();
 }
 
 void VM::defineNativeClass(const std::string& className, std::map<std::string, NativeFn> methods)
 {
     auto* klass = allocate<ObjClass>(className);
     klass->isNative = true; // 标记为原生
+    tempRoots.push_back(klass);
 
     // 注册方法
     for (auto& [name, fn] : methods)
     {
-        klass->nativeMethods[name] = allocate<ObjNative>(fn, name);
+        ObjString* key = newString(name);
+        tempRoots.push_back(key);
+        prepareWrite(klass);
+        klass->nativeMethods[key] = allocate<ObjNative>(fn, name);
+        popTempRoot();
     }
 
     // 注册全局变量
-    stack.emplace_back(klass);
-    globals[className] = klass;
-    stack.pop_back();
+    defineGlobal(newString(className), klass);
+    popTempRoot();
 }
 
-ObjString* VM::newString(const std::string& s)
+uint16_t VM::globalSlot(ObjString* name)
 {
-    return allocate<ObjString>(s);
+    if (const auto it = globalSlots.find(name); it != globalSlots.end())
+    {
+        return it->second;
+    }
+    if (globals.size() > UINT16_MAX)
+    {
+        throw std::runtime_error("Too many global variables.");
+    }
+    const auto slot = static_cast<uint16_t>(globals.size());
+    globals.push_back({Value::nil(), name});
+    globalSlots.emplace(name, slot);
+    return slot;
 }
 
-void VM::freeObjects()
+void VM::defineGlobal(ObjString* name, const Value value)
 {
-    const Obj* obj = objects;
-    while (obj)
+    GlobalSlot& g = globals[globalSlot(name)];
+    g.value = value;
+    g.defined = true;
+}
+
+bool VM::getGlobal(ObjString* name, Value& out) const
+{
+    const auto it = globalSlots.find(name);
+    if (it == globalSlots.end() || !globals[it->second].defined) return false;
+    out = globals[it->second].value;
+    return true;
+}
+
+void VM::removeGlobal(ObjString* name)
+{
+    if (const auto it = globalSlots.find(name); it != globalSlots.end())
     {
-        const Obj* next = obj->next;
-        delete obj;
-        obj = next;
+        globals[it->second].value = Value::nil();
+        globals[it->second].defined = false;
+    }
+}
+
+void VM::setField(ObjInstance* instance, ObjString* name, const Value value)
+{
+    // 新属性可能在类的转换树上增加分支
+    prepareWrite(instance);
+    prepareWrite(instance->klass);
+    instance->setField(name, value);
+    accountPayload(instance);
+    writeBarrier(instance, value);
+    writeBarrier(instance, name);
+    writeBarrier(instance->klass, name);
+}
+
+void VM::addCacheEntry(PropertyCache& cache, const PropertyCacheEntry& entry)
+{
+    // 缓存属于当前执行的函数，缓存项引用的类和方法需经过写屏障
+    ObjFunction* owner = frames.back().closure->function;
+    prepareWrite(owner);
+    cache.add(entry);
+    writeBarrier(owner, entry.holder);
+    writeBarrier(owner, entry.method);
+}
+
+ObjString* VM::newString(std::string s)
+{
+    const uint32_t hash = hashString(s);
+    if (const auto it = strings.find(StringKey{s, hash}); it != strings.end())
+    {
+        // 驻留表是弱引用：并发标记期间取出的老年代字符串可能不在快照中，交给标记线程
+        if (gcPhase == GCPhase::CONCURRENT_MARK && !(*it)->isYoung) satbLog.push_back(*it);
+        return *it;
+    }
+    auto* str = allocate<ObjString>(std::move(s), hash);
+    strings.insert(str);
+    return str;
+}
+
+ObjString* VM::flatten(ObjRope* rope)
+{
+    if (rope->flat) return rope->flat;
+    std::string s;
+    s.reserve(rope->length);
+    appendString(s, rope);
+    tempRoots.push_back(rope);
+    ObjString* str = newString(std::move(s));
+    // 展平后释放子节点，后续访问直接使用结果
+    prepareWrite(rope);
+    rope->left = rope->right = nullptr;
+    rope->flat = str;
+    writeBarrier(rope, str);
+    popTempRoot();
+    return str;
+}
+
+ObjString* VM::asString(const Value v)
+{
+    if (isObjType(v, ObjType::STRING)) return static_cast<ObjString*>(v.asObj());
+    if (isObjType(v, ObjType::ROPE)) return flatten(static_cast<ObjRope*>(v.asObj()));
+    return nullptr;
+}
+
+void VM::concatenate()
+{
+    // 操作数留在栈上直到结果分配完成，分配期间不会被回收
+    const size_t top = stack.size();
+    for (size_t i = top - 2; i < top; i++)
+    {
+        if (!isStringLike(stack[i]))
+        {
+            stack[i] = newString(valToString(stack[i]));
+        }
+        else if (isObjType(stack[i], ObjType::ROPE))
+        {
+            // 已展平的绳节点用结果代替，缩短拼接链
+            if (ObjString* flat = static_cast<ObjRope*>(stack[i].asObj())->flat) stack[i] = flat;
+        }
+    }
+    Obj* a = stack[top - 2].asObj();
+    Obj* b = stack[top - 1].asObj();
+    const size_t length = stringLength(a) + stringLength(b);
+    Obj* result;
+    if (length < ObjRope::MIN_LENGTH)
+    {
+        std::string s;
+        s.reserve(length);
+        appendString(s, a);
+        appendString(s, b);
+        result = newString(std::move(s));
+    }
+    else
+    {
+        result = allocate<ObjRope>(a, b, length);
     }
+    stack.pop_back();
+    stack.back() = result;
+}
+
+void VM::freeObjects()
+{
+    // 只析构对象，块内存随堆一起归还
+    heap.forEachCell([](void* cell) { destroyObject(static_cast<Obj*>(cell)); });
     objects = nullptr;
 }
 
+void VM::freeObject(Obj* o)
+{
+    // 驻留表是弱引用，释放前移除对应条目
+    if (o->type == ObjType::STRING)
+    {
+        strings.erase(static_cast<ObjString*>(o));
+    }
+    bytesAllocated -= Heap::allocationSize(o) + o->payload;
+    // 机器码不在 GC 堆上，随函数一起释放
+    if (o->type == ObjType::FUNCTION) releaseJITCode(static_cast<ObjFunction*>(o));
+    destroyObject(o);
+    heap.free(o);
+}
+
+void VM::recordPause(const std::chrono::steady_clock::time_point start)
+{
+    const auto pause = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    gcStats.maxPause = std::max(gcStats.maxPause, pause);
+}
+
 void VM::collectGarbage()
 {
+    collectYoung();
+    if (gcPhase == GCPhase::IDLE && bytesAllocated > nextGC)
+    {
+        if (concurrentMarking) startConcurrentMark();
+        else if (gcMaxPause.count() == 0) collectFull();
+        else startIncrementalMark();
+    }
+    else if (gcPhase != GCPhase::IDLE && bytesAllocated > nextGC * 2)
+    {
+        // 分配速度超过了增量回收的进度，直接完成本轮回收
+        collectFull();
+    }
+    else if (gcPhase != GCPhase::IDLE)
+    {
+        incrementalStep();
+    }
+}
+
+void VM::collectYoung()
+{
+    const auto start = std::chrono::steady_clock::now();
+    // 增量标记的灰色对象留到新生代回收之后继续处理
+    std::vector<Obj*> pendingGray;
+    pendingGray.swap(grayStack);
+
+    collectingYoung = true;
     markRoots();
+    // 记忆集中的老年代对象不会被标记，直接扫描它们的引用
+    for (Obj* o : rememberedSet) blackenObject(o);
     traceReferences();
+    collectingYoung = false;
+
+    grayStack.swap(pendingGray);
+    sweepYoung();
+    for (Obj* o : rememberedSet) o->isRemembered = false;
+    rememberedSet.clear();
+    heap.resetNursery();
+    payloadGrowth = 0;
+    nextGCStep = GC_STEP_BYTES;
+    gcStats.minorCollections++;
+    recordPause(start);
+}
+
+void VM::collectFull()
+{
+    const auto start = std::chrono::steady_clock::now();
+    if (gcPhase == GCPhase::MARK)
+    {
+        // 完成进行中的增量标记（剩余的灰色对象在重新扫描根时一起并行处理）
+        finishMark();
+    }
+    else if (gcPhase == GCPhase::CONCURRENT_MARK)
+    {
+        finishConcurrentMark();
+    }
+    if (gcPhase == GCPhase::SWEEP)
+    {
+        sweepStep(std::chrono::steady_clock::time_point::max());
+        recordPause(start);
+        return;
+    }
+
+    markRoots();
+    traceReferences();
+    // 清理前清空记忆集：其中可能有即将释放的对象，存活对象全部晋升后也不再需要
+    for (Obj* o : rememberedSet) o->isRemembered = false;
+    rememberedSet.clear();
+    // 先清理老年代，再把新生代存活对象晋升进去
+    beginSweep();
     sweep();
-    nextGC = bytesAllocated * 2;
+    sweepYoung();
+    gcPhase = GCPhase::IDLE;
+    heap.resetNursery();
+    payloadGrowth = 0;
+    nextGCStep = GC_STEP_BYTES;
+    nextGC = std::max(bytesAllocated * 2, static_cast<size_t>(1024 * 1024));
+    gcStats.fullCollections++;
+    recordPause(start);
+}
+
+void VM::startIncrementalMark()
+{
+    const auto start = std::chrono::steady_clock::now();
+    gcPhase = GCPhase::MARK;
+    // 新生代对象不在此时标记，晋升时再置灰
+    markRoots();
+    recordPause(start);
+}
+
+void VM::incrementalStep()
+{
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start + gcMaxPause;
+    if (gcPhase == GCPhase::MARK)
+    {
+        if (markStep(deadline)) finishMark();
+    }
+    else if (gcPhase == GCPhase::CONCURRENT_MARK)
+    {
+        // 提交主线程的记录，标记线程没有剩余工作时结束标记
+        marker.push(satbLog);
+        if (marker.idle()) finishConcurrentMark();
+    }
+    else if (gcPhase == GCPhase::SWEEP)
+    {
+        sweepStep(deadline);
+    }
+    nextGCStep = youngBytes() + GC_STEP_BYTES;
+    gcStats.incrementalSteps++;
+    recordPause(start);
+}
+
+bool VM::markStep(const std::chrono::steady_clock::time_point deadline)
+{
+    // 每处理一批对象检查一次时间
+    constexpr int BATCH = 64;
+    while (!grayStack.empty())
+    {
+        for (int i = 0; i < BATCH && !grayStack.empty(); i++)
+        {
+            Obj* o = grayStack.back();
+            grayStack.pop_back();
+            blackenObject(o);
+        }
+        if (std::chrono::steady_clock::now() >= deadline) return grayStack.empty();
+    }
+    return true;
+}
+
+void VM::finishMark()
+{
+    // 新生代存活对象晋升时被置灰，根对象上的引用不经过写屏障，需重新扫描
+    collectYoung();
+    markRoots();
+    traceReferences();
+
+    beginSweep();
+}
+
+void VM::startConcurrentMark()
+{
+    const auto start = std::chrono::steady_clock::now();
+    // 先清空新生代，快照中只有老年代对象
+    collectYoung();
+    gcPhase = GCPhase::CONCURRENT_MARK;
+    // 根对象只在此时扫描一次，之后对根的修改不需要屏障
+    markRoots();
+    // 临时根上的对象仍在构造中，由主线程立即扫描
+    for (Obj* o : tempRoots) ConcurrentMarker::snapshot(o, satbLog);
+    grayStack.insert(grayStack.end(), satbLog.begin(), satbLog.end());
+    satbLog.clear();
+    marker.start(std::move(grayStack));
+    grayStack.clear();
+    recordPause(start);
+}
+
+void VM::finishConcurrentMark()
+{
+    marker.push(satbLog);
+    marker.finish();
+    beginSweep();
+}
+
+void VM::beginSweep()
+{
+    // 驻留表是弱引用：清理阶段开始前移除死亡字符串，避免惰性清理期间被重新取出
+    // 新生代字符串不参与本轮回收
+    // 清理线程不访问驻留表，死亡的老年代字符串都在这里移除
+    std::erase_if(strings, [](const ObjString* str) { return !str->isYoung && !Heap::isMarked(str); });
+
+    gcPhase = GCPhase::SWEEP;
+    heap.beginSweep();
+}
+
+bool VM::sweepStep(const std::chrono::steady_clock::time_point deadline)
+{
+    if (deadline == std::chrono::steady_clock::time_point::max())
+    {
+        sweep();
+    }
+    else
+    {
+        // 惰性清理在主线程上逐块进行
+        while (Heap::Block* block = heap.takeSweepBlock())
+        {
+            bytesAllocated -= sweepBlock(block);
+            heap.finishSweptBlocks();
+            if (std::chrono::steady_clock::now() >= deadline && !heap.sweepDone()) return false;
+        }
+    }
+    gcPhase = GCPhase::IDLE;
+    nextGC = std::max(bytesAllocated * 2, static_cast<size_t>(1024 * 1024));
+    gcStats.fullCollections++;
+    return true;
+}
+
+void VM::checkHeapLimit()
+{
+    if (bytesAllocated <= maxHeap) return;
+    // 进行中的增量回收只能回收本轮开始前的垃圾，完成后再做一次完整回收
+    if (gcPhase != GCPhase::IDLE) collectFull();
+    collectFull();
+    if (bytesAllocated > maxHeap)
+    {
+        throw std::runtime_error("Out of memory: heap limit of " + std::to_string(maxHeap) + " bytes exceeded (" +
+            std::to_string(bytesAllocated) + " bytes in use).");
+    }
+}
+
+void VM::setMaxHeap(const double mb)
+{
+    maxHeap = static_cast<size_t>(mb * 1024 * 1024);
+}
+
+void VM::setGCMaxPause(const double ms)
+{
+    gcMaxPause = std::chrono::microseconds(static_cast<int64_t>(ms * 1000));
+}
+
+void VM::printGCStats() const
+{
+    std::cerr << "[GC] minor: " << gcStats.minorCollections << ", full: " << gcStats.fullCollections
+        << ", incremental steps: " << gcStats.incrementalSteps
+        << ", max pause: " << static_cast<double>(gcStats.maxPause.count()) / 1000.0 << " ms"
+        << ", threads: " << gcWorkers.size() << std::endl;
+    std::cerr << "[GC] heap: " << bytesAllocated << " bytes in " << heap.blockCount() << " blocks" << std::endl;
 }
 
 void VM::markRoots()
 {
     for (auto& v : stack) markValue(v);
-    for (auto& [k, v] : globals) markValue(v);
+    for (auto& g : globals)
+    {
+        markObject(g.name);
+        markValue(g.value);
+    }
+    for (auto& [k, v] : listMethods)
+    {
+        markObject(k);
+        markObject(v);
+    }
+    for (auto& [k, v] : stringMethods)
+    {
+        markObject(k);
+        markObject(v);
+    }
+    markObject(lengthString);
+    markObject(constructorString);
+    markObject(exportsString);
     for (const auto& f : frames) markObject(f.closure);
     for (ObjUpvalue* u = openUpvalues; u; u = u->nextUp) markObject(u);
-    for (Obj* o : tempRoots) markObject(o);
+    for (auto& [path, exports] : modules) markValue(exports);
+    for (ObjClosure* c : timeoutCallbacks) markObject(c);
+    for (auto& [id, c] : intervalCallbacks) markObject(c);
+    // 编译任务里的全局变量副本可能引用已被替换的对象，安装前它们都要存活
+    jitQueue.forEach([this](const JitJob& job)
+    {
+        markObject(job.function);
+        for (const GlobalSlot& g : job.globals) markValue(g.value);
+    });
+    for (Obj* o : tempRoots)
+    {
+        markObject(o);
+        // 临时根上的对象仍在构造中，写入时不经过写屏障：
+        // 新生代回收和增量标记时即使它已是老年代或已被标记，也要重新扫描它的引用
+        if (!o->isYoung && (collectingYoung || gcPhase == GCPhase::MARK)) blackenObject(o);
+    }
 }
 
 void VM::markValue(const Value& v)
 {
-    if (std::holds_alternative<Obj*>(v)) markObject(std::get<Obj*>(v));
+    if (v.isObj()) markObject(v.asObj());
 }
 
 
 void VM::markObject(Obj* o)
 {
-    if (!o || o->isMarked) return;
-    o->isMarked = true;
+    if (!o) return;
+    // 新生代回收不标记老年代对象（并发标记期间老年代对象的标记位属于标记线程，不能读取）
+    if (collectingYoung)
+    {
+        if (!o->isYoung) return;
+    }
+    else if (gcPhase == GCPhase::MARK && o->isYoung)
+    {
+        // 增量标记不标记新生代对象，它们在晋升时置灰
+        return;
+    }
+    else if (gcPhase == GCPhase::CONCURRENT_MARK)
+    {
+        // 并发标记开始时的根对象，由标记线程置灰
+        grayStack.push_back(o);
+        return;
+    }
+    if (!Heap::mark(o)) return;
     grayStack.push_back(o);
 }
 
 void VM::traceReferences()
 {
+    if (!collectingYoung)
+    {
+        bytesAllocated += ParallelMarker::mark(gcWorkers, grayStack);
+        return;
+    }
     while (!grayStack.empty())
     {
         Obj* o = grayStack.back();
         grayStack.pop_back();
-        if (o->type == ObjType::CLASS)
-        {
-            auto c = dynamic_cast<ObjClass*>(o);
-            for (auto& [k, v] : c->methods) markObject(v);
-        }
-        else if (o->type == ObjType::INSTANCE)
-        {
-            auto i = dynamic_cast<ObjInstance*>(o);
-            markObject(i->klass);
-            for (auto& [k, v] : i->fields) markValue(v);
-        }
-        else if (o->type == ObjType::BOUND_METHOD)
-        {
-            auto b = dynamic_cast<ObjBoundMethod*>(o);
-            markValue(b->receiver);
-            markObject(b->method);
-        }
-        else if (o->type == ObjType::LIST)
-        {
-            for (const auto list = dynamic_cast<ObjList*>(o); auto& val : list->elements)
-            {
-                markValue(val);
-            }
-        }
-        else if (o->type == ObjType::CLOSURE)
-        {
-            const auto c = dynamic_cast<ObjClosure*>(o);
-            markObject(c->function);
-            for (auto u : c->upvalues) markObject(u);
-        }
-        else if (o->type == ObjType::FUNCTION)
-        {
-            auto f = dynamic_cast<ObjFunction*>(o);
-            for (auto& c : f->chunk.constants) markValue(c);
-        }
-        else if (o->type == ObjType::UPVALUE) markValue(dynamic_cast<ObjUpvalue*>(o)->closedValue);
+        blackenObject(o);
     }
 }
 
+void VM::blackenObject(Obj* o)
+{
+    // 顺便刷新附属内存的统计，覆盖未在增长处单独统计的写入
+    accountPayload(o);
+    forEachReference(o, [this](Obj* child) { markObject(child); });
+}
+
 void VM::sweep()
 {
-    Obj* prev = nullptr;
+    // 各线程领取不同的块，块内的对象和空闲链表只由领取它的线程修改
+    std::vector<size_t> freed(gcWorkers.size());
+    gcWorkers.run([&](const unsigned index)
+    {
+        size_t bytes = 0;
+        while (Heap::Block* block = heap.takeSweepBlock()) bytes += sweepBlock(block);
+        freed[index] = bytes;
+    });
+    heap.finishSweptBlocks();
+    for (const size_t bytes : freed) bytesAllocated -= bytes;
+}
+
+size_t VM::sweepBlock(Heap::Block* block)
+{
+    size_t freed = 0;
+    Heap::sweepBlock(block, [this, &freed](void* cell)
+    {
+        auto* obj = static_cast<Obj*>(cell);
+        // 新生代对象由新生代回收处理
+        if (obj->isYoung) return false;
+        if (Heap::isMarked(obj))
+        {
+            Heap::clearMark(obj);
+            obj->scanState = ScanState::WHITE;
+            return false;
+        }
+        freed += Heap::allocationSize(obj) + obj->payload;
+        if (obj->type == ObjType::FUNCTION) releaseJITCode(static_cast<ObjFunction*>(obj));
+        destroyObject(obj);
+        return true;
+    });
+    return freed;
+}
+
+void VM::sweepYoung()
+{
     Obj* obj = objects;
+    objects = nullptr;
     while (obj)
     {
-        if (obj->isMarked)
+        Obj* next = obj->next;
+        if (Heap::isMarked(obj))
         {
-            obj->isMarked = false;
-            prev = obj;
-            obj = obj->next;
+            obj->next = nullptr;
+            if (gcPhase == GCPhase::CONCURRENT_MARK)
+            {
+                // 并发标记期间晋升的对象保持标记并视为已扫描，标记线程可能同时读取这几个字段
+                std::atomic_ref(obj->scanState).store(ScanState::BLACK, std::memory_order_relaxed);
+                std::atomic_ref(obj->isYoung).store(false, std::memory_order_release);
+            }
+            else
+            {
+                obj->isYoung = false;
+                if (gcPhase == GCPhase::MARK)
+                {
+                    // 增量标记期间晋升的对象保持标记并置灰，由增量标记继续扫描它的引用
+                    grayStack.push_back(obj);
+                }
+                else if (gcPhase != GCPhase::SWEEP || !Heap::sweepPending(obj))
+                {
+                    // 惰性清理尚未到达的块中，晋升的对象保持标记，清理时再复位
+                    Heap::clearMark(obj);
+                }
+            }
         }
         else
         {
-            const Obj* unreached = obj;
-            obj = obj->next;
-            if (prev) prev->next = obj;
-            else objects = obj;
-            delete unreached;
+            freeObject(obj);
         }
+        obj = next;
     }
 }
 
@@ -191,7 +652,7 @@ void VM::defineNative(const std::string& name, const NativeFn& fn)
 {
     auto* n = allocate<ObjNative>(fn, name);
     stack.emplace_back(n);
-    globals[name] = n;
+    defineGlobal(newString(name), n);
     stack.pop_back();
 }
 
@@ -312,8 +773,10 @@ void VM::closeUpvalues(const Value* last)
     while (openUpvalues && openUpvalues->location >= last)
     {
         ObjUpvalue* up = openUpvalues;
+        prepareWrite(up);
         // 把值从栈上搬到堆上
         up->closedValue = *up->location;
+        writeBarrier(up, up->closedValue);
         // 修改 location 指针，指向堆上的 closedValue
         up->location = &up->closedValue;
         openUpvalues = up->nextUp;
@@ -325,7 +788,9 @@ void VM::interpret(ObjFunction* script)
     stack.clear();
     frames.clear();
     openUpvalues = nullptr;
+    tempRoots.push_back(script);
     auto* closure = allocate<ObjClosure>(script);
+    popTempRoot();
     stack.emplace_back(closure);
     frames.push_back({closure, script->chunk.code.data(), 0});
     run();
@@ -338,6 +803,201 @@ void VM::runtimeError(const char* format)
     frames.clear();
 }
 
+void VM::tierUp(ObjFunction* function, const int entry)
+{
+    auto job = std::make_unique<JitJob>();
+    job->function = function;
+    job->entry = entry;
+    job->chunk.code = function->chunk.code;
+    job->chunk.constants = function->chunk.constants;
+    job->globals = globals;
+    if (entry != 0)
+    {
+        job->slots.assign(stack.begin() + frames.back().slots, stack.end());
+    }
+    if (jitBackground)
+    {
+        function->jitQueued = true;
+        jitQueue.push(std::move(job));
+        return;
+    }
+    jit.compile(*job);
+    installJIT(*job);
+}
+
+void VM::installJIT(JitJob& job)
+{
+    ObjFunction* function = job.function;
+    function->jitQueued = false;
+    if (job.code != nullptr)
+    {
+        keepJITReferences(function, job.refs);
+    }
+    if (job.entry != 0)
+    {
+        function->osrEntries.emplace_back(job.entry, job.code);
+        debug_log("OSR 编译函数{}的循环（位置 {}）{}", function->name, job.entry, job.code != nullptr ? "完成" : "失败");
+    }
+    else if (job.code != nullptr)
+    {
+        function->jitFunction = job.code;
+        debug_log("JIT编译函数{}完成，调用 {} 次，回边 {} 次", function->name, function->callCount,
+                  function->loopCount);
+    }
+    else
+    {
+        function->jitFailed = true;
+        debug_log("JIT编译函数{} 失败，之后始终由解释器执行", function->name);
+    }
+}
+
+void VM::installFinishedJIT()
+{
+    for (const auto& job : jitQueue.takeFinished())
+    {
+        installJIT(*job);
+    }
+}
+
+void VM::waitForJIT()
+{
+    jitQueue.wait();
+    installFinishedJIT();
+}
+
+void VM::keepJITReferences(ObjFunction* function, std::vector<Obj*>& refs)
+{
+    // 机器码直接引用的被调闭包由函数持有
+    prepareWrite(function);
+    for (Obj* ref : refs)
+    {
+        function->jitReferences.push_back(ref);
+        writeBarrier(function, ref);
+    }
+}
+
+void VM::discardJIT(ObjFunction* function)
+{
+    if (function->jitFunction == nullptr && function->osrEntries.empty())
+    {
+        return;
+    }
+    releaseJITCode(function);
+    function->jitFunction = nullptr;
+    function->osrEntries.clear();
+    // 丢弃引用同样要经过写前屏障，否则并发标记线程可能正在遍历这些引用
+    prepareWrite(function);
+    function->jitReferences.clear();
+    function->callCount = 0;
+    function->loopCount = 0;
+    function->deoptCount = 0;
+    debug_log("JIT函数{}的假设失效，回到解释器执行", function->name);
+}
+
+void VM::releaseJITCode(const ObjFunction* function)
+{
+    if (function->jitFunction != nullptr)
+    {
+        jit.release(reinterpret_cast<JitCompiler::JitFn>(function->jitFunction));
+    }
+    for (const auto& [entry, code] : function->osrEntries)
+    {
+        if (code != nullptr)
+        {
+            jit.release(reinterpret_cast<JitCompiler::JitFn>(code));
+        }
+    }
+}
+
+void VM::resumeFromDeopt(ObjClosure* closure, int calleeSlot)
+{
+    // 记录按内层到外层排列，每条是头（ip << 32 | 槽位数）加槽位 1 及之后的值
+    std::vector<const Value*> records;
+    for (const Value* record = jitDeopt.data(); record < jitContext.deoptTop;
+         record += 1 + (record->raw() & 0xffffffff))
+    {
+        records.push_back(record);
+    }
+
+    // 从最外层开始重建：外层记录的最后一个槽位是被调闭包，也就是内层帧的槽位 0
+    for (auto it = records.rbegin(); it != records.rend(); ++it)
+    {
+        const uint64_t header = (*it)->raw();
+        const int count = static_cast<int>(header & 0xffffffff);
+        stack.resize(calleeSlot + 1);
+        stack.insert(stack.end(), *it + 2, *it + 1 + count);
+        frames.push_back({closure, closure->function->chunk.code.data() + (header >> 32), calleeSlot});
+        if (std::next(it) != records.rend())
+        {
+            calleeSlot += count - 1;
+            closure = objAs<ObjClosure>(stack[calleeSlot]);
+        }
+    }
+}
+
+void VM::countDeopt()
+{
+    if (ObjFunction* fn = jitContext.deoptFunction; fn != nullptr && ++fn->deoptCount >= JIT_DEOPT_LIMIT)
+    {
+        discardJIT(fn);
+    }
+}
+
+double VM::runJIT(void* code, const Value* args)
+{
+    if (jitStack.empty())
+    {
+        jitStack.resize(JIT_STACK_SIZE);
+        jitDeopt.resize(JIT_STACK_SIZE + JitContext::MAX_RECORD);
+    }
+    jitContext.globals = globals.data();
+    jitContext.stackTop = jitStack.data();
+    jitContext.stackEnd = jitStack.data() + jitStack.size();
+    jitContext.deoptTop = jitDeopt.data();
+    jitContext.bailout = 0;
+    jitContext.deoptFunction = nullptr;
+    return reinterpret_cast<JitCompiler::JitFn>(code)(args, &jitContext);
+}
+
+bool VM::enterOSR()
+{
+    CallFrame& frame = frames.back();
+    ObjClosure* closure = frame.closure;
+    ObjFunction* function = closure->function;
+    const int entry = static_cast<int>(frame.ip - function->chunk.code.data());
+    const int slots = frame.slots;
+
+    // 每个循环头只编译一次，失败的也记下来；后台编译期间继续解释执行
+    auto found = [&]
+    {
+        return std::ranges::find_if(function->osrEntries, [&](const auto& osr) { return osr.first == entry; });
+    };
+    if (function->jitQueued && jitQueue.hasFinished())
+    {
+        installFinishedJIT();
+    }
+    auto it = found();
+    if (it == function->osrEntries.end() && !function->jitQueued)
+    {
+        tierUp(function, entry);
+        it = found();
+    }
+    if (it == function->osrEntries.end() || it->second == nullptr)
+    {
+        return false;
+    }
+
+    runJIT(it->second, stack.data() + slots + 1);
+    // 入口处类型不符时没有记录，解释器照常执行循环
+    if (jitContext.deoptTop != jitDeopt.data())
+    {
+        frames.pop_back();
+        resumeFromDeopt(closure, slots);
+    }
+    countDeopt();
+    return true;
+}
+
 void VM::callAndRun(ObjClosure* closure)
 {
     if (closure == nullptr)
@@ -351,185 +1011,523 @@ void VM::callAndRun(ObjClosure* closure)
     run();
 }
 
+bool VM::callValue(const int argc)
+{
+    int calleeSlot = stack.size() - 1 - argc;
+    if (Value callee = stack[calleeSlot]; isObjType(callee, ObjType::CLOSURE))
+    {
+        auto* cl = objAs<ObjClosure>(callee);
+
+        if (ObjFunction* fn = cl->function; jitEnabled && fn->jitFunction == nullptr && !fn->jitFailed)
+        {
+            // 后台编译期间继续解释执行，完成后在这里安装
+            if (fn->jitQueued)
+            {
+                if (jitQueue.hasFinished()) installFinishedJIT();
+            }
+            else if (++fn->callCount >= jitThreshold || fn->loopCount >= jitThreshold)
+            {
+                tierUp(fn);
+            }
+        }
+
+        // 如果有 JIT 函数，执行 JIT 代码
+        if (cl->function->jitFunction != nullptr && jitEnabled && argc == cl->function->arity)
+        {
+            debug_log("执行 JIT 函数 {} ", cl->function->name);
+            // 参数直接从 VM 栈传入，不是数字时回退到解释器执行
+            for (int i = 0; i < argc; ++i)
+            {
+                if (!stack[calleeSlot + 1 + i].isNumber())
+                {
+                    frames.push_back({cl, cl->function->chunk.code.data(), calleeSlot});
+                    return true;
+                }
+            }
+
+            const double result = runJIT(cl->function->jitFunction, stack.data() + calleeSlot + 1);
+
+            // 中止：从中止处继续解释执行
+            if (jitContext.bailout != 0)
+            {
+                resumeFromDeopt(cl, calleeSlot);
+                countDeopt();
+                return true;
+            }
+
+            stack.resize(calleeSlot);
+            stack.emplace_back(result);
+            debug_log("JIT函数{}调用成功", cl->function->name);
+        }
+        else
+        {
+            // 没有 JIT 函数，回退到解释器执行
+            frames.push_back({cl, cl->function->chunk.code.data(), calleeSlot});
+        }
+    }
+    else if (isObjType(callee, ObjType::NATIVE))
+    {
+        auto* n = objAs<ObjNative>(callee);
+        Value* args = &stack[calleeSlot + 1];
+        Value res = n->function(argc, args);
+
+        if (calleeSlot < 0 || static_cast<size_t>(calleeSlot) > stack.size())
+        {
+            stack.clear();
+        }
+        else
+        {
+            stack.resize(calleeSlot);
+        }
+        stack.push_back(res);
+    }
+    else if (isObjType(callee, ObjType::CLASS))
+    {
+        auto* klass = objAs<ObjClass>(callee);
+
+        ObjInstance* instance;
+        if (klass->isNative)
+        {
+            instance = allocate<ObjNativeInstance>(klass);
+        }
+        else
+        {
+            instance = allocate<ObjInstance>(klass);
+        }
+
+        stack[calleeSlot] = instance;
+
+        if (klass->nativeMethods.contains(constructorString))
+        {
+            ObjNative* init = klass->nativeMethods[constructorString];
+            Value* args = &stack[calleeSlot + 1];
+            // 调用原生 init，args[-1] 是刚创建的 instance
+            init->function(argc, args);
+
+            if (calleeSlot < 0 || static_cast<size_t>(calleeSlot) > stack.size())
+            {
+                stack.clear();
+            }
+            else
+            {
+                stack.resize(calleeSlot);
+            }
+            stack.emplace_back(instance); // 构造函数返回实例
+        }
+        else if (klass->methods.contains(constructorString))
+        {
+            ObjClosure* init = klass->methods[constructorString];
+            // 创建帧，开始执行 init 方法
+            frames.push_back({init, init->function->chunk.code.data(), calleeSlot});
+        }
+        else if (argc != 0)
+        {
+            runtimeError(("Expected 0 arguments but got " + std::to_string(argc) + ".").c_str());
+            return false;
+        }
+    }
+    else if (isObjType(callee, ObjType::BOUND_METHOD))
+    {
+        auto* bound = objAs<ObjBoundMethod>(callee);
+        stack[calleeSlot] = bound->receiver;
+
+        if (bound->method->type == ObjType::CLOSURE)
+        {
+            auto* closure = objAs<ObjClosure>(bound->method);
+            frames.push_back({closure, closure->function->chunk.code.data(), calleeSlot});
+        }
+        else if (bound->method->type == ObjType::NATIVE)
+        {
+            auto* native = objAs<ObjNative>(bound->method);
+            Value* args = &stack[calleeSlot + 1];
+            Value res = native->function(argc, args);
+            if (calleeSlot < 0 || static_cast<size_t>(calleeSlot) > stack.size())
+            {
+                stack.clear();
+            }
+            else
+            {
+                stack.resize(calleeSlot);
+            }
+            stack.push_back(res);
+        }
+    }
+    else
+    {
+        if (callee.isNil())
+        {
+            std::cerr << "Call failed: callee is null\n";
+        }
+        else if (callee.isBool())
+        {
+            std::cerr << "Call failed: callee is boolean (" << callee.asBool() << ")\n";
+        }
+        else if (callee.isNumber())
+        {
+            std::cerr << "Call failed: callee is number (" << callee.asNumber() << ")\n";
+        }
+        else if (callee.isObj())
+        {
+            auto* obj = callee.asObj();
+            std::cerr << "Call failed: callee is Obj* of type " << static_cast<int>(obj->type) << "\n";
+        }
+        return false;
+    }
+    return true;
+}
+
+void VM::callNative(ObjNative* native, const int argc, const int calleeSlot)
+{
+    const Value res = native->function(argc, stack.data() + calleeSlot + 1);
+    stack.resize(calleeSlot);
+    stack.push_back(res);
+}
+
+bool VM::resolveInstanceProperty(ObjInstance* instance, ObjString* name, PropertyCache& cache,
+                                 PropertyCacheEntry& entry)
+{
+    entry.key = instance->shape;
+    entry.holder = instance->klass;
+    if (const int slot = instance->shape->lookup(name); slot >= 0)
+    {
+        entry.kind = PropertyCacheEntry::Kind::FIELD;
+        entry.slot = static_cast<uint32_t>(slot);
+    }
+    else if (const auto native = instance->klass->nativeMethods.find(name);
+        native != instance->klass->nativeMethods.end())
+    {
+        entry.kind = PropertyCacheEntry::Kind::NATIVE_METHOD;
+        entry.method = native->second;
+    }
+    else if (const auto method = instance->klass->methods.find(name); method != instance->klass->methods.end())
+    {
+        entry.kind = PropertyCacheEntry::Kind::METHOD;
+        entry.method = method->second;
+    }
+    else
+    {
+        return false;
+    }
+
+    // 字典模式的形状随实例变化，不进入缓存
+    if (!instance->shape->isDictionary) addCacheEntry(cache, entry);
+    return true;
+}
+
+bool VM::invoke(ObjString* name, PropertyCache& cache, const int argc)
+{
+    const int calleeSlot = static_cast<int>(stack.size()) - 1 - argc;
+    // 在绳节点上调用方法时按展平后的字符串处理
+    flattenAt(calleeSlot);
+    const Value receiver = stack[calleeSlot];
+
+    if (isObjType(receiver, ObjType::INSTANCE))
+    {
+        auto* instance = static_cast<ObjInstance*>(receiver.asObj());
+        PropertyCacheEntry resolved;
+        const PropertyCacheEntry* entry = cache.find(instance->shape);
+        if (entry)
+        {
+            icStats.hits++;
+        }
+        else
+        {
+            icStats.misses++;
+            if (!resolveInstanceProperty(instance, name, cache, resolved))
+            {
+                runtimeError(("Undefined property '" + name->chars + "'.").c_str());
+                return false;
+            }
+            entry = &resolved;
+        }
+
+        switch (entry->kind)
+        {
+        case PropertyCacheEntry::Kind::METHOD:
+            {
+                // 接收者留在被调用者槽位，作为方法的 this
+                auto* closure = static_cast<ObjClosure*>(entry->method);
+                frames.push_back({closure, closure->function->chunk.code.data(), calleeSlot});
+                return true;
+            }
+        case PropertyCacheEntry::Kind::NATIVE_METHOD:
+            callNative(static_cast<ObjNative*>(entry->method), argc, calleeSlot);
+            return true;
+        default:
+            // 字段中保存的函数按普通调用处理
+            stack[calleeSlot] = instance->fields[entry->slot];
+            return callValue(argc);
+        }
+    }
+
+    if (isObjType(receiver, ObjType::CLASS))
+    {
+        auto* klass = static_cast<ObjClass*>(receiver.asObj());
+        ObjNative* method;
+        if (const PropertyCacheEntry* entry = cache.find(klass))
+        {
+            icStats.hits++;
+            method = static_cast<ObjNative*>(entry->method);
+        }
+        else
+        {
+            icStats.misses++;
+            const auto it = klass->nativeMethods.find(name);
+            if (it == klass->nativeMethods.end())
+            {
+                runtimeError(("Undefined static property '" + name->chars + "' on class.").c_str());
+                return false;
+            }
+            method = it->second;
+            addCacheEntry(cache, {
+                .key = klass, .kind = PropertyCacheEntry::Kind::STATIC_NATIVE, .method = method, .holder = klass
+            });
+        }
+        // 静态方法不绑定 this
+        stack[calleeSlot] = method;
+        callNative(method, argc, calleeSlot);
+        return true;
+    }
+
+    if (isObjType(receiver, ObjType::LIST) || isObjType(receiver, ObjType::STRING))
+    {
+        const bool isList = isObjType(receiver, ObjType::LIST);
+        auto& methods = isList ? listMethods : stringMethods;
+        if (const auto it = methods.find(name); it != methods.end())
+        {
+            callNative(it->second, argc, calleeSlot);
+            return true;
+        }
+        if (name == lengthString)
+        {
+            // length 不是函数，交给普通调用报告错误
+            stack[calleeSlot] = static_cast<double>(isList
+                                                        ? static_cast<ObjList*>(receiver.asObj())->elements.size()
+                                                        : static_cast<ObjString*>(receiver.asObj())->chars.length());
+            return callValue(argc);
+        }
+        runtimeError(("Undefined property '" + name->chars + "' on " + (isList ? "list." : "string.")).c_str());
+        return false;
+    }
+
+    if (receiver.isNil())
+    {
+        runtimeError(("Cannot read property '" + name->chars + "' of null").c_str());
+        return false;
+    }
+    runtimeError("Only instances, classes, lists, or strings have properties.");
+    return false;
+}
+
 void VM::run()
 {
     size_t startFrameDepth = frames.size();
 
     CallFrame* frame = &frames.back();
 #define READ_BYTE() (*frame->ip++)
-#define READ_CONST() (frame->closure->function->chunk.constants[static_cast<uint16_t>(READ_BYTE() << 8 | READ_BYTE())])
+#define READ_SHORT() (frame->ip += 2, static_cast<uint16_t>(frame->ip[-2] << 8 | frame->ip[-1]))
+#define READ_CONST() (frame->closure->function->chunk.constants[READ_SHORT()])
+#define READ_CACHE() (frame->closure->function->chunk.propertyCaches[READ_SHORT()])
+// 将刚读取的指令改写为特化版本
+#define QUICKEN(op) (frame->ip[-1] = static_cast<uint8_t>(OpCode::op))
+// 特化指令类型检查失败：改回通用指令并重新执行（不能用 do-while 包裹，switch 分派下 DISPATCH 是 break）
+#define DEOPTIMIZE(op) { frame->ip[-1] = static_cast<uint8_t>(OpCode::op); frame->ip--; DISPATCH(); }
+#if TINY_JS_THREADED_DISPATCH
+#define SWITCH_OPCODE
+#define CASE(op) L_##op
+#define DISPATCH() goto *dispatchTable[READ_BYTE()]
+#else
+#define SWITCH_OPCODE switch (static_cast<OpCode>(READ_BYTE()))
+#define CASE(op) case OpCode::op
+#define DISPATCH() break
+#endif
+
+#if TINY_JS_THREADED_DISPATCH
+    // 顺序必须与 OpCode 定义一致
+    static void* const dispatchTable[] = {
+        &&L_OP_CONSTANT,
+        &&L_OP_NIL,
+        &&L_OP_TRUE,
+        &&L_OP_FALSE,
+        &&L_OP_POP,
+        &&L_OP_GET_LOCAL,
+        &&L_OP_SET_LOCAL,
+        &&L_OP_GET_GLOBAL,
+        &&L_OP_DEFINE_GLOBAL,
+        &&L_OP_SET_GLOBAL,
+        &&L_OP_GET_UPVALUE,
+        &&L_OP_SET_UPVALUE,
+        &&L_OP_EQUAL,
+        &&L_OP_STRICT_EQUAL,
+        &&L_OP_STRICT_NOT_EQUAL,
+        &&L_OP_GREATER,
+        &&L_OP_LESS,
+        &&L_OP_GREATER_EQUAL,
+        &&L_OP_LESS_EQUAL,
+        &&L_OP_ADD,
+        &&L_OP_SUB,
+        &&L_OP_MUL,
+        &&L_OP_DIV,
+        &&L_OP_MOD,
+        &&L_OP_NOT,
+        &&L_OP_NEGATE,
+        &&L_OP_JUMP,
+        &&L_OP_JUMP_IF_FALSE,
+        &&L_OP_JUMP_IF_TRUE,
+        &&L_OP_LOOP,
+        &&L_OP_CALL,
+        &&L_OP_CLOSURE,
+        &&L_OP_CLOSE_UPVALUE,
+        &&L_OP_RETURN,
+        &&L_OP_BUILD_LIST,
+        &&L_OP_BUILD_OBJECT,
+        &&L_OP_GET_SUBSCRIPT,
+        &&L_OP_SET_SUBSCRIPT,
+        &&L_OP_DEFINE_GLOBAL_CONST,
+        &&L_OP_CLASS,
+        &&L_OP_GET_PROPERTY,
+        &&L_OP_SET_PROPERTY,
+        &&L_OP_METHOD,
+        &&L_OP_TERNARY,
+        &&L_OP_AND,
+        &&L_OP_OR,
+        &&L_OP_NEW,
+        &&L_OP_INVOKE,
+        &&L_OP_ADD_NUM,
+        &&L_OP_ADD_STR,
+        &&L_OP_LESS_NUM,
+        &&L_OP_GREATER_NUM,
+        &&L_OP_GREATER_EQUAL_NUM,
+        &&L_OP_LESS_EQUAL_NUM
+    };
+    static_assert(std::size(dispatchTable) == opCodeNames.size());
+    DISPATCH();
+#endif
 
     for (;;)
     {
-        switch (uint8_t instr = READ_BYTE(); static_cast<OpCode>(instr))
+        SWITCH_OPCODE
         {
-        case OpCode::OP_DEFINE_GLOBAL_CONST:
+        CASE(OP_DEFINE_GLOBAL_CONST):
             {
-                Value val = READ_CONST();
-                if (!std::holds_alternative<Obj*>(val) || std::get<Obj*>(val)->type != ObjType::STRING)
-                {
-                    runtimeError("Variable name must be a string.");
-                    return;
-                }
-                std::string n = dynamic_cast<ObjString*>(std::get<Obj*>(val))->chars;
-                globals[n] = stack.back();
-                globalConsts.insert(n);
+                GlobalSlot& g = globals[READ_SHORT()];
+                g.value = stack.back();
+                g.defined = true;
+                g.isConst = true;
                 stack.pop_back();
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_CONSTANT:
+        CASE(OP_CONSTANT):
             {
                 uint8_t highByte = READ_BYTE();
                 uint8_t lowByte = READ_BYTE();
                 uint16_t constIdx = highByte << 8 | lowByte;
                 stack.push_back(frame->closure->function->chunk.constants[constIdx]);
             }
-            break;
-        case OpCode::OP_NIL: stack.emplace_back(std::monostate{});
-            break;
-        case OpCode::OP_TRUE: stack.emplace_back(true);
-            break;
-        case OpCode::OP_FALSE: stack.emplace_back(false);
-            break;
-        case OpCode::OP_POP: stack.pop_back();
-            break;
-        case OpCode::OP_GET_LOCAL: stack.push_back(stack[frame->slots + READ_BYTE()]);
-            break;
-        case OpCode::OP_SET_LOCAL: stack[frame->slots + READ_BYTE()] = stack.back();
-            break;
-        case OpCode::OP_GET_GLOBAL:
+            DISPATCH();
+        CASE(OP_NIL): stack.emplace_back(Value::nil());
+            DISPATCH();
+        CASE(OP_TRUE): stack.emplace_back(true);
+            DISPATCH();
+        CASE(OP_FALSE): stack.emplace_back(false);
+            DISPATCH();
+        CASE(OP_POP): stack.pop_back();
+            DISPATCH();
+        CASE(OP_GET_LOCAL): stack.push_back(stack[frame->slots + READ_BYTE()]);
+            DISPATCH();
+        CASE(OP_SET_LOCAL): stack[frame->slots + READ_BYTE()] = stack.back();
+            DISPATCH();
+        CASE(OP_GET_GLOBAL): stack.push_back(globals[READ_SHORT()].value);
+            DISPATCH();
+        CASE(OP_DEFINE_GLOBAL):
             {
-                Value val = READ_CONST();
-
-                if (!std::holds_alternative<Obj*>(val) || std::get<Obj*>(val)->type != ObjType::STRING)
-                {
-                    runtimeError("Compiler Error: Variable name constant must be a string.");
-                    return;
-                }
-
-                std::string n = dynamic_cast<ObjString*>(std::get<Obj*>(val))->chars;
-                stack.push_back(globals[n]);
-                break;
-            }
-        case OpCode::OP_DEFINE_GLOBAL:
-            {
-                Value val = READ_CONST();
-                if (!std::holds_alternative<Obj*>(val) || std::get<Obj*>(val)->type != ObjType::STRING)
-                {
-                    runtimeError("Compiler Error: Variable name constant must be a string.");
-                    return;
-                }
-                std::string n = dynamic_cast<ObjString*>(std::get<Obj*>(val))->chars;
-                globals[n] = stack.back();
+                GlobalSlot& g = globals[READ_SHORT()];
+                g.value = stack.back();
+                g.defined = true;
                 stack.pop_back();
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_SET_GLOBAL:
+        CASE(OP_SET_GLOBAL):
             {
-                Value val = READ_CONST();
-                if (!std::holds_alternative<Obj*>(val) || std::get<Obj*>(val)->type != ObjType::STRING)
-                {
-                    runtimeError("Compiler Error: Variable name constant must be a string.");
-                    return;
-                }
-                std::string n = dynamic_cast<ObjString*>(std::get<Obj*>(val))->chars;
+                GlobalSlot& g = globals[READ_SHORT()];
 
                 // 如果是全局常量，报错
-                if (globalConsts.contains(n))
+                if (g.isConst)
                 {
-                    runtimeError(("Cannot assign to const global variable '" + n + "'.").c_str());
+                    runtimeError(("Cannot assign to const global variable '" + g.name->chars + "'.").c_str());
                     return;
                 }
 
-                if (!globals.contains(n))
+                if (!g.defined)
                 {
-                    std::cerr << "Undefined var " << n << "\n";
-                    std::cerr << "  Current function: ";
-                    if (frames.size() > 0)
-                    {
-                        std::cerr << frames.back().closure->function->name << "\n";
-                    }
-                    std::cerr << "  Constants in chunk: ";
-                    // 打印当前函数的常量列表
-                    if (frames.size() > 0)
-                    {
-                        const Chunk& chunk = frames.back().closure->function->chunk;
-                        for (size_t i = 0; i < chunk.constants.size(); ++i)
-                        {
-                            const Value& c = chunk.constants[i];
-                            if (std::holds_alternative<Obj*>(c) && std::get<Obj*>(c)->type == ObjType::STRING)
-                            {
-                                std::cerr << "[" << i << ": " << dynamic_cast<ObjString*>(std::get<Obj*>(c))->chars <<
-                                    "] ";
-                            }
-                        }
-                    }
-                    std::cerr << "\n";
+                    std::cerr << "Undefined var " << g.name->chars << "\n";
+                    std::cerr << "  Current function: " << frame->closure->function->name << "\n";
                     return;
                 }
-                globals[n] = stack.back();
-                stack.pop_back();
-                break;
+                // 赋值表达式的值留在栈顶
+                g.value = stack.back();
+                DISPATCH();
             }
-        case OpCode::OP_GET_UPVALUE: stack.push_back(*frame->closure->upvalues[READ_BYTE()]->location);
-            break;
-        case OpCode::OP_SET_UPVALUE: *frame->closure->upvalues[READ_BYTE()]->location = stack.back();
-            break;
+        CASE(OP_GET_UPVALUE): stack.push_back(*frame->closure->upvalues[READ_BYTE()]->location);
+            DISPATCH();
+        CASE(OP_SET_UPVALUE):
+            {
+                ObjUpvalue* upvalue = frame->closure->upvalues[READ_BYTE()];
+                prepareWrite(upvalue);
+                *upvalue->location = stack.back();
+                writeBarrier(upvalue, stack.back());
+            }
+            DISPATCH();
 
-        case OpCode::OP_EQUAL:
+        CASE(OP_EQUAL):
             {
+                // 绳节点不驻留，比较前展平
+                flattenAt(stack.size() - 1);
+                flattenAt(stack.size() - 2);
                 Value b = stack.back();
                 stack.pop_back();
                 Value a = stack.back();
                 stack.pop_back();
                 stack.emplace_back(a == b);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_STRICT_EQUAL:
+        CASE(OP_STRICT_EQUAL):
             {
+                // 绳节点不驻留，比较前展平
+                flattenAt(stack.size() - 1);
+                flattenAt(stack.size() - 2);
                 Value b = stack.back();
                 stack.pop_back();
                 Value a = stack.back();
                 stack.pop_back();
 
-                // 严格相等
+                // 严格相等：类型不同时为 false
                 bool result = false;
-                if (a.index() == b.index())
+                if (a.isNil() && b.isNil())
                 {
-                    if (std::holds_alternative<std::monostate>(a) && std::holds_alternative<std::monostate>(b))
-                    {
-                        result = true;
-                    }
-                    else if (std::holds_alternative<bool>(a) && std::holds_alternative<bool>(b))
-                    {
-                        result = std::get<bool>(a) == std::get<bool>(b);
-                    }
-                    else if (std::holds_alternative<double>(a) && std::holds_alternative<double>(b))
-                    {
-                        result = std::get<double>(a) == std::get<double>(b);
-                    }
-                    else if (std::holds_alternative<Obj*>(a) && std::holds_alternative<Obj*>(b))
-                    {
-                        // 特殊处理字符串
-                        auto o1 = std::get<Obj*>(a);
-                        auto o2 = std::get<Obj*>(b);
-                        if (o1->type == ObjType::STRING && o2->type == ObjType::STRING)
-                        {
-                            auto s1 = dynamic_cast<ObjString*>(o1);
-                            auto s2 = dynamic_cast<ObjString*>(o2);
-                            result = s1->chars == s2->chars;
-                        }
-                        else
-                        {
-                            result = o1 == o2;
-                        }
-                    }
+                    result = true;
+                }
+                else if (a.isBool() && b.isBool())
+                {
+                    result = a.asBool() == b.asBool();
+                }
+                else if (a.isNumber() && b.isNumber())
+                {
+                    result = a.asNumber() == b.asNumber();
+                }
+                else if (a.isObj() && b.isObj())
+                {
+                    // 字符串已驻留，内容相同即为同一对象
+                    result = a.asObj() == b.asObj();
                 }
                 stack.emplace_back(result);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_STRICT_NOT_EQUAL:
+        CASE(OP_STRICT_NOT_EQUAL):
             {
+                // 绳节点不驻留，比较前展平
+                flattenAt(stack.size() - 1);
+                flattenAt(stack.size() - 2);
                 Value b = stack.back();
                 stack.pop_back();
                 Value a = stack.back();
@@ -537,57 +1535,55 @@ void VM::run()
 
                 // 严格不相等：类型不同 或者 (类型相同但值不同)
                 bool result = true;
-                if (a.index() == b.index())
+                if (a.isNil() && b.isNil())
+                {
+                    result = false;
+                }
+                else if (a.isBool() && b.isBool())
+                {
+                    result = a.asBool() != b.asBool();
+                }
+                else if (a.isNumber() && b.isNumber())
+                {
+                    result = a.asNumber() != b.asNumber();
+                }
+                else if (a.isObj() && b.isObj())
                 {
-                    if (std::holds_alternative<std::monostate>(a) && std::holds_alternative<std::monostate>(b))
-                    {
-                        result = false;
-                    }
-                    else if (std::holds_alternative<bool>(a) && std::holds_alternative<bool>(b))
-                    {
-                        result = std::get<bool>(a) != std::get<bool>(b);
-                    }
-                    else if (std::holds_alternative<double>(a) && std::holds_alternative<double>(b))
-                    {
-                        result = std::get<double>(a) != std::get<double>(b);
-                    }
-                    else if (std::holds_alternative<Obj*>(a) && std::holds_alternative<Obj*>(b))
-                    {
-                        result = std::get<Obj*>(a) != std::get<Obj*>(b);
-                    }
+                    result = a.asObj() != b.asObj();
                 }
                 stack.emplace_back(result);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_AND:
+        CASE(OP_AND):
             {
                 bool b = toBool(stack.back());
                 stack.pop_back();
                 bool a = toBool(stack.back());
                 stack.pop_back();
                 stack.emplace_back(a && b);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_OR:
+        CASE(OP_OR):
             {
                 bool b = toBool(stack.back());
                 stack.pop_back();
                 bool a = toBool(stack.back());
                 stack.pop_back();
                 stack.emplace_back(a || b);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_GREATER:
+        CASE(OP_GREATER):
             {
                 Value bVal = stack.back();
                 stack.pop_back();
                 Value aVal = stack.back();
                 stack.pop_back();
 
-                if (std::holds_alternative<double>(aVal) && std::holds_alternative<double>(bVal))
+                if (aVal.isNumber() && bVal.isNumber())
                 {
-                    double b = std::get<double>(bVal);
-                    double a = std::get<double>(aVal);
+                    QUICKEN(OP_GREATER_NUM);
+                    double b = bVal.asNumber();
+                    double a = aVal.asNumber();
                     stack.emplace_back(a > b);
                 }
                 else
@@ -595,19 +1591,20 @@ void VM::run()
                     runtimeError("Operands must be numbers for comparison.");
                     return;
                 }
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_LESS:
+        CASE(OP_LESS):
             {
                 Value bVal = stack.back();
                 stack.pop_back();
                 Value aVal = stack.back();
                 stack.pop_back();
 
-                if (std::holds_alternative<double>(aVal) && std::holds_alternative<double>(bVal))
+                if (aVal.isNumber() && bVal.isNumber())
                 {
-                    double b = std::get<double>(bVal);
-                    double a = std::get<double>(aVal);
+                    QUICKEN(OP_LESS_NUM);
+                    double b = bVal.asNumber();
+                    double a = aVal.asNumber();
                     stack.emplace_back(a < b);
                 }
                 else
@@ -615,90 +1612,189 @@ void VM::run()
                     runtimeError("Operands must be numbers for comparison.");
                     return;
                 }
-                break;
+                DISPATCH();
             }
+        CASE(OP_GREATER_EQUAL):
+            {
+                Value bVal = stack.back();
+                stack.pop_back();
+                Value aVal = stack.back();
+                stack.pop_back();
 
-        case OpCode::OP_ADD:
+                if (aVal.isNumber() && bVal.isNumber())
+                {
+                    QUICKEN(OP_GREATER_EQUAL_NUM);
+                    double b = bVal.asNumber();
+                    double a = aVal.asNumber();
+                    stack.emplace_back(a >= b);
+                }
+                else
+                {
+                    runtimeError("Operands must be numbers for comparison.");
+                    return;
+                }
+                DISPATCH();
+            }
+        CASE(OP_LESS_EQUAL):
             {
-                Value b = stack.back();
+                Value bVal = stack.back();
                 stack.pop_back();
-                Value a = stack.back();
+                Value aVal = stack.back();
                 stack.pop_back();
-                if (isObjType(a, ObjType::STRING) || isObjType(b, ObjType::STRING))
+
+                if (aVal.isNumber() && bVal.isNumber())
+                {
+                    QUICKEN(OP_LESS_EQUAL_NUM);
+                    double b = bVal.asNumber();
+                    double a = aVal.asNumber();
+                    stack.emplace_back(a <= b);
+                }
+                else
+                {
+                    runtimeError("Operands must be numbers for comparison.");
+                    return;
+                }
+                DISPATCH();
+            }
+
+        CASE(OP_ADD):
+            {
+                const size_t top = stack.size();
+                const Value b = stack[top - 1];
+                const Value a = stack[top - 2];
+                if (isStringLike(a) || isStringLike(b))
                 {
-                    std::string sa = valToString(a);
-                    std::string sb = valToString(b);
-                    stack.emplace_back(newString(sa + sb));
+                    if (isStringLike(a) && isStringLike(b)) QUICKEN(OP_ADD_STR);
+                    concatenate();
                 }
-                else if (std::holds_alternative<double>(a) && std::holds_alternative<double>(b))
+                else if (a.isNumber() && b.isNumber())
                 {
-                    stack.emplace_back(std::get<double>(a) + std::get<double>(b));
+                    QUICKEN(OP_ADD_NUM);
+                    stack[top - 2] = a.asNumber() + b.asNumber();
+                    stack.pop_back();
                 }
-                else if (std::holds_alternative<bool>(a) || std::holds_alternative<bool>(b))
+                else if (a.isBool() || b.isBool())
                 {
                     // 布尔类型转换为字符串进行拼接
-                    std::string sa = valToString(a);
-                    std::string sb = valToString(b);
-                    stack.emplace_back(newString(sa + sb));
+                    concatenate();
                 }
                 else
                 {
                     runtimeError("Operands must be two numbers or two strings.");
                     return;
                 }
-                break;
+                DISPATCH();
+            }
+        CASE(OP_ADD_NUM):
+            {
+                const size_t top = stack.size();
+                const Value b = stack[top - 1];
+                const Value a = stack[top - 2];
+                if (!a.isNumber() || !b.isNumber()) DEOPTIMIZE(OP_ADD);
+                stack[top - 2] = a.asNumber() + b.asNumber();
+                stack.pop_back();
+                DISPATCH();
+            }
+        CASE(OP_ADD_STR):
+            {
+                const size_t top = stack.size();
+                const Value b = stack[top - 1];
+                const Value a = stack[top - 2];
+                if (!isStringLike(a) || !isStringLike(b)) DEOPTIMIZE(OP_ADD);
+                concatenate();
+                DISPATCH();
+            }
+        CASE(OP_LESS_NUM):
+            {
+                const size_t top = stack.size();
+                const Value b = stack[top - 1];
+                const Value a = stack[top - 2];
+                if (!a.isNumber() || !b.isNumber()) DEOPTIMIZE(OP_LESS);
+                stack[top - 2] = a.asNumber() < b.asNumber();
+                stack.pop_back();
+                DISPATCH();
+            }
+        CASE(OP_GREATER_NUM):
+            {
+                const size_t top = stack.size();
+                const Value b = stack[top - 1];
+                const Value a = stack[top - 2];
+                if (!a.isNumber() || !b.isNumber()) DEOPTIMIZE(OP_GREATER);
+                stack[top - 2] = a.asNumber() > b.asNumber();
+                stack.pop_back();
+                DISPATCH();
+            }
+        CASE(OP_GREATER_EQUAL_NUM):
+            {
+                const size_t top = stack.size();
+                const Value b = stack[top - 1];
+                const Value a = stack[top - 2];
+                if (!a.isNumber() || !b.isNumber()) DEOPTIMIZE(OP_GREATER_EQUAL);
+                stack[top - 2] = a.asNumber() >= b.asNumber();
+                stack.pop_back();
+                DISPATCH();
             }
-        case OpCode::OP_SUB:
+        CASE(OP_LESS_EQUAL_NUM):
             {
-                double b = std::get<double>(stack.back());
+                const size_t top = stack.size();
+                const Value b = stack[top - 1];
+                const Value a = stack[top - 2];
+                if (!a.isNumber() || !b.isNumber()) DEOPTIMIZE(OP_LESS_EQUAL);
+                stack[top - 2] = a.asNumber() <= b.asNumber();
                 stack.pop_back();
-                double a = std::get<double>(stack.back());
+                DISPATCH();
+            }
+        CASE(OP_SUB):
+            {
+                double b = stack.back().asNumber();
+                stack.pop_back();
+                double a = stack.back().asNumber();
                 stack.pop_back();
                 stack.emplace_back(a - b);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_MUL:
+        CASE(OP_MUL):
             {
-                double b = std::get<double>(stack.back());
+                double b = stack.back().asNumber();
                 stack.pop_back();
-                double a = std::get<double>(stack.back());
+                double a = stack.back().asNumber();
                 stack.pop_back();
                 stack.emplace_back(a * b);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_DIV:
+        CASE(OP_DIV):
             {
-                double b = std::get<double>(stack.back());
+                double b = stack.back().asNumber();
                 stack.pop_back();
-                double a = std::get<double>(stack.back());
+                double a = stack.back().asNumber();
                 stack.pop_back();
                 stack.emplace_back(a / b);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_NOT:
+        CASE(OP_NOT):
             {
                 Value v = stack.back();
                 stack.pop_back();
                 stack.emplace_back(!toBool(v));
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_MOD:
+        CASE(OP_MOD):
             {
-                double b = std::get<double>(stack.back());
+                double b = stack.back().asNumber();
                 stack.pop_back();
-                double a = std::get<double>(stack.back());
+                double a = stack.back().asNumber();
                 stack.pop_back();
                 stack.emplace_back(fmod(a, b));
-                break;
+                DISPATCH();
             }
 
-        case OpCode::OP_JUMP:
+        CASE(OP_JUMP):
             {
                 uint16_t o = (frame->ip[0] << 8) | frame->ip[1];
                 frame->ip += 2 + o;
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_JUMP_IF_FALSE:
+        CASE(OP_JUMP_IF_FALSE):
             {
                 uint16_t o = (frame->ip[0] << 8) | frame->ip[1];
                 frame->ip += 2;
@@ -706,9 +1802,9 @@ void VM::run()
                 // stack.pop_back(); // 弹出值
                 if (!toBool(v))
                     frame->ip += o;
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_JUMP_IF_TRUE:
+        CASE(OP_JUMP_IF_TRUE):
             {
                 uint16_t o = (frame->ip[0] << 8) | frame->ip[1];
                 frame->ip += 2;
@@ -716,243 +1812,63 @@ void VM::run()
                 // stack.pop_back(); // 弹出值
                 if (toBool(v))
                     frame->ip += o;
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_LOOP:
+        CASE(OP_LOOP):
             {
                 uint16_t o = (frame->ip[0] << 8) | frame->ip[1];
                 frame->ip = frame->ip + 2 - o; // 修正跳转计算
-                break;
-            }
-
-        case OpCode::OP_CALL:
-            {
-                int argc = READ_BYTE();
-                int calleeSlot = stack.size() - 1 - argc;
-                if (Value callee = stack[calleeSlot]; isObjType(callee, ObjType::CLOSURE))
+                // 循环足够热时从循环头转入机器码，之后在去优化记录指出的位置继续
+                if (ObjFunction* fn = frame->closure->function; ++fn->loopCount >= jitThreshold && jitEnabled)
                 {
-                    auto* cl = dynamic_cast<ObjClosure*>(std::get<Obj*>(callee));
-
-                    if (cl->function->jitFunction == nullptr && jitEnabled)
-                    {
-                        JitCompiler::JitFn jitFn = jit.compile(&cl->function->chunk);
-                        if (jitFn != nullptr)
-                        {
-                            cl->function->jitFunction = reinterpret_cast<void*>(jitFn);
-                            debug_log("JIT开始编译函数{} ", cl->function->name);
-                        }
-                        else
-                        {
-                            debug_log("JIT编译函数{} 失败，回退到解释器", cl->function->name);
-                        }
-                    }
-
-                    // 如果有 JIT 函数，执行 JIT 代码
-                    if (cl->function->jitFunction != nullptr && jitEnabled)
-                    {
-                        debug_log("执行 JIT 函数 {} ", cl->function->name);
-                        // 准备参数
-                        double args[256]; // 假设最多 256 个参数
-                        for (int i = 0; i < argc; ++i)
-                        {
-                            if (std::holds_alternative<double>(stack[calleeSlot + 1 + i]))
-                            {
-                                args[i] = std::get<double>(stack[calleeSlot + 1 + i]);
-                            }
-                            else
-                            {
-                                // 如果参数不是数字，回退到解释器执行
-                                frames.push_back({cl, cl->function->chunk.code.data(), calleeSlot});
-                                frame = &frames.back();
-                                goto call_end;
-                            }
-                        }
-
-                        // 调用 JIT 函数
-                        auto jitFn = reinterpret_cast<JitCompiler::JitFn>(cl->function->jitFunction);
-                        double result;
-                        try
-                        {
-                            result = jitFn(args);
-                        }
-                        catch (const std::exception& e)
-                        {
-                            std::cout << "JIT函数执行异常: " << e.what() << std::endl;
-                            frames.push_back({cl, cl->function->chunk.code.data(), calleeSlot});
-                            frame = &frames.back();
-                            goto call_end;
-                        }
-                        catch (...)
-                        {
-                            std::cout << "JIT函数执行未知异常" << std::endl;
-                            frames.push_back({cl, cl->function->chunk.code.data(), calleeSlot});
-                            frame = &frames.back();
-                            goto call_end;
-                        }
-
-                        // 处理返回值
-                        if (calleeSlot < 0 || static_cast<size_t>(calleeSlot) > stack.size())
-                        {
-                            frames.push_back({cl, cl->function->chunk.code.data(), calleeSlot});
-                            frame = &frames.back();
-                            goto call_end;
-                        }
-                        if (static_cast<size_t>(calleeSlot) > stack.size())
-                        {
-                            stack.clear();
-                        }
-                        else
-                        {
-                            stack.resize(calleeSlot);
-                        }
-                        stack.emplace_back(result);
-                        debug_log("JIT函数{}调用成功", cl->function->name);
-                    }
-                    else
+                    if (enterOSR())
                     {
-                        // 没有 JIT 函数，回退到解释器执行
-                        frames.push_back({cl, cl->function->chunk.code.data(), calleeSlot});
                         frame = &frames.back();
                     }
-                }
-                else if (isObjType(callee, ObjType::NATIVE))
-                {
-                    auto* n = dynamic_cast<ObjNative*>(std::get<Obj*>(callee));
-                    Value* args = &stack[calleeSlot + 1];
-                    Value res = n->function(argc, args);
-
-                    if (calleeSlot < 0 || static_cast<size_t>(calleeSlot) > stack.size())
-                    {
-                        stack.clear();
-                    }
-                    else
-                    {
-                        stack.resize(calleeSlot);
-                    }
-                    stack.push_back(res);
-
-                    frame = &frames.back();
-                }
-                else if (isObjType(callee, ObjType::CLASS))
-                {
-                    auto* klass = dynamic_cast<ObjClass*>(std::get<Obj*>(callee));
-
-                    ObjInstance* instance;
-                    if (klass->isNative)
-                    {
-                        instance = allocate<ObjNativeInstance>(klass);
-                    }
                     else
                     {
-                        instance = allocate<ObjInstance>(klass);
-                    }
-
-                    stack[calleeSlot] = instance;
-
-                    if (klass->nativeMethods.contains("constructor"))
-                    {
-                        ObjNative* init = klass->nativeMethods["constructor"];
-                        Value* args = &stack[calleeSlot + 1];
-                        // 调用原生 init，args[-1] 是刚创建的 instance
-                        init->function(argc, args);
-
-                        if (calleeSlot < 0 || static_cast<size_t>(calleeSlot) > stack.size())
-                        {
-                            stack.clear();
-                        }
-                        else
-                        {
-                            stack.resize(calleeSlot);
-                        }
-                        stack.emplace_back(instance); // 构造函数返回实例
-                        frame = &frames.back();
-                    }
-                    else if (klass->methods.contains("constructor"))
-                    {
-                        ObjClosure* init = klass->methods["constructor"];
-                        // 创建帧，开始执行 init 方法
-                        frames.push_back({init, init->function->chunk.code.data(), calleeSlot});
-                        frame = &frames.back();
-                    }
-                    else if (argc != 0)
-                    {
-                        runtimeError(("Expected 0 arguments but got " + std::to_string(argc) + ".").c_str());
-                        return;
+                        // 编译失败或仍在后台编译时重新计数，避免之后每次回边都查找 OSR 入口
+                        fn->loopCount = 0;
                     }
                 }
-                else if (isObjType(callee, ObjType::BOUND_METHOD))
-                {
-                    auto* bound = dynamic_cast<ObjBoundMethod*>(std::get<Obj*>(callee));
-                    stack[calleeSlot] = bound->receiver;
+                DISPATCH();
+            }
 
-                    if (bound->method->type == ObjType::CLOSURE)
-                    {
-                        auto* closure = dynamic_cast<ObjClosure*>(bound->method);
-                        frames.push_back({closure, closure->function->chunk.code.data(), calleeSlot});
-                        frame = &frames.back();
-                    }
-                    else if (bound->method->type == ObjType::NATIVE)
-                    {
-                        auto* native = dynamic_cast<ObjNative*>(bound->method);
-                        Value* args = &stack[calleeSlot + 1];
-                        Value res = native->function(argc, args);
-                        if (calleeSlot < 0 || static_cast<size_t>(calleeSlot) > stack.size())
-                        {
-                            stack.clear();
-                        }
-                        else
-                        {
-                            stack.resize(calleeSlot);
-                        }
-                        stack.push_back(res);
-                        frame = &frames.back();
-                    }
-                }
-                else
-                {
-                    if (std::holds_alternative<std::monostate>(callee))
-                    {
-                        std::cerr << "Call failed: callee is null\n";
-                    }
-                    else if (std::holds_alternative<bool>(callee))
-                    {
-                        std::cerr << "Call failed: callee is boolean (" << std::get<bool>(callee) << ")\n";
-                    }
-                    else if (std::holds_alternative<double>(callee))
-                    {
-                        std::cerr << "Call failed: callee is number (" << std::get<double>(callee) << ")\n";
-                    }
-                    else if (std::holds_alternative<Obj*>(callee))
-                    {
-                        auto* obj = std::get<Obj*>(callee);
-                        std::cerr << "Call failed: callee is Obj* of type " << static_cast<int>(obj->type) << "\n";
-                    }
-                    return;
-                }
-            call_end:
-                break;
+        CASE(OP_CALL):
+            {
+                if (!callValue(READ_BYTE())) return;
+                frame = &frames.back();
+                DISPATCH();
+            }
+        CASE(OP_INVOKE):
+            {
+                auto* name = objAs<ObjString>(READ_CONST());
+                PropertyCache& cache = READ_CACHE();
+                if (!invoke(name, cache, READ_BYTE())) return;
+                frame = &frames.back();
+                DISPATCH();
             }
-        case OpCode::OP_NEW:
+        CASE(OP_NEW):
             {
                 int argc = READ_BYTE();
                 int calleeSlot = stack.size() - 1 - argc;
 
                 // 获取类名
                 Value callee = stack[calleeSlot];
-                if (!std::holds_alternative<Obj*>(callee))
+                if (!callee.isObj())
                 {
                     runtimeError("Class name must be a class object.");
                     return;
                 }
 
-                auto obj = std::get<Obj*>(callee);
+                auto obj = callee.asObj();
                 if (!isObjType(callee, ObjType::CLASS))
                 {
                     runtimeError("Can only use 'new' with a class.");
                     return;
                 }
 
-                auto* klass = dynamic_cast<ObjClass*>(obj);
+                auto* klass = objAs<ObjClass>(obj);
 
                 // 创建实例
                 ObjInstance* instance;
@@ -969,9 +1885,9 @@ void VM::run()
                 stack[calleeSlot] = instance;
 
                 // 调用 constructor 方法
-                if (klass->nativeMethods.contains("constructor"))
+                if (klass->nativeMethods.contains(constructorString))
                 {
-                    ObjNative* init = klass->nativeMethods["constructor"];
+                    ObjNative* init = klass->nativeMethods[constructorString];
                     Value* args = &stack[calleeSlot + 1];
                     // 调用原生 init，args[-1] 是刚创建的 instance
                     init->function(argc, args);
@@ -986,9 +1902,9 @@ void VM::run()
                     }
                     stack.emplace_back(instance); // 构造函数返回实例
                 }
-                else if (klass->methods.contains("constructor"))
+                else if (klass->methods.contains(constructorString))
                 {
-                    ObjClosure* init = klass->methods["constructor"];
+                    ObjClosure* init = klass->methods[constructorString];
                     // 创建帧，开始执行 init 方法
                     frames.push_back({init, init->function->chunk.code.data(), calleeSlot});
                     frame = &frames.back();
@@ -999,18 +1915,18 @@ void VM::run()
                     return;
                 }
 
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_CLOSURE:
+        CASE(OP_CLOSURE):
             {
                 auto t = READ_CONST();
 
                 // 检查常量是否可以转换为函数类型
                 ObjFunction* func = nullptr;
 
-                if (std::holds_alternative<Obj*>(t))
+                if (t.isObj())
                 {
-                    func = dynamic_cast<ObjFunction*>(std::get<Obj*>(t));
+                    func = objCast<ObjFunction>(t);
                 }
 
                 // 如果不是有效的函数类型，尝试获取当前任务回调的函数（用于事件循环执行）
@@ -1035,15 +1951,19 @@ void VM::run()
                 {
                     uint8_t isLocal = READ_BYTE();
                     uint8_t idx = READ_BYTE();
+                    prepareWrite(cl);
                     if (isLocal) cl->upvalues.push_back(captureUpvalue(&stack[frame->slots + idx]));
                     else cl->upvalues.push_back(frame->closure->upvalues[idx]);
+                    // 捕获上值可能分配对象，闭包此时可能已被晋升
+                    writeBarrier(cl, cl->upvalues.back());
                 }
-                break;
+                accountPayload(cl);
+                DISPATCH();
             }
-        case OpCode::OP_CLOSE_UPVALUE: closeUpvalues(&stack.back());
+        CASE(OP_CLOSE_UPVALUE): closeUpvalues(&stack.back());
             stack.pop_back();
-            break;
-        case OpCode::OP_RETURN:
+            DISPATCH();
+        CASE(OP_RETURN):
             {
                 Value res = stack.back();
                 stack.pop_back();
@@ -1087,9 +2007,9 @@ void VM::run()
                 }
                 stack.push_back(res);
                 frame = &frames.back();
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_BUILD_LIST:
+        CASE(OP_BUILD_LIST):
             {
                 int count = READ_BYTE();
                 auto* list = allocate<ObjList>(); // 创建对象
@@ -1097,43 +2017,60 @@ void VM::run()
                 for (int i = count - 1; i >= 0; i--)
                 {
                     list->elements[i] = stack.back();
+                    list->noteElement(stack.back());
                     stack.pop_back();
                 }
+                accountPayload(list);
                 stack.emplace_back(list);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_BUILD_OBJECT:
+        CASE(OP_BUILD_OBJECT):
             {
-                int count = READ_BYTE();
-                
-                auto* objClass = allocate<ObjClass>("<object>");
-                auto* instance = allocate<ObjInstance>(objClass);
-                for (int i = 0; i < count; i++)
+                const int count = READ_BYTE();
+                ObjFunction* function = frame->closure->function;
+                ObjectLiteral& literal = function->chunk.objectLiterals[READ_SHORT()];
+                if (!literal.klass)
                 {
-                    Value value = stack.back();
-                    stack.pop_back();
-                    Value keyVal = stack.back();
-                    stack.pop_back();
+                    // 首次执行时创建共享的类，由字面量模板保持存活
+                    auto* objClass = allocate<ObjClass>("<object>");
+                    prepareWrite(function);
+                    literal.klass = objClass;
+                    writeBarrier(function, objClass);
+                }
+                auto* instance = allocate<ObjInstance>(literal.klass);
 
-                    // key 应该是字符串
-                    if (!isObjType(keyVal, ObjType::STRING))
+                const size_t base = stack.size() - count;
+                if (literal.shape)
+                {
+                    // 形状已知：新实例直接采用最终形状，按槽位写入属性值
+                    instance->shape = literal.shape;
+                    instance->fields.resize(literal.shape->slotCount);
+                    for (int i = 0; i < count; i++) instance->fields[literal.slots[i]] = stack[base + i];
+                    accountPayload(instance);
+                }
+                else
+                {
+                    // 按源码顺序添加属性，使实例形状与属性定义顺序一致
+                    instance->fields.reserve(count);
+                    for (int i = 0; i < count; i++) setField(instance, literal.keys[i], stack[base + i]);
+                    if (!instance->shape->isDictionary)
                     {
-                        runtimeError("Object property key must be a string.");
-                        continue;
+                        literal.shape = instance->shape;
+                        literal.slots.resize(count);
+                        for (int i = 0; i < count; i++)
+                        {
+                            literal.slots[i] = static_cast<uint32_t>(literal.shape->lookup(literal.keys[i]));
+                        }
                     }
-
-                    const std::string key = std::get<Obj*>(keyVal) != nullptr
-                        ? dynamic_cast<ObjString*>(std::get<Obj*>(keyVal))->chars
-                        : "";
-
-                    instance->fields[key] = value;
                 }
+                stack.resize(base);
 
                 stack.emplace_back(instance);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_GET_SUBSCRIPT:
+        CASE(OP_GET_SUBSCRIPT):
             {
+                flattenAt(stack.size() - 1);
                 Value indexVal = stack.back();
                 stack.pop_back();
                 Value listVal = stack.back();
@@ -1145,19 +2082,19 @@ void VM::run()
 
                 if (isInstance && isString)
                 {
-                    auto* instance = dynamic_cast<ObjInstance*>(std::get<Obj*>(listVal));
-                    const std::string key = dynamic_cast<ObjString*>(std::get<Obj*>(indexVal))->chars;
+                    auto* instance = objAs<ObjInstance>(listVal);
+                    auto* key = objAs<ObjString>(indexVal);
 
-                    if (instance->fields.contains(key))
+                    if (Value field; instance->getField(key, field))
                     {
-                        stack.push_back(instance->fields[key]);
+                        stack.push_back(field);
                     }
                     else
                     {
-                        runtimeError(("Undefined property '" + key + "'.").c_str());
+                        runtimeError(("Undefined property '" + key->chars + "'.").c_str());
                         return;
                     }
-                    break;
+                    DISPATCH();
                 }
 
                 // 原有的数组访问逻辑
@@ -1166,14 +2103,14 @@ void VM::run()
                     runtimeError("Operands must be a list.");
                     return;
                 }
-                if (!std::holds_alternative<double>(indexVal))
+                if (!indexVal.isNumber())
                 {
                     runtimeError("Index must be a number.");
                     return;
                 }
 
-                auto* list = dynamic_cast<ObjList*>(std::get<Obj*>(listVal));
-                int index = static_cast<int>(std::get<double>(indexVal));
+                auto* list = objAs<ObjList>(listVal);
+                int index = static_cast<int>(indexVal.asNumber());
 
                 if (index < 0 || index >= list->elements.size())
                 {
@@ -1182,10 +2119,11 @@ void VM::run()
                 }
 
                 stack.push_back(list->elements[index]);
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_SET_SUBSCRIPT:
+        CASE(OP_SET_SUBSCRIPT):
             {
+                flattenAt(stack.size() - 2);
                 Value val = stack.back();
                 stack.pop_back();
                 Value indexVal = stack.back();
@@ -1196,12 +2134,10 @@ void VM::run()
                 // 检查是否是对象属性设置：obj[key] = value where key is string
                 if (isObjType(listVal, ObjType::INSTANCE) && isObjType(indexVal, ObjType::STRING))
                 {
-                    auto* instance = dynamic_cast<ObjInstance*>(std::get<Obj*>(listVal));
-                    const std::string key = dynamic_cast<ObjString*>(std::get<Obj*>(indexVal))->chars;
-
-                    instance->fields[key] = val;
+                    auto* instance = objAs<ObjInstance>(listVal);
+                    setField(instance, objAs<ObjString>(indexVal), val);
                     stack.push_back(val); // 赋值表达式返回赋的值
-                    break;
+                    DISPATCH();
                 }
 
                 // 原有的数组设置逻辑
@@ -1210,8 +2146,8 @@ void VM::run()
                     runtimeError("Operands must be a list.");
                     return;
                 }
-                auto* list = dynamic_cast<ObjList*>(std::get<Obj*>(listVal));
-                int index = static_cast<int>(std::get<double>(indexVal));
+                auto* list = objAs<ObjList>(listVal);
+                int index = static_cast<int>(indexVal.asNumber());
 
                 if (index < 0 || index >= list->elements.size())
                 {
@@ -1219,43 +2155,102 @@ void VM::run()
                     return;
                 }
 
-                list->elements[index] = val;
+                if (list->isPackedDouble() && val.isNumber())
+                {
+                    // 数字写入只含数字的数组：既不覆盖引用也不产生引用，无需屏障
+                    list->elements[index] = val;
+                }
+                else
+                {
+                    prepareWrite(list);
+                    list->elements[index] = val;
+                    list->noteElement(val);
+                    writeBarrier(list, val);
+                }
                 stack.push_back(val); // 赋值表达式返回赋的值
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_CLASS:
+        CASE(OP_CLASS):
             {
-                std::string name = dynamic_cast<ObjString*>(std::get<Obj*>(READ_CONST()))->chars;
+                std::string name = objAs<ObjString>(READ_CONST())->chars;
                 stack.emplace_back(allocate<ObjClass>(name));
-                break;
+                DISPATCH();
             }
-        case OpCode::OP_METHOD:
+        CASE(OP_METHOD):
             {
-                std::string name = dynamic_cast<ObjString*>(std::get<Obj*>(READ_CONST()))->chars;
+                auto* name = objAs<ObjString>(READ_CONST());
                 Value methodVal = stack.back();
                 stack.pop_back();
-                auto* klass = dynamic_cast<ObjClass*>(std::get<Obj*>(stack.back()));
-                klass->methods[name] = dynamic_cast<ObjClosure*>(std::get<Obj*>(methodVal));
-                break;
+                auto* klass = objAs<ObjClass>(stack.back());
+                prepareWrite(klass);
+                klass->methods[name] = objAs<ObjClosure>(methodVal);
+                writeBarrier(klass, methodVal);
+                writeBarrier(klass, name);
+                DISPATCH();
             }
-        case OpCode::OP_GET_PROPERTY:
+        CASE(OP_GET_PROPERTY):
             {
                 Value val = READ_CONST();
+                PropertyCache& cache = READ_CACHE();
 
-                std::string name = dynamic_cast<ObjString*>(std::get<Obj*>(val))->chars;
+                auto* name = objAs<ObjString>(val);
                 Value objVal = stack.back();
 
+                // 内联缓存：按实例形状或类查找上次解析的结果
+                const void* cacheKey = nullptr;
+                if (isObjType(objVal, ObjType::INSTANCE))
+                {
+                    cacheKey = static_cast<ObjInstance*>(objVal.asObj())->shape;
+                }
+                else if (isObjType(objVal, ObjType::CLASS))
+                {
+                    cacheKey = objVal.asObj();
+                }
+                if (cacheKey)
+                {
+                    if (const PropertyCacheEntry* entry = cache.find(cacheKey))
+                    {
+                        icStats.hits++;
+                        if (entry->kind == PropertyCacheEntry::Kind::FIELD)
+                        {
+                            stack.back() = static_cast<ObjInstance*>(objVal.asObj())->fields[entry->slot];
+                        }
+                        else if (entry->kind == PropertyCacheEntry::Kind::STATIC_NATIVE)
+                        {
+                            stack.back() = entry->method;
+                        }
+                        else
+                        {
+                            stack.back() = allocate<ObjBoundMethod>(objVal, entry->method);
+                        }
+                        DISPATCH();
+                    }
+                    icStats.misses++;
+                }
+
+                if (isObjType(objVal, ObjType::ROPE))
+                {
+                    // 绳节点记录了长度，读取 length 无需展平；其他属性按展平后的字符串处理
+                    if (name == lengthString)
+                    {
+                        stack.back() = static_cast<double>(static_cast<ObjRope*>(objVal.asObj())->length);
+                        DISPATCH();
+                    }
+                    flattenAt(stack.size() - 1);
+                    objVal = stack.back();
+                }
+
                 // 检查是否是有效的对象（实例或其他可拥有属性的对象）
-                if (std::holds_alternative<std::monostate>(objVal))
+                if (objVal.isNil())
                 {
-                    runtimeError(("Cannot read property '" + name + "' of null").c_str());
+                    runtimeError(("Cannot read property '" + name->chars + "' of null").c_str());
                     return;
                 }
-                if (!std::holds_alternative<Obj*>(objVal) ||
-                    (std::get<Obj*>(objVal)->type != ObjType::INSTANCE &&
-                        std::get<Obj*>(objVal)->type != ObjType::CLASS &&
-                        std::get<Obj*>(objVal)->type != ObjType::LIST &&
-                        std::get<Obj*>(objVal)->type != ObjType::STRING))
+                if (!objVal.isObj() ||
+                    (objVal.asObj()->type != ObjType::INSTANCE &&
+                        objVal.asObj()->type != ObjType::CLASS &&
+                        objVal.asObj()->type != ObjType::LIST &&
+                        objVal.asObj()->type != ObjType::STRING))
                 {
                     runtimeError("Only instances, classes, lists, or strings have properties.");
                     return;
@@ -1264,12 +2259,12 @@ void VM::run()
                 // 处理数组的原生方法和属性
                 if (isObjType(objVal, ObjType::LIST))
                 {
-                    if (name == "length")
+                    if (name == lengthString)
                     {
-                        auto* list = dynamic_cast<ObjList*>(std::get<Obj*>(objVal));
+                        auto* list = objAs<ObjList>(objVal);
                         stack.pop_back();
                         stack.emplace_back(static_cast<double>(list->elements.size()));
-                        break;
+                        DISPATCH();
                     }
 
                     if (listMethods.contains(name))
@@ -1278,22 +2273,22 @@ void VM::run()
                         auto* bound = allocate<ObjBoundMethod>(objVal, method);
                         stack.pop_back();
                         stack.emplace_back(bound);
-                        break;
+                        DISPATCH();
                     }
 
-                    runtimeError(("Undefined property '" + name + "' on list.").c_str());
+                    runtimeError(("Undefined property '" + name->chars + "' on list.").c_str());
                     return;
                 }
 
                 // 处理字符串的原生方法和属性
                 if (isObjType(objVal, ObjType::STRING))
                 {
-                    if (name == "length")
+                    if (name == lengthString)
                     {
-                        auto* str = dynamic_cast<ObjString*>(std::get<Obj*>(objVal));
+                        auto* str = objAs<ObjString>(objVal);
                         stack.pop_back();
                         stack.emplace_back(static_cast<double>(str->chars.length()));
-                        break;
+                        DISPATCH();
                     }
 
                     if (stringMethods.contains(name))
@@ -1302,28 +2297,32 @@ void VM::run()
                         auto* bound = allocate<ObjBoundMethod>(objVal, method);
                         stack.pop_back();
                         stack.emplace_back(bound);
-                        break;
+                        DISPATCH();
                     }
 
-                    runtimeError(("Undefined property '" + name + "' on string.").c_str());
+                    runtimeError(("Undefined property '" + name->chars + "' on string.").c_str());
                     return;
                 }
 
                 // 处理类的原生方法（静态方法）
                 if (isObjType(objVal, ObjType::CLASS))
                 {
-                    auto* klass = dynamic_cast<ObjClass*>(std::get<Obj*>(objVal));
+                    auto* klass = objAs<ObjClass>(objVal);
 
                     if (klass->nativeMethods.contains(name))
                     {
                         ObjNative* method = klass->nativeMethods[name];
+                        addCacheEntry(cache, {
+                            .key = klass, .kind = PropertyCacheEntry::Kind::STATIC_NATIVE, .method = method,
+                            .holder = klass
+                        });
                         // 对于静态方法，不绑定 this，直接返回方法
                         stack.pop_back();
                         stack.emplace_back(method);
-                        break;
+                        DISPATCH();
                     }
 
-                    runtimeError(("Undefined static property '" + name + "' on class.").c_str());
+                    runtimeError(("Undefined static property '" + name->chars + "' on class.").c_str());
                     return;
                 }
 
@@ -1332,43 +2331,30 @@ void VM::run()
                     runtimeError("Only instances have properties.");
                     return;
                 }
-                auto* instance = dynamic_cast<ObjInstance*>(std::get<Obj*>(objVal));
+                auto* instance = objAs<ObjInstance>(objVal);
 
-                // 查找字段
-                if (instance->fields.contains(name))
+                // 查找字段和方法（方法绑定 this）
+                PropertyCacheEntry entry;
+                if (!resolveInstanceProperty(instance, name, cache, entry))
                 {
-                    stack.pop_back(); // 弹出对象
-                    stack.push_back(instance->fields[name]);
-                    break;
+                    runtimeError(("Undefined property '" + name->chars + "'.").c_str());
+                    return;
                 }
-
-                // 查找原生方法 (绑定 this)
-                if (instance->klass->nativeMethods.contains(name))
+                if (entry.kind == PropertyCacheEntry::Kind::FIELD)
                 {
-                    ObjNative* method = instance->klass->nativeMethods[name];
-                    auto* bound = allocate<ObjBoundMethod>(objVal, method);
-                    stack.pop_back();
-                    stack.emplace_back(bound);
-                    break;
+                    stack.back() = instance->fields[entry.slot];
                 }
-
-                // 查找方法 (绑定 this)
-                if (instance->klass->methods.contains(name))
+                else
                 {
-                    ObjClosure* method = instance->klass->methods[name];
-                    auto* bound = allocate<ObjBoundMethod>(objVal, method);
-                    stack.pop_back();
-                    stack.emplace_back(bound);
-                    break;
+                    stack.back() = allocate<ObjBoundMethod>(objVal, entry.method);
                 }
-
-                runtimeError(("Undefined property '" + name + "'.").c_str());
-                return;
+                DISPATCH();
             }
-        case OpCode::OP_SET_PROPERTY:
+        CASE(OP_SET_PROPERTY):
             {
                 Value val = READ_CONST();
-                std::string name = dynamic_cast<ObjString*>(std::get<Obj*>(val))->chars;
+                PropertyCache& cache = READ_CACHE();
+                auto* name = objAs<ObjString>(val);
                 Value value = stack.back();
                 stack.pop_back();
                 Value objVal = stack.back();
@@ -1379,12 +2365,62 @@ void VM::run()
                     runtimeError("Only instances have fields.");
                     return;
                 }
-                auto* instance = dynamic_cast<ObjInstance*>(std::get<Obj*>(objVal));
-                instance->fields[name] = value;
+                auto* instance = static_cast<ObjInstance*>(objVal.asObj());
+
+                // 内联缓存：已有字段直接写槽位，新字段直接沿缓存的转换前进
+                if (const PropertyCacheEntry* entry = cache.find(instance->shape))
+                {
+                    icStats.hits++;
+                    prepareWrite(instance);
+                    if (entry->kind == PropertyCacheEntry::Kind::ADD_FIELD)
+                    {
+                        instance->shape = entry->nextShape;
+                        instance->fields.push_back(value);
+                        accountPayload(instance);
+                    }
+                    else
+                    {
+                        instance->fields[entry->slot] = value;
+                    }
+                    writeBarrier(instance, value);
+                    stack.push_back(value);
+                    DISPATCH();
+                }
+                icStats.misses++;
+
+                Shape* oldShape = instance->shape;
+                setField(instance, name, value);
+                if (!oldShape->isDictionary && !instance->shape->isDictionary)
+                {
+                    if (instance->shape == oldShape)
+                    {
+                        addCacheEntry(cache, {
+                            .key = oldShape, .kind = PropertyCacheEntry::Kind::FIELD,
+                            .slot = static_cast<uint32_t>(oldShape->lookup(name)), .holder = instance->klass
+                        });
+                    }
+                    else
+                    {
+                        addCacheEntry(cache, {
+                            .key = oldShape, .kind = PropertyCacheEntry::Kind::ADD_FIELD,
+                            .nextShape = instance->shape, .holder = instance->klass
+                        });
+                    }
+                }
                 stack.push_back(value); // 赋值表达式的值
-                break;
+                DISPATCH();
+            }
+        CASE(OP_NEGATE):
+            if (stack.back().isNumber())
+            {
+                stack.back() = Value(-stack.back().asNumber());
             }
-        default: break;
+            DISPATCH();
+        CASE(OP_TERNARY):
+            DISPATCH();
+#if !TINY_JS_THREADED_DISPATCH
+        default: DISPATCH();
+#endif
         }
     }
 }
@@ -1395,16 +2431,27 @@ void VM::runWithFile(const std::string& filename)
     {
         // 创建一个全局 exports 对象（用于 export 语句）
         auto* exportsClass = allocate<ObjClass>("exports");
+        tempRoots.push_back(exportsClass);
         auto* exportsObj = allocate<ObjInstance>(exportsClass);
-        globals["exports"] = exportsObj;
+        popTempRoot();
+        defineGlobal(exportsString, exportsObj);
 
         Scanner scanner(source);
         const auto tokens = scanner.scanTokens();
         Parser parser(tokens, filename);
         const auto stmts = parser.parse();
         Compiler compiler(*this);
-        ObjFunction* script = compiler.compile(stmts);
-        this->interpret(script);
+        try
+        {
+            ObjFunction* script = compiler.compile(stmts);
+            this->interpret(script);
+        }
+        catch (const std::exception& e)
+        {
+            // 内存不足等无法在脚本内恢复的错误
+            runtimeError(e.what());
+            return;
+        }
 
         // 运行事件循环，处理所有异步任务
         runEventLoop();
@@ -1415,6 +2462,28 @@ void VM::runWithFile(const std::string& filename)
     }
 }
 
+void VM::printInlineCacheStats() const
+{
+    size_t monomorphic = 0, polymorphic = 0, megamorphic = 0;
+    heap.forEachCell([&](void* cell)
+    {
+        const auto* o = static_cast<const Obj*>(cell);
+        if (o->type != ObjType::FUNCTION) return;
+        for (const auto& cache : static_cast<const ObjFunction*>(o)->chunk.propertyCaches)
+        {
+            if (cache.megamorphic) megamorphic++;
+            else if (cache.count > 1) polymorphic++;
+            else if (cache.count == 1) monomorphic++;
+        }
+    });
+    const uint64_t total = icStats.hits + icStats.misses;
+    std::cerr << "[IC] hits: " << icStats.hits << ", misses: " << icStats.misses
+        << ", hit rate: " << (total ? 100.0 * static_cast<double>(icStats.hits) / static_cast<double>(total) : 0.0)
+        << "%" << std::endl;
+    std::cerr << "[IC] monomorphic: " << monomorphic << ", polymorphic: " << polymorphic
+        << ", megamorphic: " << megamorphic << std::endl;
+}
+
 void VM::waitForAsyncTasks()
 {
     std::lock_guard lock(asyncTasksMutex);
@@ -1434,6 +2503,9 @@ void VM::runEventLoop()
     // 运行事件循环，直到所有定时器都被清除
     while (true)
     {
+        // 在回调之间推进增量回收，避免停顿落在回调执行中
+        if (gcPhase != GCPhase::IDLE) incrementalStep();
+
         std::unique_lock lock(eventQueueMutex);
 
         // 等待新任务或超时
@@ -1485,24 +2557,42 @@ void VM::runEventLoop()
                     continue; // 跳过无效任务
                 }
 
-                // 确保任务执行的堆栈是空的
-                stack.clear();
-                frames.clear();
+                // 已清除的 interval 回调可能已被回收，队列中残留的任务直接丢弃
+                const bool cleared = task.isInterval && !intervalCallbacks.contains(task.intervalId);
+                if (!cleared)
+                {
+                    // 确保任务执行的堆栈是空的
+                    stack.clear();
+                    frames.clear();
 
-                // 执行任务回调
-                callAndRun(task.callback);
+                    // 执行任务回调
+                    callAndRun(task.callback);
 
-                // 再次确保任务执行后的堆栈状态
-                stack.clear();
-                frames.clear();
+                    // 再次确保任务执行后的堆栈状态
+                    stack.clear();
+                    frames.clear();
+                }
             }
             catch (const std::exception& e)
             {
+                std::cerr << "Runtime Error: " << e.what() << "\n";
+                stack.clear();
+                frames.clear();
                 // 如果是 interval 任务出错，清除它
                 if (task.isInterval)
                 {
                     std::lock_guard intervalLock(intervalIdsMutex);
                     intervalIds.erase(task.intervalId);
+                    intervalCallbacks.erase(task.intervalId);
+                }
+            }
+
+            // 一次性定时器执行完毕，回调不再需要保持可达
+            if (!task.isInterval)
+            {
+                if (const auto it = timeoutCallbacks.find(task.callback); it != timeoutCallbacks.end())
+                {
+                    timeoutCallbacks.erase(it);
                 }
             }
 
@@ -0,0 +1,65 @@
+#include "worker_pool.h"
+
+void WorkerPool::resize(const unsigned n)
+{
+    if (n == threadCount) return;
+    stop();
+    threadCount = std::max(1u, n);
+}
+
+void WorkerPool::run(const std::function<void(unsigned)>& task)
+{
+    if (threadCount == 1)
+    {
+        task(0);
+        return;
+    }
+    if (threads.empty())
+    {
+        stopping = false;
+        for (unsigned i = 1; i < threadCount; i++) threads.emplace_back(&WorkerPool::workerLoop, this, i, generation);
+    }
+    {
+        std::lock_guard lock(mutex);
+        this->task = &task;
+        pending = threadCount - 1;
+        generation++;
+    }
+    startCV.notify_all();
+    task(0);
+    std::unique_lock lock(mutex);
+    doneCV.wait(lock, [this] { return pending == 0; });
+    this->task = nullptr;
+}
+
+void WorkerPool::stop()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    startCV.notify_all();
+    for (auto& t : threads) t.join();
+    threads.clear();
+}
+
+void WorkerPool::workerLoop(const unsigned index, uint64_t seen)
+{
+    while (true)
+    {
+        const std::function<void(unsigned)>* current;
+        {
+            std::unique_lock lock(mutex);
+            startCV.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            current = task;
+        }
+        (*current)(index);
+        {
+            std::lock_guard lock(mutex);
+            pending--;
+        }
+        doneCV.notify_one();
+    }
+}
@@ -0,0 +1,343 @@
+#include "vm.h"
+#include "compiler.h"
+#include "parser.h"
+#include "scanner.h"
+#include "test_check.h"
+#include <iostream>
+
+// 统计老年代中的列表对象
+size_t countOldLists(const VM& vm)
+{
+    size_t count = 0;
+    vm.heap.forEachCell([&](void* cell)
+    {
+        const auto* o = static_cast<const Obj*>(cell);
+        if (!o->isYoung && o->type == ObjType::LIST) count++;
+    });
+    return count;
+}
+
+void testHeap()
+{
+    std::cout << "=== 测试对象堆 ===" << std::endl;
+
+    Heap heap;
+    void* a = heap.allocate(40);
+    void* b = heap.allocate(40);
+    void* c = heap.allocate(24);
+    check("按 16 字节对齐", reinterpret_cast<uintptr_t>(a) % Heap::ALIGNMENT == 0 &&
+          reinterpret_cast<uintptr_t>(c) % Heap::ALIGNMENT == 0);
+    check("同尺寸类顺序分配", static_cast<char*>(b) - static_cast<char*>(a) == 48);
+    check("单元大小", Heap::allocationSize(a) == 48 && Heap::allocationSize(c) == 32);
+    check("新生代字节数", heap.nurseryBytes() == 48 + 48 + 32);
+
+    // 标记位在块头的位图中，释放单元时一并清除
+    check("标记位图", Heap::mark(a) && !Heap::mark(a) && Heap::isMarked(a) && !Heap::isMarked(b));
+
+    // 释放的单元优先被同尺寸类复用
+    heap.free(a);
+    check("复用空闲单元", heap.allocate(48) == a && !Heap::isMarked(a));
+
+    std::vector<void*> objects = {a, b, c};
+    for (int i = 0; i < 10000; i++) objects.push_back(heap.allocate(64));
+    check("写满后申请新块", heap.blockCount() > 3);
+
+    // 空块进入空闲列表，再次分配时复用而不向系统申请
+    const size_t blocks = heap.blockCount();
+    for (void* p : objects) heap.free(p);
+    objects.clear();
+    for (int i = 0; i < 10000; i++) objects.push_back(heap.allocate(64));
+    check("复用空闲块", heap.blockCount() == blocks);
+    for (void* p : objects) heap.free(p);
+}
+
+void testGenerational()
+{
+    std::cout << "=== 测试分代回收 ===" << std::endl;
+
+    VM vm;
+    auto* list = vm.allocate<ObjList>();
+    vm.tempRoots.push_back(list);
+    vm.collectGarbage();
+    check("存活对象晋升到老年代", !list->isYoung);
+
+    // 老年代对象引用新生代对象，依靠写屏障存活
+    ObjString* young = vm.newString("young-string");
+    list->push(young);
+    vm.writeBarrier(list, young);
+    check("写屏障记入记忆集", list->isRemembered && vm.rememberedSet.size() == 1);
+
+    vm.collectGarbage();
+    check("记忆集中的引用存活", vm.strings.contains(young) && !young->isYoung);
+    check("回收后清空记忆集", vm.rememberedSet.empty() && !list->isRemembered);
+
+    // 不可达的新生代对象被回收
+    const size_t before = vm.bytesAllocated;
+    for (int i = 0; i < 100; i++) vm.allocate<ObjList>();
+    vm.collectGarbage();
+    check("回收不可达的新生代对象", vm.bytesAllocated == before);
+
+    vm.popTempRoot();
+}
+
+void testIncremental()
+{
+    std::cout << "=== 测试增量回收 ===" << std::endl;
+
+    VM vm;
+    vm.setGCMaxPause(0.001);
+    auto* list = vm.allocate<ObjList>();
+    vm.defineGlobal(vm.newString("root"), list);
+    for (int i = 0; i < 1000; i++) list->push(vm.allocate<ObjList>());
+    for (int i = 0; i < 1000; i++) vm.allocate<ObjList>();
+    vm.collectGarbage();
+
+    // 增量标记期间，已标记的对象写入未标记的老年代对象时，插入屏障将其置灰
+    vm.startIncrementalMark();
+    check("进入标记阶段", vm.gcPhase == VM::GCPhase::MARK && Heap::isMarked(list));
+    check("增量标记尚未扫描元素", !Heap::isMarked(list->elements.back().asObj()));
+    auto* moved = static_cast<ObjList*>(list->elements.back().asObj());
+    list->elements.pop_back();
+    list->elements.front() = moved;
+    vm.writeBarrier(list, moved);
+    check("插入屏障置灰", Heap::isMarked(moved));
+
+    int steps = 0;
+    while (vm.gcPhase != VM::GCPhase::IDLE && steps < 100000)
+    {
+        vm.incrementalStep();
+        steps++;
+    }
+    check("增量回收完成", vm.gcPhase == VM::GCPhase::IDLE && vm.gcStats.fullCollections == 1);
+    check("清理后标记位复位", !Heap::isMarked(list) && !Heap::isMarked(moved));
+
+    // 可达对象全部存活，不可达对象全部释放：剩下的 999 个元素 + 根列表
+    size_t count = countOldLists(vm);
+    check("只保留可达对象", count == 1000);
+}
+
+void testConcurrent()
+{
+    std::cout << "=== 测试并发标记 ===" << std::endl;
+
+    VM vm;
+    vm.concurrentMarking = true;
+    auto* list = vm.allocate<ObjList>();
+    vm.defineGlobal(vm.newString("root"), list);
+    for (int i = 0; i < 1000; i++) list->push(vm.allocate<ObjList>());
+    for (int i = 0; i < 1000; i++) vm.allocate<ObjList>();
+    vm.collectGarbage();
+
+    vm.startConcurrentMark();
+    check("进入并发标记阶段", vm.gcPhase == VM::GCPhase::CONCURRENT_MARK && vm.marker.running());
+
+    // 修改老年代对象前记录快照：被移走的元素即使不再可达，本轮也视为存活
+    auto* moved = static_cast<ObjList*>(list->elements.back().asObj());
+    vm.prepareWrite(list);
+    check("写入前扫描对象", list->scanState == ScanState::BLACK);
+    list->elements.pop_back();
+    list->elements.front() = moved;
+    vm.writeBarrier(list, moved);
+
+    // 标记期间分配并晋升的对象视为已扫描
+    auto* fresh = vm.allocate<ObjList>();
+    vm.prepareWrite(list);
+    list->push(fresh);
+    vm.writeBarrier(list, fresh);
+    vm.collectYoung();
+    check("标记期间晋升的对象为黑色", !fresh->isYoung && fresh->scanState == ScanState::BLACK);
+
+    vm.collectFull();
+    check("并发回收完成", vm.gcPhase == VM::GCPhase::IDLE && !vm.marker.running() &&
+          vm.gcStats.fullCollections == 1);
+    check("清理后扫描状态复位", list->scanState == ScanState::WHITE && !Heap::isMarked(moved));
+
+    // 1000 个元素（被替换的第一个元素和 moved 都按快照存活）+ 根列表 + fresh
+    size_t count = countOldLists(vm);
+    check("只保留快照中可达的对象", count == 1002);
+
+    // 下一轮回收释放上一轮按快照保留的垃圾
+    vm.startConcurrentMark();
+    vm.collectFull();
+    count = countOldLists(vm);
+    check("下一轮回收快照中的垃圾", count == 1001);
+}
+
+void testParallel()
+{
+    std::cout << "=== 测试并行回收 ===" << std::endl;
+
+    VM vm;
+    vm.setGCThreads(4);
+    auto* list = vm.allocate<ObjList>();
+    vm.defineGlobal(vm.newString("root"), list);
+    // 链状结构只有一条路径，需要工作窃取才能分给多个线程；宽的结构和垃圾分布在多个块中
+    auto* tail = list;
+    for (int i = 0; i < 20000; i++)
+    {
+        auto* node = vm.allocate<ObjList>();
+        tail->push(node);
+        vm.writeBarrier(tail, node);
+        if (i % 2 == 0) tail = node;
+        vm.allocate<ObjList>();
+    }
+    vm.collectGarbage();
+    const uint64_t collections = vm.gcStats.fullCollections;
+    vm.collectFull();
+    check("并行回收完成", vm.gcPhase == VM::GCPhase::IDLE && vm.gcStats.fullCollections == collections + 1);
+    check("并行标记保留可达对象", countOldLists(vm) == 20001);
+
+    bool cleared = true;
+    vm.heap.forEachCell([&](void* cell) { cleared = cleared && !Heap::isMarked(cell); });
+    check("并行清理复位标记位", cleared);
+
+    // 清空根列表后，下一轮回收释放所有节点
+    list->elements.clear();
+    vm.collectFull();
+    check("并行清理释放不可达对象", countOldLists(vm) == 1);
+}
+
+void testPackedList()
+{
+    std::cout << "=== 测试数字数组 ===" << std::endl;
+
+    VM vm;
+    auto* list = vm.allocate<ObjList>();
+    vm.defineGlobal(vm.newString("root"), list);
+    for (int i = 0; i < 100; i++) list->push(i * 0.5);
+    check("只含数字时为 DOUBLE", list->isPackedDouble());
+
+    // 写入对象后转为通用元素类型，回收时扫描元素
+    vm.collectGarbage();
+    ObjString* str = vm.newString("element");
+    list->push(str);
+    vm.writeBarrier(list, str);
+    check("写入非数字转为 GENERIC", !list->isPackedDouble());
+    vm.collectGarbage();
+    vm.collectFull();
+    check("GENERIC 数组的元素存活", vm.strings.contains(str) && list->elements.back() == Value(str));
+}
+
+void testObjectLiteral()
+{
+    std::cout << "=== 测试对象字面量模板 ===" << std::endl;
+
+    VM vm;
+    vm.registerNative();
+    Scanner scanner(R"(
+        let all = [];
+        for (let i = 0; i < 100; i++) { all.push({a: i, b: "x", a: i + 1}); }
+    )");
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    vm.interpret(compiler.compile(parser.parse()));
+
+    Value all;
+    vm.getGlobal(vm.newString("all"), all);
+    const auto& elements = objAs<ObjList>(all)->elements;
+    auto* first = objAs<ObjInstance>(elements.front());
+    auto* last = objAs<ObjInstance>(elements.back());
+    check("同一处字面量共享类和形状", first->klass == last->klass && first->shape == last->shape);
+    Value a;
+    check("重复属性名写入同一槽位", last->shape->slotCount == 2 &&
+          last->getField(vm.newString("a"), a) && a == Value(100.0));
+}
+
+void testInstancePayload()
+{
+    std::cout << "=== 测试实例字段的附属内存统计 ===" << std::endl;
+
+    VM vm;
+    vm.registerNative();
+    Scanner scanner(R"(
+        class Point { constructor(x, y) { this.x = x; this.y = y; this.z = x + y; } }
+        let all = [];
+        for (let i = 0; i < 100; i++) { all.push(new Point(i, i)); }
+    )");
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    vm.interpret(compiler.compile(parser.parse()));
+
+    Value all;
+    vm.getGlobal(vm.newString("all"), all);
+    // 第一个实例之后的字段都经内联缓存添加，同样要计入附属内存
+    const auto* last = objAs<ObjInstance>(objAs<ObjList>(all)->elements.back());
+    check("内联缓存添加字段时统计附属内存", last->fields.size() == 3 && last->payload == payloadBytes(last));
+}
+
+void testRope()
+{
+    std::cout << "=== 测试绳节点 ===" << std::endl;
+
+    VM vm;
+    vm.stack.emplace_back(vm.newString(""));
+    for (int i = 0; i < 1000; i++)
+    {
+        vm.stack.emplace_back(vm.newString("piece-" + std::to_string(i)));
+        vm.concatenate();
+    }
+    check("长拼接生成绳节点", isObjType(vm.stack.back(), ObjType::ROPE));
+
+    // 绳节点的子节点在回收后仍然存活
+    vm.collectGarbage();
+    vm.collectFull();
+    std::string expected;
+    for (int i = 0; i < 1000; i++) expected += "piece-" + std::to_string(i);
+    auto* rope = objAs<ObjRope>(vm.stack.back());
+    check("回收后内容不变", rope->length == expected.size() && valToString(rope) == expected);
+
+    ObjString* flat = vm.flatten(rope);
+    check("展平结果已驻留", flat == vm.newString(expected) && rope->flat == flat && !rope->left);
+
+    vm.stack.emplace_back(vm.newString("a"));
+    vm.stack.emplace_back(1.0);
+    vm.concatenate();
+    check("短拼接直接生成字符串", vm.stack.back() == Value(vm.newString("a1")));
+    vm.stack.clear();
+}
+
+void testHeapLimit()
+{
+    std::cout << "=== 测试堆上限 ===" << std::endl;
+
+    VM vm;
+    vm.setMaxHeap(1);
+    auto* list = vm.allocate<ObjList>();
+    vm.defineGlobal(vm.newString("root"), list);
+
+    // 不可达的对象和附属内存在达到上限前被回收
+    for (int i = 0; i < 10000; i++) vm.newString(std::string(1000, 'a') + std::to_string(i));
+    check("垃圾不触发内存不足", vm.bytesAllocated <= vm.maxHeap);
+
+    bool outOfMemory = false;
+    try
+    {
+        for (int i = 0; i < 10000; i++)
+        {
+            ObjString* str = vm.newString(std::string(1000, 'b') + std::to_string(i));
+            list->push(str);
+            vm.writeBarrier(list, str);
+        }
+    }
+    catch (const std::runtime_error&)
+    {
+        outOfMemory = true;
+    }
+    check("存活数据超过上限时报错", outOfMemory && list->elements.size() < 1100);
+}
+
+int main()
+{
+    testHeap();
+    testGenerational();
+    testIncremental();
+    testConcurrent();
+    testParallel();
+    testPackedList();
+    testObjectLiteral();
+    testInstancePayload();
+    testRope();
+    testHeapLimit();
+
+    return checkFailures == 0 ? 0 : 1;
+}
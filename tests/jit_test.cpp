@@ -1,14 +1,22 @@
 #include "jit.h"
 #include "object.h"
 #include "parser.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <unistd.h>
 
 #include "compiler.h"
 #include "scanner.h"
+#include "vm.h"
+#include "test_check.h"
 
 void testWithChunk()
 {
     JitCompiler compiler;
+    JitContext ctx;
 
     // 测试 1: (10 + 20) - 5 = 25
     Chunk chunk1;
@@ -57,8 +65,8 @@ void testWithChunk()
     std::cout << "=== 测试 1: (10 + 20) - 5 ===" << std::endl;
     if (const auto func1 = compiler.compile(&chunk1))
     {
-        double args[1] = {0.0};
-        const double result1 = func1(args);
+        Value args[1] = {0.0};
+        const double result1 = func1(args, &ctx);
         std::cout << "JIT 执行结果: " << result1 << std::endl;
     }
     else
@@ -70,8 +78,8 @@ void testWithChunk()
     std::cout << "=== 测试 2: (20 * 5) / 4 ===" << std::endl;
     if (const auto func2 = compiler.compile(&chunk2))
     {
-        double args[1] = {0.0};
-        const double result2 = func2(args);
+        Value args[1] = {0.0};
+        const double result2 = func2(args, &ctx);
         std::cout << "JIT 执行结果: " << result2 << std::endl;
     }
     else
@@ -98,8 +106,8 @@ void testWithChunk()
     std::cout << "=== 测试 3: 10 % 3 ===" << std::endl;
     if (const auto func3 = compiler.compile(&chunk3))
     {
-        double args[1] = {0.0};
-        const double result3 = func3(args);
+        Value args[1] = {0.0};
+        const double result3 = func3(args, &ctx);
         std::cout << "JIT 执行结果: " << result3 << std::endl;
     }
     else
@@ -111,6 +119,7 @@ void testWithChunk()
 void testWithScript()
 {
     JitCompiler compiler;
+    JitContext ctx;
 
     // 测试脚本: return (15 + 10) * 2;
     const std::string script = R"(
@@ -132,8 +141,8 @@ void testWithScript()
     std::cout << "=== 测试脚本: return (15 + 10) * 2; ===" << std::endl;
     if (const auto func = compiler.compile(&chunk))
     {
-        double args[1] = {0.0};
-        const double result = func(args);
+        Value args[1] = {0.0};
+        const double result = func(args, &ctx);
         std::cout << "JIT 执行结果: " << result << std::endl;
     }
     else
@@ -142,9 +151,417 @@ void testWithScript()
     }
 }
 
+// 编译脚本并取出其中定义的第一个函数
+const ObjFunction* compileFunction(VM& vm, const std::string& script)
+{
+    Scanner scanner(script);
+    Parser parser(scanner.scanTokens());
+    Compiler comp(vm);
+    const ObjFunction* function = comp.compile(parser.parse());
+    for (const Value& v : function->chunk.constants)
+    {
+        if (isObjType(v, ObjType::FUNCTION)) return objAs<ObjFunction>(v);
+    }
+    return nullptr;
+}
+
+void testWithLocals()
+{
+    JitCompiler compiler;
+    JitContext ctx;
+    VM vm;
+    const ObjFunction* f = compileFunction(vm, R"(
+        function f(a, b) { let c = a * b; c = c + 1; return c - a; }
+    )");
+
+    std::cout << "=== 测试局部变量: f(3, 4) ===" << std::endl;
+    if (const auto func = compiler.compile(&f->chunk, f->arity))
+    {
+        Value args[2] = {3.0, 4.0};
+        const double result = func(args, &ctx);
+        std::cout << "JIT 执行结果: " << result << std::endl;
+        check("局部变量保存在寄存器中", result == 10.0);
+    }
+    else
+    {
+        std::cerr << "JIT 编译失败" << std::endl;
+    }
+}
+
+void testControlFlow()
+{
+    JitCompiler compiler;
+    JitContext ctx;
+    VM vm;
+    const ObjFunction* factorial = compileFunction(vm, R"(
+        let factorial = (a) => {
+            if (a <= 1) return 1;
+            let total = 1;
+            for (let i = 1; i <= a; i++) { total *= i; }
+            return total;
+        };
+    )");
+    const ObjFunction* collatz = compileFunction(vm, R"(
+        function collatz(n) {
+            let steps = 0;
+            while (!(n == 1)) {
+                if (n % 2 == 0) { n = n / 2; } else { n = 3 * n + 1; }
+                steps++;
+            }
+            return steps;
+        }
+    )");
+
+    std::cout << "=== 测试控制流: factorial(10), collatz(27) ===" << std::endl;
+    const auto fact = compiler.compile(&factorial->chunk, factorial->arity);
+    const auto steps = compiler.compile(&collatz->chunk, collatz->arity);
+    if (fact && steps)
+    {
+        Value args[1] = {10.0};
+        check("循环与比较", fact(args, &ctx) == 3628800.0);
+        args[0] = 1.0;
+        check("提前返回", fact(args, &ctx) == 1.0);
+        args[0] = 27.0;
+        check("嵌套分支", steps(args, &ctx) == 111.0);
+    }
+    else
+    {
+        std::cerr << "JIT 编译失败" << std::endl;
+    }
+}
+
+void testModulo()
+{
+    std::cout << "=== 测试取模 ===" << std::endl;
+
+    VM vm;
+    vm.setJITThreshold(3);
+    vm.setJITBackground(false);
+    Scanner scanner(R"(
+        function m(a, b) { return a % b; }
+        let r = 0;
+        for (let i = 0; i < 5; i++) { r = m(7, 3); }
+        let zero = m(5, 0);
+        let big = m(100000000000000000000000, 3);
+        let negative = m(-7.5, 2);
+    )");
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    vm.interpret(compiler.compile(parser.parse()));
+
+    Value m, zero, big, negative;
+    vm.getGlobal(vm.newString("m"), m);
+    vm.getGlobal(vm.newString("zero"), zero);
+    vm.getGlobal(vm.newString("big"), big);
+    vm.getGlobal(vm.newString("negative"), negative);
+    // 结果与解释器的 fmod 一致
+    check("取模已编译", objAs<ObjClosure>(m)->function->jitFunction != nullptr);
+    check("除数为 0 得到 NaN", zero.isNumber() && std::isnan(zero.asNumber()));
+    check("商超出整数范围", big.isNumber() && big.asNumber() == 2.0);
+    check("负数取模保留被除数的符号", negative.isNumber() && negative.asNumber() == -1.5);
+}
+
+void testComparison()
+{
+    std::cout << "=== 测试小于等于和大于等于 ===" << std::endl;
+
+    VM vm;
+    vm.setJITThreshold(3);
+    vm.setJITBackground(false);
+    Scanner scanner(R"(
+        function le(a, b) { if (a <= b) return 1; return 0; }
+        function ge(a, b) { if (a >= b) return 1; return 0; }
+        let n = 0 / 0;
+        let count = 0;
+        for (let i = 0; i < 10; i++) { count = count + le(i, 5) + ge(i, 5) * 10; }
+        let nanLe = le(n, 1) + le(1, n);
+        let nanGe = ge(n, 1) + ge(1, n);
+        let interpreted = n <= 1 || n >= 1;
+    )");
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    vm.interpret(compiler.compile(parser.parse()));
+
+    Value le, count, nanLe, nanGe, interpreted;
+    vm.getGlobal(vm.newString("le"), le);
+    vm.getGlobal(vm.newString("count"), count);
+    vm.getGlobal(vm.newString("nanLe"), nanLe);
+    vm.getGlobal(vm.newString("nanGe"), nanGe);
+    vm.getGlobal(vm.newString("interpreted"), interpreted);
+    check("边界值", objAs<ObjClosure>(le)->function->jitFunction != nullptr && count == Value(56.0));
+    // NaN 参与的比较都为假，不等于大于或小于取反
+    check("机器码中 NaN 比较为假", nanLe == Value(0.0) && nanGe == Value(0.0));
+    check("解释器中 NaN 比较为假", interpreted == Value(false));
+}
+
+void testTierUp()
+{
+    std::cout << "=== 测试分层编译阈值 ===" << std::endl;
+
+    VM vm;
+    vm.setJITThreshold(3);
+    // 同步编译，到达阈值的那次调用就能用上机器码
+    vm.setJITBackground(false);
+    // 读取字符串全局变量的函数 JIT 无法编译
+    Scanner scanner(R"(
+        let g = "g";
+        function cold(x) { return g + x; }
+        function hot(x) { return g + x; }
+        let s = cold(1);
+        for (let i = 0; i < 10; i++) { s = hot(i); }
+    )");
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    vm.interpret(compiler.compile(parser.parse()));
+
+    Value cold, hot;
+    vm.getGlobal(vm.newString("cold"), cold);
+    vm.getGlobal(vm.newString("hot"), hot);
+    const auto* coldFn = objAs<ObjClosure>(cold)->function;
+    const auto* hotFn = objAs<ObjClosure>(hot)->function;
+    check("未达阈值不编译", coldFn->callCount == 1 && !coldFn->jitFailed);
+    check("编译失败后不再计数和重试", hotFn->callCount == 3 && hotFn->jitFailed && hotFn->jitFunction == nullptr);
+}
+
+void testCalls()
+{
+    std::cout << "=== 测试 JIT 函数之间的调用 ===" << std::endl;
+
+    VM vm;
+    vm.setJITThreshold(3);
+    vm.setJITBackground(false);
+    Scanner scanner(R"(
+        function fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }
+        function sq(x) { return x * x; }
+        function sumsq(n) { let s = 0; for (let i = 0; i < n; i++) { s = s + sq(i); } return s; }
+        let f = 0;
+        for (let i = 0; i < 5; i++) { f = fib(20); }
+        let a = 0;
+        for (let k = 0; k < 5; k++) { a = sumsq(10); }
+        sq = (x) => { return x; };
+        let b = sumsq(10);
+    )");
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    vm.interpret(compiler.compile(parser.parse()));
+
+    Value fib, sumsq, f, a, b;
+    vm.getGlobal(vm.newString("fib"), fib);
+    vm.getGlobal(vm.newString("sumsq"), sumsq);
+    vm.getGlobal(vm.newString("f"), f);
+    vm.getGlobal(vm.newString("a"), a);
+    vm.getGlobal(vm.newString("b"), b);
+    const auto* fibFn = objAs<ObjClosure>(fib)->function;
+    const auto* sumsqFn = objAs<ObjClosure>(sumsq)->function;
+    check("递归调用", f.isNumber() && f.asNumber() == 6765.0 && fibFn->jitFunction != nullptr);
+    check("调用其他 JIT 函数", a.isNumber() && a.asNumber() == 285.0);
+    // 被调函数被替换后，调用方从调用处去优化；循环的 OSR 代码也引用着旧的闭包，
+    // 每次回边都在同一处去优化，达到上限后机器码全部丢弃
+    check("被调函数变化时回退", b.isNumber() && b.asNumber() == 45.0 && sumsqFn->jitFunction == nullptr);
+}
+
+void testDeopt()
+{
+    std::cout << "=== 测试类型守卫与去优化 ===" << std::endl;
+
+    VM vm;
+    vm.setJITThreshold(3);
+    vm.setJITBackground(false);
+    Scanner scanner(R"(
+        let step = 1;
+        function inner(n) { return n + step; }
+        function outer(n) { let t = 0; for (let i = 0; i < n; i++) { t = t + inner(i); } return t; }
+        let warm = 0;
+        for (let k = 0; k < 5; k++) { warm = outer(4); }
+        step = "a";
+        let cold = outer(3);
+    )");
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    vm.interpret(compiler.compile(parser.parse()));
+
+    Value inner, outer, warm, cold;
+    vm.getGlobal(vm.newString("inner"), inner);
+    vm.getGlobal(vm.newString("outer"), outer);
+    vm.getGlobal(vm.newString("warm"), warm);
+    vm.getGlobal(vm.newString("cold"), cold);
+    const auto* innerFn = objAs<ObjClosure>(inner)->function;
+    const auto* outerFn = objAs<ObjClosure>(outer)->function;
+    check("推测全局变量为数字", warm.isNumber() && warm.asNumber() == 10.0 && outerFn->jitFunction != nullptr);
+    // 第一次在 inner 的机器码中途去优化，调用方 outer 的帧也一并重建；之后两次由解释器调用 inner
+    check("去优化后从中途恢复", isStringLike(cold) && valToString(cold) == "00a1a2a");
+    // outer 循环的 OSR 代码推测 t 是数字，每次回边都在入口处发现类型不符
+    check("记录去优化次数", innerFn->deoptCount == 3 && outerFn->deoptCount == 3);
+}
+
+void testCalleeReassigned()
+{
+    std::cout << "=== 测试求值参数时改写被调函数 ===" << std::endl;
+
+    VM vm;
+    vm.setJITThreshold(3);
+    vm.setJITBackground(false);
+    Scanner scanner(R"(
+        function f(x) { return x + 1; }
+        function setF(n) { if (n > 5) { f = 7; } return n; }
+        function h(n) { return f(setF(n)); }
+        let r = 0;
+        for (let i = 0; i < 7; i++) { r = h(i); }
+    )");
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    vm.interpret(compiler.compile(parser.parse()));
+
+    Value h, f, r;
+    vm.getGlobal(vm.newString("h"), h);
+    vm.getGlobal(vm.newString("f"), f);
+    vm.getGlobal(vm.newString("r"), r);
+    check("被调函数已编译", objAs<ObjClosure>(h)->function->jitFunction != nullptr);
+    // 与解释器一致：被调函数在求值参数之前读取，改写全局变量的那次调用仍调用原来的闭包
+    check("调用读取时的闭包", f == Value(7.0) && r.isNumber() && r.asNumber() == 7.0);
+}
+
+void testOSR()
+{
+    std::cout << "=== 测试循环的栈上替换 ===" << std::endl;
+
+    VM vm;
+    vm.setJITThreshold(3);
+    vm.setJITBackground(false);
+    Scanner scanner(R"(
+        let total = 0;
+        for (let i = 0; i < 10; i++) {
+            for (let j = 0; j < 10; j++) { total = total + i * j; }
+        }
+        function root(n) { let k = 0; while (true) { k = k + 1; if (k * k > n) return k; } }
+        let r = root(5000);
+    )");
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    ObjFunction* script = compiler.compile(parser.parse());
+    vm.interpret(script);
+    // 脚本函数之后可能被回收，先记下结果
+    const bool scriptOSR = !script->osrEntries.empty() && script->osrEntries[0].second != nullptr;
+
+    Value root, total, r;
+    vm.getGlobal(vm.newString("root"), root);
+    vm.getGlobal(vm.newString("total"), total);
+    vm.getGlobal(vm.newString("r"), r);
+    const auto* rootFn = objAs<ObjClosure>(root)->function;
+    // 内层循环先变热，从它的循环头进入机器码
+    check("顶层循环转入机器码", total.isNumber() && total.asNumber() == 2025.0 && scriptOSR);
+    check("只调用一次的函数", r.isNumber() && r.asNumber() == 71.0 && rootFn->jitFunction == nullptr &&
+          rootFn->osrEntries.size() == 1 && rootFn->osrEntries[0].second != nullptr);
+
+    // 循环体含有不支持的指令时编译失败，之后重新计数而不是每次回边都尝试进入
+    Scanner listScanner(R"(
+        function build(n) { let items = []; for (let i = 0; i < n; i++) { items = [i]; } return items; }
+        let items = build(100);
+    )");
+    Parser listParser(listScanner.scanTokens());
+    Compiler listCompiler(vm);
+    vm.interpret(listCompiler.compile(listParser.parse()));
+    Value build;
+    vm.getGlobal(vm.newString("build"), build);
+    const auto* buildFn = objAs<ObjClosure>(build)->function;
+    check("OSR 编译失败后重新计数", buildFn->osrEntries.size() == 1 && buildFn->osrEntries[0].second == nullptr &&
+          buildFn->loopCount < 3);
+}
+
+void testBackground()
+{
+    std::cout << "=== 测试后台编译 ===" << std::endl;
+
+    VM vm;
+    vm.setJITThreshold(3);
+    Scanner scanner(R"(
+        function fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }
+        let f = 0;
+        for (let i = 0; i < 5; i++) { f = fib(15); }
+    )");
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    vm.interpret(compiler.compile(parser.parse()));
+    vm.waitForJIT();
+
+    Value fib, f;
+    vm.getGlobal(vm.newString("fib"), fib);
+    vm.getGlobal(vm.newString("f"), f);
+    const auto* fibFn = objAs<ObjClosure>(fib)->function;
+    // 编译期间解释器继续执行，结果不受影响
+    check("编译期间继续解释执行", f.isNumber() && f.asNumber() == 610.0);
+    check("编译完成后安装机器码", fibFn->jitFunction != nullptr && !fibFn->jitQueued);
+}
+
+void testPerfMap()
+{
+    std::cout << "=== 测试 perf 符号输出 ===" << std::endl;
+
+    const std::string mapPath = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    const std::string dumpPath = "/tmp/jit-" + std::to_string(getpid()) + ".dump";
+    {
+        VM vm;
+        vm.setJITThreshold(3);
+        vm.setJITBackground(false);
+        check("打开输出文件", vm.enableJITPerfMap() && vm.enableJITDump());
+        Scanner scanner(R"(
+            function square(x) { return x * x; }
+            let s = 0;
+            for (let i = 0; i < 5; i++) { s = s + square(i); }
+        )");
+        Parser parser(scanner.scanTokens());
+        Compiler compiler(vm);
+        vm.interpret(compiler.compile(parser.parse()));
+    }
+
+    std::ifstream map(mapPath);
+    std::string line;
+    bool found = false;
+    while (std::getline(map, line))
+    {
+        // 起始地址 长度 符号名
+        std::istringstream fields(line);
+        std::string address, size, name;
+        fields >> address >> size >> name;
+        found = found || (name == "js::square" && std::stoul(size, nullptr, 16) > 0);
+    }
+    check("perf map 记录函数名和长度", found);
+
+    std::ifstream dump(dumpPath, std::ios::binary);
+    uint32_t magic = 0;
+    dump.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    check("jitdump 文件头", magic == 0x4A695444);
+
+    std::remove(mapPath.c_str());
+    std::remove(dumpPath.c_str());
+}
+
 int main()
 {
     testWithChunk();
 
     testWithScript();
+
+    testWithLocals();
+
+    testControlFlow();
+
+    testModulo();
+
+    testComparison();
+
+    testTierUp();
+
+    testCalls();
+
+    testDeopt();
+    testCalleeReassigned();
+
+    testOSR();
+
+    testBackground();
+
+    testPerfMap();
+
+    return checkFailures == 0 ? 0 : 1;
 }
@@ -0,0 +1,206 @@
+#include "vm.h"
+#include "compiler.h"
+#include "parser.h"
+#include "scanner.h"
+#include "test_check.h"
+#include <algorithm>
+#include <iostream>
+
+void run(VM& vm, const char* source)
+{
+    Scanner scanner(source);
+    Parser parser(scanner.scanTokens());
+    Compiler compiler(vm);
+    vm.interpret(compiler.compile(parser.parse()));
+}
+
+Value global(VM& vm, const char* name)
+{
+    Value value;
+    vm.getGlobal(vm.newString(name), value);
+    return value;
+}
+
+ObjFunction* globalFunction(VM& vm, const char* name)
+{
+    return objAs<ObjClosure>(global(vm, name))->function;
+}
+
+bool hasOpCode(const ObjFunction* function, const OpCode op)
+{
+    return std::ranges::find(function->chunk.code, static_cast<uint8_t>(op)) != function->chunk.code.end();
+}
+
+void testInterning()
+{
+    std::cout << "=== 测试字符串驻留 ===" << std::endl;
+
+    VM vm;
+    ObjString* a = vm.newString("abc");
+    check("相同内容得到同一对象", a == vm.newString(std::string("ab") + "c"));
+    check("不同内容得到不同对象", a != vm.newString("abd"));
+
+    // 运行时拼接出的字符串同样驻留，属性名和全局变量名可以按指针比较
+    run(vm, R"(let s = "ab" + "c"; let key = "k"; let o = {k: 1}; let v = o[key + ""];)");
+    check("拼接结果驻留", global(vm, "s") == Value(a));
+    check("拼接出的属性名", global(vm, "v") == Value(1.0));
+}
+
+void testShapes()
+{
+    std::cout << "=== 测试实例形状 ===" << std::endl;
+
+    VM vm;
+    run(vm, R"(
+        class P { constructor(x, y) { this.x = x; this.y = y; } }
+        let p = new P(1, 2);
+        let q = new P(3, 4);
+        let r = new P(5, 6);
+        let u = new P(7, 8);
+        r.z = 9;
+        u.z = 10;
+        let ry = r.y;
+    )");
+    const auto* p = objAs<ObjInstance>(global(vm, "p"));
+    const auto* q = objAs<ObjInstance>(global(vm, "q"));
+    auto* r = objAs<ObjInstance>(global(vm, "r"));
+    const auto* u = objAs<ObjInstance>(global(vm, "u"));
+    check("同样顺序添加字段的实例共享形状", p->shape == q->shape && p->shape->slotCount == 2);
+    check("添加字段转换到新形状", r->shape != p->shape && r->shape->slotCount == 3);
+    check("相同转换得到同一形状", r->shape == u->shape);
+    Value z;
+    check("字段值按槽位保存", r->getField(vm.newString("z"), z) && z == Value(9.0) &&
+          global(vm, "ry") == Value(6.0));
+}
+
+void testInlineCache()
+{
+    std::cout << "=== 测试属性访问内联缓存 ===" << std::endl;
+
+    VM vm;
+    vm.registerNative();
+    run(vm, R"(
+        function getX(o) { return o.x; }
+        function getY(o) { return o.y; }
+        let four = [{x: 1}, {a: 0, x: 2}, {b: 0, x: 3}, {c: 0, x: 4}];
+        let six = [{y: 1}, {a: 0, y: 2}, {b: 0, y: 3}, {c: 0, y: 4}, {d: 0, y: 5}, {e: 0, y: 6}];
+        let sumX = 0;
+        let sumY = 0;
+        for (let k = 0; k < 3; k++) {
+            for (let i = 0; i < 4; i++) { sumX = sumX + getX(four[i]); }
+            for (let i = 0; i < 6; i++) { sumY = sumY + getY(six[i]); }
+        }
+
+        class A { constructor() { this.v = 1; } m() { return this.v; } }
+        let a = new A();
+        let before = 0;
+        for (let i = 0; i < 5; i++) { before = before + a.m(); }
+        a.m = function() { return 42; };
+        let after = a.m();
+        let fresh = new A();
+        let other = fresh.m();
+    )");
+    const PropertyCache& poly = globalFunction(vm, "getX")->chunk.propertyCaches[0];
+    const PropertyCache& mega = globalFunction(vm, "getY")->chunk.propertyCaches[0];
+    check("多态缓存最多容纳 4 种形状", global(vm, "sumX") == Value(30.0) && poly.count == 4 && !poly.megamorphic);
+    check("第 5 种形状后转为超多态", global(vm, "sumY") == Value(63.0) && mega.megamorphic);
+    check("缓存的方法被实例字段遮蔽", global(vm, "before") == Value(5.0) && global(vm, "after") == Value(42.0));
+    check("其他实例仍调用方法", global(vm, "other") == Value(1.0));
+    check("命中内联缓存", vm.icStats.hits > 0);
+}
+
+void testGlobalSlots()
+{
+    std::cout << "=== 测试全局变量槽位 ===" << std::endl;
+
+    VM vm;
+    run(vm, R"(
+        function readLater() { return later; }
+        let later = 7;
+        let first = readLater();
+        later = 8;
+        let second = readLater();
+    )");
+    check("函数读取之后定义的全局变量", global(vm, "first") == Value(7.0));
+    check("赋值后读到新值", global(vm, "second") == Value(8.0));
+
+    // 另一段脚本按名字使用同一槽位
+    run(vm, "let third = readLater(); later = 9;");
+    check("跨脚本共享槽位", global(vm, "third") == Value(8.0) && global(vm, "later") == Value(9.0));
+
+    vm.removeGlobal(vm.newString("later"));
+    Value removed;
+    check("删除后不再定义", !vm.getGlobal(vm.newString("later"), removed));
+}
+
+void testInvoke()
+{
+    std::cout << "=== 测试方法调用指令 ===" << std::endl;
+
+    VM vm;
+    vm.registerNative();
+    run(vm, R"(
+        class Counter {
+            constructor() { this.n = 0; }
+            inc(step) { this.n = this.n + step; return this; }
+        }
+        let c = new Counter();
+        for (let i = 0; i < 10; i++) { c.inc(i); }
+        let d = new Counter();
+        let chained = d.inc(1).inc(2).n;
+        let list = [];
+        for (let i = 0; i < 3; i++) { list.push(i); }
+        let bound = c.inc;
+        bound(100);
+    )");
+    check("方法接收 this 和参数", objAs<ObjInstance>(global(vm, "c"))->fields[0] == Value(145.0));
+    check("链式调用", global(vm, "chained") == Value(3.0));
+    check("原生方法", objAs<ObjList>(global(vm, "list"))->elements.size() == 3);
+
+    // 只有取出方法值时才创建绑定方法
+    size_t boundMethods = 0;
+    vm.heap.forEachCell([&](void* cell)
+    {
+        if (static_cast<Obj*>(cell)->type == ObjType::BOUND_METHOD) boundMethods++;
+    });
+    check("调用不创建绑定方法", boundMethods == 1);
+}
+
+void testQuickening()
+{
+    std::cout << "=== 测试指令特化 ===" << std::endl;
+
+    VM vm;
+    vm.enableJIT(false);
+    run(vm, R"(
+        function add(a, b) { return a + b; }
+        function less(a, b) { return a < b; }
+        let n1 = add(1, 2);
+    )");
+    ObjFunction* add = globalFunction(vm, "add");
+    check("数字加法特化", global(vm, "n1") == Value(3.0) && hasOpCode(add, OpCode::OP_ADD_NUM));
+
+    run(vm, R"(let s = add("a", "b");)");
+    check("类型改变后改回通用指令再特化", global(vm, "s") == Value(vm.newString("ab")) &&
+          hasOpCode(add, OpCode::OP_ADD_STR) && !hasOpCode(add, OpCode::OP_ADD_NUM));
+
+    run(vm, R"(let n2 = add(3, 4);)");
+    check("再次遇到数字", global(vm, "n2") == Value(7.0) && hasOpCode(add, OpCode::OP_ADD_NUM));
+
+    run(vm, R"(let mixed = add("x", 1); let lt = less(1, 2);)");
+    check("混合类型保持通用指令", global(vm, "mixed") == Value(vm.newString("x1")) &&
+          hasOpCode(add, OpCode::OP_ADD) && !hasOpCode(add, OpCode::OP_ADD_NUM));
+    check("比较特化", global(vm, "lt") == Value(true) && hasOpCode(globalFunction(vm, "less"), OpCode::OP_LESS_NUM));
+}
+
+int main()
+{
+    testInterning();
+    testShapes();
+    testInlineCache();
+    testGlobalSlots();
+    testInvoke();
+    testQuickening();
+
+    return checkFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+#ifndef TINY_JS_TEST_CHECK_H
+#define TINY_JS_TEST_CHECK_H
+
+#include <iostream>
+
+// 失败的检查数，测试程序以此作为退出码，ctest 据此判断是否通过
+inline int checkFailures = 0;
+
+inline void check(const char* name, const bool ok)
+{
+    std::cout << (ok ? "[PASS] " : "[FAIL] ") << name << std::endl;
+    if (!ok) checkFailures++;
+}
+
+#endif // TINY_JS_TEST_CHECK_H
@@ -0,0 +1,67 @@
+#include "object.h"
+#include "test_check.h"
+#include <iostream>
+#include <cmath>
+
+void testNaNBoxing()
+{
+    std::cout << "=== 测试 NaN-boxing Value ===" << std::endl;
+
+    check("sizeof(Value) == 8", sizeof(Value) == 8);
+
+    const Value nil = Value::nil();
+    check("nil", nil.isNil() && !nil.isBool() && !nil.isNumber() && !nil.isObj());
+
+    const Value t = true;
+    const Value f = false;
+    check("bool", t.isBool() && f.isBool() && t.asBool() && !f.asBool() && !t.isNumber());
+
+    const Value n = 3.5;
+    check("number", n.isNumber() && n.asNumber() == 3.5 && !n.isObj());
+
+    const Value negZero = -0.0;
+    check("-0.0", negZero.isNumber() && std::signbit(negZero.asNumber()));
+
+    const Value nan = std::nan("");
+    check("NaN 仍为数字", nan.isNumber() && std::isnan(nan.asNumber()));
+    check("NaN != NaN", !(nan == nan));
+
+    const Value inf = INFINITY;
+    check("Infinity", inf.isNumber() && std::isinf(inf.asNumber()));
+
+    ObjString str("hello");
+    const Value o = static_cast<Obj*>(&str);
+    check("object", o.isObj() && o.asObj() == &str && !o.isNumber() && !o.isNil());
+    check("isObjType", isObjType(o, ObjType::STRING) && !isObjType(n, ObjType::STRING));
+
+    check("相等比较", Value(1.0) == Value(1.0) && !(Value(1.0) == Value(true)) && nil == Value());
+    check("fromBits/raw 往返", Value::fromBits(n.raw()) == n && Value::fromBits(o.raw()).asObj() == &str);
+}
+
+void testObjHeader()
+{
+    std::cout << "=== 测试对象头 ===" << std::endl;
+
+    check("sizeof(Obj) == 16", sizeof(Obj) == 16);
+
+    ObjString str("hello");
+    ObjList list;
+    const Value s = static_cast<Obj*>(&str);
+    check("objAs", objAs<ObjString>(s) == &str && objAs<ObjList>(&list) == &list);
+    check("objCast", objCast<ObjString>(s) == &str && objCast<ObjList>(s) == nullptr &&
+          objCast<ObjString>(Value(1.0)) == nullptr);
+
+    ObjClass klass("File");
+    ObjInstance plain(&klass);
+    ObjNativeInstance native(&klass);
+    check("原生实例", isObj<ObjInstance>(&native) && isObj<ObjNativeInstance>(&native) &&
+          !isObj<ObjNativeInstance>(&plain));
+}
+
+int main()
+{
+    testNaNBoxing();
+    testObjHeader();
+
+    return checkFailures == 0 ? 0 : 1;
+}